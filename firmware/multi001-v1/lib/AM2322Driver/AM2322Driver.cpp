@@ -0,0 +1,138 @@
+/**********************************************************************
+ * AM2322Driver.cpp - SensorDriver for an AM2320/AM2322 I2C humidity
+ * and temperature sensor.
+ */
+
+#include "AM2322Driver.h"
+#include <Profiler.h>
+
+#define AM2322_READ_REGISTERS 0x03
+#define AM2322_HUMIDITY_REGISTER 0x00
+#define AM2322_REGISTER_COUNT 4
+#define AM2322_RESPONSE_SIZE (2 + AM2322_REGISTER_COUNT + 2)
+
+AM2322Driver::AM2322Driver(TwoWire &wire, uint8_t sdaPin, uint8_t sclPin, unsigned long warmup) : wire(wire), sdaPin(sdaPin), sclPin(sclPin), warmup(warmup) {
+  this->state = IDLE;
+  this->startTime = this->lastRead = 0UL;
+  this->phaseStart = 0UL;
+  this->sampleRequested = true;
+  this->sampled = false;
+  this->temperature = this->humidity = SAMPLE_INVALID_VALUE;
+}
+
+/**********************************************************************
+ * Detect the sensor and start its warm up period. Detection has to
+ * wake the sensor, which costs us a millisecond here in setup().
+ */
+bool AM2322Driver::begin() {
+  this->wire.begin(this->sdaPin, this->sclPin);
+  this->wake();
+  delayMicroseconds(AM2322_DRIVER_WAKE_TIME);
+  this->wire.beginTransmission(AM2322_DRIVER_ADDRESS);
+  if (this->wire.endTransmission() != 0) return(false);
+  this->startTime = millis();
+  this->lastRead = this->startTime - AM2322_DRIVER_MIN_INTERVAL;
+  this->sampleRequested = true;
+  return(true);
+}
+
+void AM2322Driver::startSample() {
+  this->sampleRequested = true;
+}
+
+/**********************************************************************
+ * Move any read along to its next phase. A read is started when a
+ * sample has been requested, the sensor is warm and the sensor's
+ * minimum interval between reads has passed.
+ */
+uint8_t AM2322Driver::poll() {
+  unsigned long now = millis();
+
+  switch (this->state) {
+    case IDLE:
+      if ((!this->sampleRequested) || ((now - this->startTime) < this->warmup) || ((now - this->lastRead) < AM2322_DRIVER_MIN_INTERVAL)) break;
+      this->wake();
+      this->phaseStart = micros();
+      this->state = WAKING;
+      break;
+    case WAKING:
+      if ((micros() - this->phaseStart) < AM2322_DRIVER_WAKE_TIME) break;
+      if (!this->requestRegisters()) return(this->finish(false));
+      this->phaseStart = micros();
+      this->state = READING;
+      break;
+    case READING:
+      if ((micros() - this->phaseStart) < AM2322_DRIVER_RESPONSE_TIME) break;
+      return(this->finish(this->readRegisters()));
+  }
+  return(0);
+}
+
+bool AM2322Driver::isReady() {
+  return(this->sampled);
+}
+
+void AM2322Driver::encode(SAMPLE &sample) {
+  sample.flags |= (SAMPLE_HAS_TEMPERATURE | SAMPLE_HAS_HUMIDITY);
+  sample.temperature = this->temperature;
+  sample.humidity = this->humidity;
+}
+
+/**********************************************************************
+ * The sensor sleeps between reads and wakes on seeing its address,
+ * which it does not acknowledge.
+ */
+void AM2322Driver::wake() {
+  this->wire.beginTransmission(AM2322_DRIVER_ADDRESS);
+  this->wire.endTransmission();
+}
+
+bool AM2322Driver::requestRegisters() {
+  this->wire.beginTransmission(AM2322_DRIVER_ADDRESS);
+  this->wire.write(AM2322_READ_REGISTERS);
+  this->wire.write(AM2322_HUMIDITY_REGISTER);
+  this->wire.write(AM2322_REGISTER_COUNT);
+  return(this->wire.endTransmission() == 0);
+}
+
+/**********************************************************************
+ * Retrieve and check the response to a read registers command and, if
+ * it is good, save the values it carries.
+ */
+bool AM2322Driver::readRegisters() {
+  PROFILE_SECTION("am2322.read");
+  uint8_t buffer[AM2322_RESPONSE_SIZE];
+  uint16_t magnitude;
+
+  if (this->wire.requestFrom(AM2322_DRIVER_ADDRESS, AM2322_RESPONSE_SIZE) != AM2322_RESPONSE_SIZE) return(false);
+  for (uint8_t i = 0; i < AM2322_RESPONSE_SIZE; i++) buffer[i] = this->wire.read();
+  if ((buffer[0] != AM2322_READ_REGISTERS) || (buffer[1] != AM2322_REGISTER_COUNT)) return(false);
+  if (crc16(buffer, AM2322_RESPONSE_SIZE - 2) != (uint16_t) (buffer[6] | (buffer[7] << 8))) return(false);
+  this->humidity = (int16_t) ((buffer[2] << 8) | buffer[3]);
+  magnitude = (((buffer[4] & 0x7F) << 8) | buffer[5]);
+  this->temperature = (int16_t) (((buffer[4] & 0x80)?-magnitude:magnitude) * 10);
+  return(true);
+}
+
+/**********************************************************************
+ * Complete a read, successful or otherwise, and report the new
+ * reading.
+ */
+uint8_t AM2322Driver::finish(bool ok) {
+  if (!ok) this->temperature = this->humidity = SAMPLE_INVALID_VALUE;
+  this->lastRead = millis();
+  this->sampleRequested = false;
+  this->sampled = true;
+  this->state = IDLE;
+  return(SENSOR_UPDATED);
+}
+
+uint16_t AM2322Driver::crc16(const uint8_t *buffer, uint8_t length) {
+  uint16_t crc = 0xFFFF;
+
+  while (length--) {
+    crc ^= *buffer++;
+    for (uint8_t i = 0; i < 8; i++) crc = (crc & 1)?((crc >> 1) ^ 0xA001):(crc >> 1);
+  }
+  return(crc);
+}
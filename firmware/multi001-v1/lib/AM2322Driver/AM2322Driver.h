@@ -0,0 +1,65 @@
+/**********************************************************************
+ * NAME
+ *   AM2322Driver.h - SensorDriver for an AM2320/AM2322 I2C humidity
+ *   and temperature sensor.
+ * DESCRIPTION
+ *   The sensor needs a warm up period after power on before its first
+ *   reading can be trusted. Rather than waiting for this in setup(),
+ *   the driver records when the sensor was woken and defers any
+ *   requested read until the warm up period has passed.
+ *
+ *   The sensor is read directly over I2C. A read consists of a wake
+ *   up, a read registers command and, a couple of milliseconds later,
+ *   the retrieval of the response. poll() steps through these phases
+ *   on successive calls, so it never waits on the sensor. The
+ *   response carries humidity in tenths of a percent and temperature
+ *   in sign-magnitude tenths of a degree, protected by a Modbus CRC,
+ *   so no floating point arithmetic is involved.
+ */
+
+#ifndef AM2322_DRIVER_H
+#define AM2322_DRIVER_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <SensorDriver.h>
+
+#define AM2322_DRIVER_ADDRESS 0x5C
+#define AM2322_DRIVER_WAKE_TIME 1000      // Microseconds from wake to command
+#define AM2322_DRIVER_RESPONSE_TIME 2000  // Microseconds from command to response
+#define AM2322_DRIVER_MIN_INTERVAL 2000   // Milliseconds between reads
+
+class AM2322Driver : public SensorDriver {
+  public:
+    AM2322Driver(TwoWire &wire, uint8_t sdaPin, uint8_t sclPin, unsigned long warmup);
+    const char *getName() { return("AM2322"); }
+    bool begin();
+    void startSample();
+    uint8_t poll();
+    bool isReady();
+    void encode(SAMPLE &sample);
+
+  private:
+    enum STATE { IDLE, WAKING, READING };
+
+    void wake();
+    bool requestRegisters();
+    bool readRegisters();
+    uint8_t finish(bool ok);
+    static uint16_t crc16(const uint8_t *buffer, uint8_t length);
+
+    TwoWire &wire;
+    uint8_t sdaPin;
+    uint8_t sclPin;
+    unsigned long warmup;
+    STATE state;
+    unsigned long startTime;              // millis() when woken by begin()
+    unsigned long lastRead;               // millis() at the last read
+    unsigned long phaseStart;             // micros() at the start of a phase
+    bool sampleRequested;
+    bool sampled;
+    int16_t temperature;                  // Hundredths of a degree Celsius
+    int16_t humidity;                     // Tenths of a percent
+};
+
+#endif
@@ -0,0 +1,51 @@
+/**********************************************************************
+ * BootProfile.cpp - record how long each phase of start up takes.
+ */
+
+#include "BootProfile.h"
+
+BootProfile::BootProfile() {
+  this->count = 0;
+}
+
+/**********************************************************************
+ * Record that <phase> has just completed.
+ */
+void BootProfile::mark(const char *phase) {
+  uint32_t now = micros();
+
+  if ((this->count < BOOT_PROFILE_MAX_PHASES) && (!this->isMarked(phase))) {
+    this->phases[this->count] = phase;
+    this->times[this->count] = now;
+    this->count++;
+  }
+}
+
+bool BootProfile::isMarked(const char *phase) {
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (strcmp(this->phases[i], phase) == 0) return(true);
+  }
+  return(false);
+}
+
+/**********************************************************************
+ * Write the profile into <buffer> as a JSON object of the form
+ * '{ "reason": <reason>, "phases": { <phase>: <micros>, ... } }'.
+ * Returns the length of the message or 0 if it did not fit.
+ */
+size_t BootProfile::toJson(char *buffer, size_t size, const char *reason) {
+  size_t length;
+  int n;
+
+  n = snprintf(buffer, size, "{ \"reason\": \"%s\", \"phases\": {", reason);
+  if ((n < 0) || ((size_t) n >= size)) return(0);
+  length = n;
+  for (uint8_t i = 0; i < this->count; i++) {
+    n = snprintf(buffer + length, size - length, "%s \"%s\": %lu", (i)?",":"", this->phases[i], (unsigned long) this->times[i]);
+    if ((n < 0) || ((size_t) n >= (size - length))) return(0);
+    length += n;
+  }
+  n = snprintf(buffer + length, size - length, " } }");
+  if ((n < 0) || ((size_t) n >= (size - length))) return(0);
+  return(length + n);
+}
@@ -0,0 +1,34 @@
+/**********************************************************************
+ * NAME
+ *   BootProfile.h - record how long each phase of start up takes.
+ * DESCRIPTION
+ *   Records the micros() timestamp at which each of a series of named
+ *   start up phases completed, so that a node can report where its
+ *   boot time goes. Phase names are held by reference and so must be
+ *   string literals (or otherwise outlive the profile).
+ *
+ *   At most BOOT_PROFILE_MAX_PHASES phases are recorded and each is
+ *   recorded only the first time it is marked.
+ */
+
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <Arduino.h>
+
+#define BOOT_PROFILE_MAX_PHASES 12
+
+class BootProfile {
+  public:
+    BootProfile();
+    void mark(const char *phase);
+    bool isMarked(const char *phase);
+    size_t toJson(char *buffer, size_t size, const char *reason);
+
+  private:
+    const char *phases[BOOT_PROFILE_MAX_PHASES];
+    uint32_t times[BOOT_PROFILE_MAX_PHASES];
+    uint8_t count;
+};
+
+#endif
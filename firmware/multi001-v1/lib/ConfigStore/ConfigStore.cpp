@@ -0,0 +1,199 @@
+/**********************************************************************
+ * ConfigStore.cpp - versioned, CRC-checked configuration in EEPROM.
+ */
+
+#include "ConfigStore.h"
+
+/**********************************************************************
+ * Create a store occupying the <size> bytes of EEPROM starting at
+ * <address>.
+ */
+ConfigStore::ConfigStore(int address, size_t size) {
+  this->address = address;
+  this->size = size;
+  this->version = 0;
+}
+
+/**********************************************************************
+ * Load <config>, described by the <count> entries in <fields>, from
+ * EEPROM. Fields which have not been stored are given their defaults.
+ * Returns false (leaving every field at its default) if the store
+ * does not hold a valid configuration.
+ */
+bool ConfigStore::load(void *config, const CONFIG_FIELD *fields, size_t count) {
+  int records = this->address + CONFIG_STORE_HEADER_SIZE;
+  uint16_t magic, crc, length;
+  bool valid = false;
+
+  setDefaults(config, fields, count);
+  this->version = 0;
+  EEPROM.begin(CONFIG_STORE_EEPROM_SIZE);
+  magic = (EEPROM.read(this->address) | (EEPROM.read(this->address + 1) << 8));
+  crc = (EEPROM.read(this->address + 2) | (EEPROM.read(this->address + 3) << 8));
+  length = (EEPROM.read(this->address + 5) | (EEPROM.read(this->address + 6) << 8));
+  if ((magic == CONFIG_STORE_MAGIC) && (length <= (this->size - CONFIG_STORE_HEADER_SIZE)) && (crc == this->computeCrc(this->address + 4, length + 3))) {
+    for (int p = records; (p + 2) <= (records + length); ) {
+      uint8_t tag = EEPROM.read(p), recordLength = EEPROM.read(p + 1);
+
+      if ((p + 2 + recordLength) > (records + length)) break;
+      for (size_t i = 0; i < count; i++) {
+        if (fields[i].tag == tag) this->decodeRecord(config, &fields[i], p + 2, recordLength);
+      }
+      p += (2 + recordLength);
+    }
+    this->version = EEPROM.read(this->address + 4);
+    valid = true;
+  }
+  EEPROM.end();
+  return(valid);
+}
+
+/**********************************************************************
+ * Save <config>, described by the <count> entries in <fields>, as
+ * schema <version>. Only bytes which have changed are written and
+ * nothing is committed if the store already holds exactly this
+ * configuration. Returns false if the configuration will not fit.
+ */
+bool ConfigStore::save(const void *config, const CONFIG_FIELD *fields, size_t count, uint8_t version) {
+  bool changed = false, fits;
+  size_t length;
+  uint16_t crc;
+
+  EEPROM.begin(CONFIG_STORE_EEPROM_SIZE);
+  length = this->encodeRecords(config, fields, count, false, changed);
+  if ((fits = (length <= (this->size - CONFIG_STORE_HEADER_SIZE)))) {
+    this->update(this->address + 4, version, changed);
+    this->update(this->address + 5, (length & 0xff), changed);
+    this->update(this->address + 6, (length >> 8), changed);
+    this->encodeRecords(config, fields, count, true, changed);
+    crc = this->computeCrc(this->address + 4, length + 3);
+    this->update(this->address, (CONFIG_STORE_MAGIC & 0xff), changed);
+    this->update(this->address + 1, (CONFIG_STORE_MAGIC >> 8), changed);
+    this->update(this->address + 2, (crc & 0xff), changed);
+    this->update(this->address + 3, (crc >> 8), changed);
+    if (changed) EEPROM.commit();
+    this->version = version;
+  }
+  EEPROM.end();
+  return(fits);
+}
+
+/**********************************************************************
+ * Returns the schema version of the most recently loaded (or saved)
+ * configuration, or zero if there is none.
+ */
+uint8_t ConfigStore::getVersion() {
+  return(this->version);
+}
+
+/**********************************************************************
+ * Set every field of <config> described in <fields> to its default:
+ * its fallback value if it is an integer, otherwise an empty string.
+ */
+void ConfigStore::setDefaults(void *config, const CONFIG_FIELD *fields, size_t count) {
+  uint8_t *base = (uint8_t*) config;
+
+  for (size_t i = 0; i < count; i++) {
+    if (fields[i].type == CONFIG_STORE_INT) {
+      int32_t value = fields[i].fallback;
+      memset(base + fields[i].offset, 0, fields[i].size);
+      memcpy(base + fields[i].offset, &value, (fields[i].size < sizeof(value))?fields[i].size:sizeof(value));
+    } else {
+      memset(base + fields[i].offset, 0, fields[i].size);
+    }
+  }
+}
+
+/**********************************************************************
+ * Returns the total length of the records representing each field of
+ * <config> and, if <write> is true, writes them after the header,
+ * setting <changed> if any stored byte differs. Integer fields narrower
+ * than four bytes are sign extended so that a negative value is stored
+ * as minimally as a positive one. The caller must check that the
+ * records fit before writing them.
+ */
+size_t ConfigStore::encodeRecords(const void *config, const CONFIG_FIELD *fields, size_t count, bool write, bool &changed) {
+  const uint8_t *base = (const uint8_t*) config;
+  int start = this->address + CONFIG_STORE_HEADER_SIZE;
+  size_t length = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *value = base + fields[i].offset;
+    uint8_t bytes[4];
+    uint8_t n;
+
+    if (fields[i].type == CONFIG_STORE_INT) {
+      uint8_t width = (fields[i].size < sizeof(int32_t))?fields[i].size:sizeof(int32_t);
+      int32_t v = 0;
+
+      memcpy(&v, value, width);
+      if ((width > 0) && (width < sizeof(v)) && (value[width - 1] & 0x80)) v |= (int32_t) (0xffffffffUL << (8 * width));
+      n = encodeInt(v, bytes);
+      value = bytes;
+    } else {
+      n = (uint8_t) strnlen((const char*) value, (fields[i].size < 255)?fields[i].size:255);
+    }
+    if (write) {
+      this->update(start + length, fields[i].tag, changed);
+      this->update(start + length + 1, n, changed);
+      for (uint8_t j = 0; j < n; j++) this->update(start + length + 2 + j, value[j], changed);
+    }
+    length += (2 + n);
+  }
+  return(length);
+}
+
+/**********************************************************************
+ * Write <value> to <bytes> little-endian in the fewest bytes which
+ * sign extend back to the same value. Returns the number of bytes.
+ */
+uint8_t ConfigStore::encodeInt(int32_t value, uint8_t *bytes) {
+  uint8_t n = 4;
+
+  while ((n > 1) && (value >= -(1L << ((8 * (n - 1)) - 1))) && (value < (1L << ((8 * (n - 1)) - 1)))) n--;
+  for (uint8_t i = 0; i < n; i++) bytes[i] = (uint8_t) (((uint32_t) value) >> (8 * i));
+  return(n);
+}
+
+/**********************************************************************
+ * Copy the <length> byte record value at <address> into <field> of
+ * <config>, sign extending integers and truncating (and terminating)
+ * strings which have grown too long for the field.
+ */
+void ConfigStore::decodeRecord(void *config, const CONFIG_FIELD *field, int address, uint8_t length) {
+  uint8_t *target = ((uint8_t*) config) + field->offset;
+
+  if (field->type == CONFIG_STORE_INT) {
+    int32_t value;
+
+    if ((length == 0) || (length > 4)) return;
+    value = ((EEPROM.read(address + length - 1) & 0x80)?-1:0);
+    for (int i = (length - 1); i >= 0; i--) value = (int32_t) (((uint32_t) value << 8) | EEPROM.read(address + i));
+    memset(target, 0, field->size);
+    memcpy(target, &value, (field->size < sizeof(value))?field->size:sizeof(value));
+  } else if (field->size > 0) {
+    size_t n = (length < field->size)?length:(field->size - 1);
+
+    for (size_t i = 0; i < n; i++) target[i] = EEPROM.read(address + i);
+    target[n] = 0;
+  }
+}
+
+void ConfigStore::update(int address, uint8_t value, bool &changed) {
+  if (EEPROM.read(address) == value) return;
+  EEPROM.write(address, value);
+  changed = true;
+}
+
+/**********************************************************************
+ * CRC16-CCITT of the <length> bytes of EEPROM at <address>.
+ */
+uint16_t ConfigStore::computeCrc(int address, size_t length) {
+  uint16_t crc = 0xffff;
+
+  for (size_t i = 0; i < length; i++) {
+    crc ^= ((uint16_t) EEPROM.read(address + i) << 8);
+    for (uint8_t bit = 0; bit < 8; bit++) crc = (crc & 0x8000)?((crc << 1) ^ 0x1021):(crc << 1);
+  }
+  return(crc);
+}
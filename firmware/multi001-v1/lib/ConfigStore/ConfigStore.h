@@ -0,0 +1,76 @@
+/**********************************************************************
+ * NAME
+ *   ConfigStore.h - versioned, CRC-checked configuration in EEPROM.
+ * DESCRIPTION
+ *   Persists a configuration structure as a compact list of tagged
+ *   records rather than as a raw image of the structure, so that
+ *   fields can be added, removed or resized without corrupting the
+ *   configuration of a node upgraded from older firmware.
+ *
+ *   The client describes its structure with a table of CONFIG_FIELDs,
+ *   each giving a field's tag, type, offset and size (and, for an
+ *   integer, the value to use if it has never been saved). Tags must
+ *   never be reused for a different purpose. On load every field is
+ *   first set to its default, then each stored record whose tag is in
+ *   the table overwrites its field; records with unknown tags are
+ *   ignored. Integers are stored in as few bytes as will hold them and
+ *   strings without padding.
+ *
+ *   The store begins with a header holding a magic number, a CRC16,
+ *   the client's schema version and the length of the records which
+ *   follow. The CRC covers the version, length and records, so that a
+ *   blank, foreign or damaged store is never mistaken for a
+ *   configuration. getVersion() returns the schema version of the
+ *   loaded configuration so that the client can migrate values whose
+ *   meaning has changed.
+ *
+ *   save() encodes the configuration and rewrites only the bytes which
+ *   differ from those already stored, committing nothing at all if the
+ *   configuration is unchanged. The emulated EEPROM (and the RAM it
+ *   needs) is only held for the duration of each load() or save().
+ */
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#define CONFIG_STORE_MAGIC 0x4643         // "CF"
+#define CONFIG_STORE_EEPROM_SIZE 512
+#define CONFIG_STORE_HEADER_SIZE 7
+#define CONFIG_STORE_INT 0                // Signed integer of up to 4 bytes
+#define CONFIG_STORE_STRING 1             // NUL terminated char array
+
+struct CONFIG_FIELD {
+  uint8_t tag;                            // 1..255, unique and never reused
+  uint8_t type;                           // CONFIG_STORE_INT or CONFIG_STORE_STRING
+  uint16_t offset;                        // offsetof() the field
+  uint16_t size;                          // sizeof() the field
+  int32_t fallback;                       // Default value of an integer
+};
+
+class ConfigStore {
+  public:
+    ConfigStore(int address, size_t size);
+    bool load(void *config, const CONFIG_FIELD *fields, size_t count);
+    bool save(const void *config, const CONFIG_FIELD *fields, size_t count,
+              uint8_t version);
+    uint8_t getVersion();
+    static void setDefaults(void *config, const CONFIG_FIELD *fields, size_t count);
+
+  private:
+    size_t encodeRecords(const void *config, const CONFIG_FIELD *fields,
+                         size_t count, bool write, bool &changed);
+    static uint8_t encodeInt(int32_t value, uint8_t *bytes);
+    void decodeRecord(void *config, const CONFIG_FIELD *field,
+                      int address, uint8_t length);
+    void update(int address, uint8_t value, bool &changed);
+    uint16_t computeCrc(int address, size_t length);
+
+    int address;
+    size_t size;
+    uint8_t version;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/**********************************************************************
+ * DS18B20Driver.cpp - SensorDriver for DS18B20 one-wire temperature
+ * sensors.
+ */
+
+#include "DS18B20Driver.h"
+
+/**********************************************************************
+ * The sampler is given an interval which never expires, so it only
+ * converts on request.
+ */
+DS18B20Driver::DS18B20Driver(OneWire &wire, DallasTemperature &bus, bool asTemperature) : sampler(wire, bus, ~0UL), asTemperature(asTemperature) {
+  this->lastSampleCount = 0UL;
+  this->lastScanCount = 0UL;
+  for (uint8_t i = 0; i < SAMPLE_MAX_PROBES; i++) this->names[i][0] = 0;
+}
+
+/**********************************************************************
+ * Enumerate the bus and name each device from its ROM address. The
+ * driver counts as present even if no device is found, since devices
+ * can be plugged in later.
+ */
+bool DS18B20Driver::begin() {
+  this->sampler.begin();
+  this->nameDevices();
+  return(true);
+}
+
+void DS18B20Driver::startSample() {
+  this->sampler.requestSample();
+}
+
+uint8_t DS18B20Driver::poll() {
+  uint8_t result = 0;
+
+  this->sampler.loop();
+  if (this->sampler.getScanCount() != this->lastScanCount) {
+    this->nameDevices();
+    result |= SENSOR_RENUMBERED;
+  }
+  if (this->sampler.getSampleCount() != this->lastSampleCount) {
+    this->lastSampleCount = this->sampler.getSampleCount();
+    result |= SENSOR_UPDATED;
+  }
+  return(result);
+}
+
+bool DS18B20Driver::isReady() {
+  return(this->sampler.isReady());
+}
+
+void DS18B20Driver::describe(SAMPLE_NAMES &names) {
+  if (this->asTemperature) return;
+  for (uint8_t i = 0; i < SAMPLE_MAX_PROBES; i++) names.probes[i] = this->names[i];
+}
+
+void DS18B20Driver::encode(SAMPLE &sample) {
+  if (this->asTemperature) {
+    sample.flags |= SAMPLE_HAS_TEMPERATURE;
+    sample.temperature = toFixed(this->sampler.getTemperature(0));
+  } else {
+    sample.probeCount = 0;
+    for (uint8_t i = 0; (i < this->sampler.getDeviceCount()) && (i < SAMPLE_MAX_PROBES); i++) {
+      sample.probes[sample.probeCount++] = toFixed(this->sampler.getTemperature(i));
+    }
+  }
+}
+
+uint8_t DS18B20Driver::getDeviceCount() {
+  return(this->sampler.getDeviceCount());
+}
+
+const char *DS18B20Driver::getDeviceName(uint8_t index) {
+  return((index < SAMPLE_MAX_PROBES)?this->names[index]:"");
+}
+
+/**********************************************************************
+ * Ask for the bus to be searched for added or removed devices before
+ * the next conversion.
+ */
+void DS18B20Driver::rescan() {
+  this->sampler.rescan();
+}
+
+void DS18B20Driver::setResolution(uint8_t bits) {
+  this->sampler.setResolution(bits);
+}
+
+/**********************************************************************
+ * Build the property name of each reported device from its cached ROM
+ * address.
+ */
+void DS18B20Driver::nameDevices() {
+  DeviceAddress address;
+
+  for (uint8_t i = 0; i < SAMPLE_MAX_PROBES; i++) {
+    if (this->sampler.getAddress(i, address)) {
+      snprintf(this->names[i], DS18B20_DRIVER_NAME_SIZE, DS18B20_DRIVER_NAME_FORMAT, address[0], address[1], address[2], address[3], address[4], address[5], address[6], address[7]);
+    } else {
+      this->names[i][0] = 0;
+    }
+  }
+  this->lastScanCount = this->sampler.getScanCount();
+}
+
+int16_t DS18B20Driver::toFixed(int16_t temperature) {
+  return((temperature == DS18B20_SAMPLER_INVALID_VALUE)?SAMPLE_INVALID_VALUE:temperature);
+}
@@ -0,0 +1,63 @@
+/**********************************************************************
+ * NAME
+ *   DS18B20Driver.h - SensorDriver for DS18B20 one-wire temperature
+ *   sensors.
+ * DESCRIPTION
+ *   Conversions are run in the background by a DS18B20Sampler and are
+ *   started only when startSample() asks for one, so the bus is idle
+ *   between publication cycles.
+ *
+ *   Normally every detected device is reported as a probe named from
+ *   its ROM address. Names are built once, when the bus is first
+ *   enumerated, and again only if a rescan finds a different set of
+ *   devices, in which case poll() returns SENSOR_RENUMBERED. A driver
+ *   created with <asTemperature> instead reports the first device as
+ *   the node's temperature (and reports an invalid temperature if
+ *   there are no devices at all).
+ *
+ *   The driver is present even if the bus is empty at start up, so
+ *   that the periodic rescan still runs. It reports no probes until a
+ *   device is found.
+ *
+ *   setResolution() should be called before begin() to choose the
+ *   conversion resolution (and with it the conversion time).
+ */
+
+#ifndef DS18B20_DRIVER_H
+#define DS18B20_DRIVER_H
+
+#include <Arduino.h>
+#include <DallasTemperature.h>
+#include <DS18B20Sampler.h>
+#include <SensorDriver.h>
+
+#define DS18B20_DRIVER_NAME_FORMAT "DS-%02x%02x%02x%02x%02x%02x%02x%02x"
+#define DS18B20_DRIVER_NAME_SIZE 20
+
+class DS18B20Driver : public SensorDriver {
+  public:
+    DS18B20Driver(OneWire &wire, DallasTemperature &bus, bool asTemperature = false);
+    const char *getName() { return("DS18B20"); }
+    bool begin();
+    void startSample();
+    uint8_t poll();
+    bool isReady();
+    void describe(SAMPLE_NAMES &names);
+    void encode(SAMPLE &sample);
+    uint8_t getDeviceCount();
+    const char *getDeviceName(uint8_t index);
+    void rescan();
+    void setResolution(uint8_t bits);
+
+  private:
+    void nameDevices();
+    static int16_t toFixed(int16_t temperature);
+
+    DS18B20Sampler sampler;
+    bool asTemperature;
+    unsigned long lastSampleCount;
+    unsigned long lastScanCount;
+    char names[SAMPLE_MAX_PROBES][DS18B20_DRIVER_NAME_SIZE];
+};
+
+#endif
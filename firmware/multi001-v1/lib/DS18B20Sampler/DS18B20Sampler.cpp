@@ -0,0 +1,286 @@
+/**********************************************************************
+ * DS18B20Sampler.cpp - non-blocking DS18B20 conversion engine.
+ */
+
+#include "DS18B20Sampler.h"
+#include <Profiler.h>
+
+/**********************************************************************
+ * Create a sampler for the devices on <bus> which will start a new
+ * conversion every <interval> milliseconds.
+ */
+DS18B20Sampler::DS18B20Sampler(OneWire &wire, DallasTemperature &bus, unsigned long interval) : wire(wire), bus(bus), interval(interval) {
+  this->state = IDLE;
+  this->sampleRequested = true;
+  this->rescanRequested = false;
+  this->readFailed = false;
+  this->parasitePowered = false;
+  this->resolution = DS18B20_SAMPLER_MAX_RESOLUTION;
+  this->deviceCount = 0;
+  this->conversionTime = 0UL;
+  this->conversionStart = 0UL;
+  this->lastPoll = 0UL;
+  this->sampleTime = 0UL;
+  this->sampleCount = 0UL;
+  this->lastScan = 0UL;
+  this->scanCount = 0UL;
+  for (int i = 0; i < DS18B20_SAMPLER_MAX_DEVICES; i++) this->raws[i] = DS18B20_SAMPLER_INVALID_VALUE;
+}
+
+/**********************************************************************
+ * Enumerate the bus and switch the library into asynchronous mode.
+ * The first conversion will be started by the next call to loop().
+ */
+void DS18B20Sampler::begin() {
+  this->bus.begin();
+  this->bus.setWaitForConversion(false);
+  this->deviceCount = 0;
+  this->scan();
+  // A parasite powered device cannot signal conversion complete, so
+  // in this case we must rely on the worst case conversion time.
+  this->parasitePowered = this->bus.isParasitePowerMode();
+  this->sampleRequested = true;
+}
+
+/**********************************************************************
+ * Advance the conversion state machine. This must be called from
+ * loop() and will never wait on the bus.
+ */
+void DS18B20Sampler::loop() {
+  unsigned long now = millis();
+
+  switch (this->state) {
+    case IDLE:
+      if ((this->rescanRequested) || ((this->readFailed) && ((now - this->lastScan) >= DS18B20_SAMPLER_RETRY_INTERVAL)) || ((now - this->lastScan) >= DS18B20_SAMPLER_RESCAN_INTERVAL)) {
+        this->scan();
+        now = millis();
+      }
+      if ((this->deviceCount) && ((this->sampleRequested) || ((now - this->conversionStart) >= this->interval))) {
+        {
+          PROFILE_SECTION("ds18b20.request");
+          this->bus.requestTemperatures();
+        }
+        this->conversionStart = now;
+        this->lastPoll = now;
+        this->sampleRequested = false;
+        this->state = CONVERTING;
+      }
+      break;
+    case CONVERTING:
+      if ((now - this->lastPoll) >= DS18B20_SAMPLER_POLL_INTERVAL) {
+        this->lastPoll = now;
+        if (((now - this->conversionStart) >= this->conversionTime) || ((!this->parasitePowered) && (this->bus.isConversionComplete()))) {
+          this->harvest();
+          this->sampleTime = millis();
+          this->sampleCount++;
+          this->state = IDLE;
+        }
+      }
+      break;
+  }
+}
+
+/**********************************************************************
+ * Ask for a conversion to be started as soon as possible, rather than
+ * waiting for the current interval to expire.
+ */
+void DS18B20Sampler::requestSample() {
+  this->sampleRequested = true;
+}
+
+/**********************************************************************
+ * Ask for the bus to be searched again before the next conversion.
+ */
+void DS18B20Sampler::rescan() {
+  this->rescanRequested = true;
+}
+
+/**********************************************************************
+ * Set the resolution, in bits, at which devices should convert. This
+ * takes effect when the bus is next searched, so it should normally
+ * be called before begin(). Values outside the range supported by the
+ * DS18B20 are ignored.
+ */
+void DS18B20Sampler::setResolution(uint8_t bits) {
+  if ((bits >= DS18B20_SAMPLER_MIN_RESOLUTION) && (bits <= DS18B20_SAMPLER_MAX_RESOLUTION)) this->resolution = bits;
+}
+
+uint8_t DS18B20Sampler::getResolution() {
+  return(this->resolution);
+}
+
+/**********************************************************************
+ * Returns the worst case conversion time, in milliseconds, of the
+ * devices found by the most recent search.
+ */
+unsigned long DS18B20Sampler::getConversionTime() {
+  return(this->conversionTime);
+}
+
+/**********************************************************************
+ * Returns true once there is something worth reporting: either a
+ * conversion has completed or there are no devices to wait for.
+ */
+bool DS18B20Sampler::isReady() {
+  return((this->deviceCount == 0) || (this->sampleCount > 0));
+}
+
+uint8_t DS18B20Sampler::getDeviceCount() {
+  return(this->deviceCount);
+}
+
+/**********************************************************************
+ * Copy the cached ROM address of device <index> to <address>. Returns
+ * false if there is no such device.
+ */
+bool DS18B20Sampler::getAddress(uint8_t index, uint8_t *address) {
+  if (index >= this->deviceCount) return(false);
+  memcpy(address, this->addresses[index], sizeof(DeviceAddress));
+  return(true);
+}
+
+/**********************************************************************
+ * Returns the raw count of 1/16 degree Celsius reported by device
+ * <index> at the end of the most recently completed conversion or
+ * DS18B20_SAMPLER_INVALID_VALUE if there is no such value.
+ */
+int16_t DS18B20Sampler::getRaw(uint8_t index) {
+  return((index < this->deviceCount)?this->raws[index]:DS18B20_SAMPLER_INVALID_VALUE);
+}
+
+/**********************************************************************
+ * Returns the temperature in hundredths of a degree Celsius reported
+ * by device <index>, rounded to the nearest hundredth, or
+ * DS18B20_SAMPLER_INVALID_VALUE if there is no such value.
+ */
+int16_t DS18B20Sampler::getTemperature(uint8_t index) {
+  int32_t raw = this->getRaw(index);
+
+  if (raw == DS18B20_SAMPLER_INVALID_VALUE) return(DS18B20_SAMPLER_INVALID_VALUE);
+  return((int16_t) (((raw * 25) + ((raw < 0)?-2:2)) / 4));
+}
+
+unsigned long DS18B20Sampler::getSampleTime() {
+  return(this->sampleTime);
+}
+
+unsigned long DS18B20Sampler::getSampleCount() {
+  return(this->sampleCount);
+}
+
+/**********************************************************************
+ * Returns the number of times the set of devices has changed (the
+ * first search at start up counts as a change), so that clients can
+ * tell when index to device mappings must be refreshed.
+ */
+unsigned long DS18B20Sampler::getScanCount() {
+  return(this->scanCount);
+}
+
+/**********************************************************************
+ * Read the conversion result from each device's scratchpad into our
+ * cache, addressing each device by its cached ROM address. A
+ * scratchpad which cannot be read or fails its CRC check is reported
+ * as invalid and prompts a rescan in case the device has gone.
+ */
+void DS18B20Sampler::harvest() {
+  PROFILE_SECTION("ds18b20.read");
+  ScratchPad scratchPad;
+
+  for (uint8_t i = 0; i < this->deviceCount; i++) {
+    this->raws[i] = DS18B20_SAMPLER_INVALID_VALUE;
+    if (this->bus.isConnected(this->addresses[i], scratchPad)) {
+      this->raws[i] = rawFromScratchPad(scratchPad);
+    } else {
+      this->readFailed = true;
+    }
+  }
+}
+
+/**********************************************************************
+ * Search the bus once, from start to finish, and update the cached
+ * device table. Devices already in the table keep their order (moving
+ * down over any which have gone) and any new devices are appended (up
+ * to DS18B20_SAMPLER_MAX_DEVICES).
+ * Every device is brought to the configured resolution and the
+ * conversion time is recalculated to suit the slowest of them.
+ */
+void DS18B20Sampler::scan() {
+  PROFILE_SECTION("ds18b20.scan");
+  DeviceAddress found[DS18B20_SAMPLER_MAX_DEVICES];
+  DeviceAddress address;
+  uint8_t foundCount = 0, count = 0;
+  bool changed;
+
+  this->wire.reset_search();
+  while ((foundCount < DS18B20_SAMPLER_MAX_DEVICES) && (this->wire.search(address))) {
+    if ((this->bus.validAddress(address)) && (this->bus.validFamily(address))) {
+      memcpy(found[foundCount++], address, sizeof(DeviceAddress));
+    }
+  }
+
+  // Keep the survivors in order, then add the newcomers.
+  for (uint8_t i = 0; i < this->deviceCount; i++) {
+    for (uint8_t j = 0; j < foundCount; j++) {
+      if (memcmp(this->addresses[i], found[j], sizeof(DeviceAddress)) == 0) {
+        if (count != i) {
+          memcpy(this->addresses[count], this->addresses[i], sizeof(DeviceAddress));
+          this->raws[count] = this->raws[i];
+        }
+        count++;
+        break;
+      }
+    }
+  }
+  changed = ((count != this->deviceCount) || (this->scanCount == 0));
+  for (uint8_t j = 0; j < foundCount; j++) {
+    if ((this->findDevice(found[j], count) < 0) && (count < DS18B20_SAMPLER_MAX_DEVICES)) {
+      memcpy(this->addresses[count], found[j], sizeof(DeviceAddress));
+      this->raws[count++] = DS18B20_SAMPLER_INVALID_VALUE;
+      changed = true;
+    }
+  }
+  for (uint8_t i = count; i < this->deviceCount; i++) this->raws[i] = DS18B20_SAMPLER_INVALID_VALUE;
+
+  this->conversionTime = 0UL;
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t bits = this->bus.getResolution(this->addresses[i]);
+
+    // Read back the result, since not every family supports the change.
+    if ((bits) && (bits != this->resolution)) {
+      this->bus.setResolution(this->addresses[i], this->resolution, true);
+      bits = this->bus.getResolution(this->addresses[i]);
+    }
+    if (bits == 0) bits = DS18B20_SAMPLER_MAX_RESOLUTION;
+    if ((unsigned long) this->bus.millisToWaitForConversion(bits) > this->conversionTime) this->conversionTime = this->bus.millisToWaitForConversion(bits);
+  }
+
+  this->deviceCount = count;
+  this->lastScan = millis();
+  this->rescanRequested = false;
+  this->readFailed = false;
+  if (changed) this->scanCount++;
+}
+
+/**********************************************************************
+ * Returns the index of <address> amongst the first <count> cached
+ * devices or -1 if it is not there.
+ */
+int8_t DS18B20Sampler::findDevice(const uint8_t *address, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (memcmp(this->addresses[i], address, sizeof(DeviceAddress)) == 0) return((int8_t) i);
+  }
+  return(-1);
+}
+
+/**********************************************************************
+ * Returns the temperature held in <scratchPad> as a count of 1/16
+ * degree, with any bits which are undefined at the device's configured
+ * resolution cleared.
+ */
+int16_t DS18B20Sampler::rawFromScratchPad(const uint8_t *scratchPad) {
+  int16_t raw = (int16_t) ((scratchPad[TEMP_MSB] << 8) | scratchPad[TEMP_LSB]);
+  uint8_t undefinedBits = (3 - ((scratchPad[CONFIGURATION] >> 5) & 0x03));
+
+  return((int16_t) (raw & ~((1 << undefinedBits) - 1)));
+}
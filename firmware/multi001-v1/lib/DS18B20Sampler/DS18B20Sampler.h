@@ -0,0 +1,105 @@
+/**********************************************************************
+ * NAME
+ *   DS18B20Sampler.h - non-blocking DS18B20 conversion engine.
+ * DESCRIPTION
+ *   DallasTemperature's requestTemperatures() normally blocks until
+ *   the requested conversion is complete which, at the DS18B20's
+ *   default 12-bit resolution, takes around 750ms. DS18B20Sampler
+ *   puts the library into asynchronous mode and runs a small state
+ *   machine from loop() which starts a conversion on all devices,
+ *   polls for its completion and then harvests the results.
+ *
+ *   Client code never waits on the one-wire bus: it simply reads the
+ *   most recently completed sample with getTemperature().
+ *
+ *   The ROM address of every device is found by a single search of
+ *   the bus at start up and cached, so each cycle costs one broadcast
+ *   conversion and one addressed scratchpad read per device however
+ *   long the string of sensors. The bus is searched again (between
+ *   conversions) when rescan() is called, when a cached device fails
+ *   to respond (at most every DS18B20_SAMPLER_RETRY_INTERVAL
+ *   milliseconds) and every DS18B20_SAMPLER_RESCAN_INTERVAL milliseconds,
+ *   so that sensors can be added and removed without a restart.
+ *   Devices which are still present keep their order across a rescan,
+ *   closing up over any which have gone, and newly found devices are
+ *   added after them. An index can therefore refer to a different
+ *   device after a rescan, which getScanCount() signals.
+ *
+ *   Each device found is set to the resolution given to
+ *   setResolution() (only if it differs, since the setting is copied
+ *   to the device's EEPROM). Lower resolutions convert faster: 94ms at
+ *   9 bits against 750ms at 12 bits. A conversion is harvested as soon
+ *   as the bus reports it complete or, for parasite powered devices,
+ *   after the worst case time for the slowest device.
+ *
+ *   Results are read directly from each device's scratchpad and are
+ *   held as the device's raw two's complement count of 1/16 degree,
+ *   so no floating point arithmetic is involved. A device which could
+ *   not be read reports DS18B20_SAMPLER_INVALID_VALUE.
+ */
+
+#ifndef DS18B20_SAMPLER_H
+#define DS18B20_SAMPLER_H
+
+#include <Arduino.h>
+#include <DallasTemperature.h>
+
+#ifndef DS18B20_SAMPLER_MAX_DEVICES
+#define DS18B20_SAMPLER_MAX_DEVICES 20    // Devices we will report on
+#endif
+#define DS18B20_SAMPLER_POLL_INTERVAL 10  // Milliseconds between completion checks
+#define DS18B20_SAMPLER_RESCAN_INTERVAL 600000 // Milliseconds between hot-plug searches
+#define DS18B20_SAMPLER_RETRY_INTERVAL 60000 // Minimum milliseconds between searches after a failed read
+#define DS18B20_SAMPLER_INVALID_VALUE -32768
+#define DS18B20_SAMPLER_MIN_RESOLUTION 9  // Bits
+#define DS18B20_SAMPLER_MAX_RESOLUTION 12
+
+class DS18B20Sampler {
+  public:
+    DS18B20Sampler(OneWire &wire, DallasTemperature &bus, unsigned long interval);
+    void begin();
+    void loop();
+    void requestSample();
+    void rescan();
+    void setResolution(uint8_t bits);
+    uint8_t getResolution();
+    unsigned long getConversionTime();
+    bool isReady();
+    uint8_t getDeviceCount();
+    bool getAddress(uint8_t index, uint8_t *address);
+    int16_t getRaw(uint8_t index);
+    int16_t getTemperature(uint8_t index);
+    unsigned long getSampleTime();
+    unsigned long getSampleCount();
+    unsigned long getScanCount();
+
+  private:
+    enum STATE { IDLE, CONVERTING };
+
+    void harvest();
+    void scan();
+    int8_t findDevice(const uint8_t *address, uint8_t count);
+    static int16_t rawFromScratchPad(const uint8_t *scratchPad);
+
+    OneWire &wire;
+    DallasTemperature &bus;
+    unsigned long interval;
+    STATE state;
+    bool sampleRequested;
+    bool rescanRequested;
+    bool readFailed;
+    bool parasitePowered;
+    uint8_t resolution;
+    uint8_t deviceCount;
+    unsigned long conversionTime;
+    unsigned long conversionStart;
+    unsigned long lastPoll;
+    unsigned long sampleTime;
+    unsigned long sampleCount;
+    unsigned long lastScan;
+    unsigned long scanCount;
+    DeviceAddress addresses[DS18B20_SAMPLER_MAX_DEVICES];
+    int16_t raws[DS18B20_SAMPLER_MAX_DEVICES]; // 1/16 degree Celsius
+};
+
+#endif
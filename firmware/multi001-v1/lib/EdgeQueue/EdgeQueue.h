@@ -0,0 +1,76 @@
+/**********************************************************************
+ * NAME
+ *   EdgeQueue.h - lock-free queue of timestamped GPIO edges.
+ * DESCRIPTION
+ *   A fixed-size single-producer/single-consumer ring buffer intended
+ *   to carry input edges from interrupt service routines to loop().
+ *
+ *   The producer (an ISR) only ever writes <head> and the consumer
+ *   (loop()) only ever writes <tail>, so no locking is required on a
+ *   single core processor. Both indices run freely and are reduced
+ *   modulo SIZE on use, which must therefore be a power of two no
+ *   greater than 128.
+ *
+ *   push() is forced inline so that it is compiled into the calling
+ *   ISR and so lands in IRAM along with it.
+ */
+
+#ifndef EDGE_QUEUE_H
+#define EDGE_QUEUE_H
+
+#include <Arduino.h>
+
+struct EDGE_EVENT {
+  uint32_t timestamp;             // micros() at which the edge was seen
+  uint8_t channel;                // Application defined channel number
+  uint8_t level;                  // Pin level after the edge
+};
+
+template <uint8_t SIZE>
+class EdgeQueue {
+  static_assert(((SIZE & (SIZE - 1)) == 0) && (SIZE <= 128), "EdgeQueue SIZE must be a power of two no greater than 128");
+
+  public:
+    EdgeQueue() : head(0), tail(0), overruns(0) {}
+
+    /******************************************************************
+     * Producer side: append an edge to the queue. If the queue is full
+     * the edge is discarded and the overrun counter incremented.
+     */
+    inline __attribute__((always_inline)) bool push(uint8_t channel, uint8_t level) {
+      uint8_t h = this->head;
+      if ((uint8_t) (h - this->tail) >= SIZE) { this->overruns++; return(false); }
+      EDGE_EVENT &event = this->events[h & (SIZE - 1)];
+      event.timestamp = micros();
+      event.channel = channel;
+      event.level = level;
+      __asm__ __volatile__ ("" ::: "memory");
+      this->head = (uint8_t) (h + 1);
+      return(true);
+    }
+
+    /******************************************************************
+     * Consumer side: remove the oldest edge from the queue into
+     * <event>, returning false if the queue is empty.
+     */
+    bool pop(EDGE_EVENT &event) {
+      uint8_t t = this->tail;
+      if (t == this->head) return(false);
+      event = this->events[t & (SIZE - 1)];
+      __asm__ __volatile__ ("" ::: "memory");
+      this->tail = (uint8_t) (t + 1);
+      return(true);
+    }
+
+    bool isEmpty() { return(this->tail == this->head); }
+
+    uint32_t getOverruns() { return(this->overruns); }
+
+  private:
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint32_t overruns;
+    EDGE_EVENT events[SIZE];
+};
+
+#endif
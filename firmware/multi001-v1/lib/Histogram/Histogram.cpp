@@ -0,0 +1,62 @@
+/**********************************************************************
+ * Histogram.cpp - fixed-bucket histogram of unsigned values.
+ */
+
+#include "Histogram.h"
+
+/**********************************************************************
+ * Create a histogram with the <count> ascending upper <bounds> (and so
+ * <count> + 1 buckets). Bounds beyond HISTOGRAM_MAX_BUCKETS - 1 are
+ * ignored.
+ */
+Histogram::Histogram(const uint32_t *bounds, uint8_t count) : bounds(bounds) {
+  this->boundCount = (count < HISTOGRAM_MAX_BUCKETS)?count:(HISTOGRAM_MAX_BUCKETS - 1);
+  this->reset();
+}
+
+void Histogram::record(uint32_t value) {
+  uint8_t i = 0;
+
+  while ((i < this->boundCount) && (value >= this->bounds[i])) i++;
+  this->counts[i]++;
+  if (value > this->max) this->max = value;
+}
+
+void Histogram::reset() {
+  for (uint8_t i = 0; i < HISTOGRAM_MAX_BUCKETS; i++) this->counts[i] = 0UL;
+  this->max = 0UL;
+}
+
+uint8_t Histogram::getBucketCount() {
+  return(this->boundCount + 1);
+}
+
+uint32_t Histogram::getCount(uint8_t bucket) {
+  return((bucket <= this->boundCount)?this->counts[bucket]:0UL);
+}
+
+uint32_t Histogram::getMax() {
+  return(this->max);
+}
+
+/**********************************************************************
+ * Write the histogram into <buffer> as a JSON object. Returns the
+ * length of the generated string or zero if it would not fit in
+ * <size> bytes.
+ */
+size_t Histogram::toJson(char *buffer, size_t size) {
+  size_t length = 0;
+  int n;
+
+  if ((n = snprintf(buffer, size, "{ \"buckets\": [ ")) < 0) return(0);
+  length += n;
+  for (uint8_t i = 0; i <= this->boundCount; i++) {
+    if (length >= size) return(0);
+    if ((n = snprintf(buffer + length, size - length, "%s%lu", (i)?", ":"", (unsigned long) this->counts[i])) < 0) return(0);
+    length += n;
+  }
+  if (length >= size) return(0);
+  if ((n = snprintf(buffer + length, size - length, " ], \"max\": %lu }", (unsigned long) this->max)) < 0) return(0);
+  length += n;
+  return((length < size)?length:0);
+}
@@ -0,0 +1,43 @@
+/**********************************************************************
+ * NAME
+ *   Histogram.h - fixed-bucket histogram of unsigned values.
+ * DESCRIPTION
+ *   Counts values into the buckets delimited by an ascending table of
+ *   upper bounds supplied by the client: bucket i counts values less
+ *   than bounds[i] (and not counted by an earlier bucket) and a final
+ *   bucket counts everything else. The bounds table is held by
+ *   reference and so must outlive the histogram.
+ *
+ *   Recording a value is a short linear search and an increment, so a
+ *   histogram is cheap enough to feed from every pass of loop().
+ *   toJson() renders the counts (and the largest value recorded) in
+ *   the form:
+ *
+ *     '{ "buckets": [ n, n, ... ], "max": n }'
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <Arduino.h>
+
+#define HISTOGRAM_MAX_BUCKETS 12          // Including the overflow bucket
+
+class Histogram {
+  public:
+    Histogram(const uint32_t *bounds, uint8_t count);
+    void record(uint32_t value);
+    void reset();
+    uint8_t getBucketCount();
+    uint32_t getCount(uint8_t bucket);
+    uint32_t getMax();
+    size_t toJson(char *buffer, size_t size);
+
+  private:
+    const uint32_t *bounds;
+    uint8_t boundCount;
+    uint32_t counts[HISTOGRAM_MAX_BUCKETS];
+    uint32_t max;
+};
+
+#endif
@@ -0,0 +1,151 @@
+/**********************************************************************
+ * InputDriver.cpp - SensorDriver for SPST switches and a PIR motion
+ * sensor.
+ */
+
+#include "InputDriver.h"
+
+/**********************************************************************
+ * Create a driver for the <switchCount> switches on <switchPins>,
+ * named by <switchNames>, and for any PIR sensor on <motionPin>. The
+ * name table is referenced, not copied.
+ */
+InputDriver::InputDriver(const uint8_t *switchPins, uint8_t switchCount, const char * const *switchNames, uint8_t motionPin) : switchNames(switchNames) {
+  this->switchCount = (switchCount < SAMPLE_MAX_SWITCHES)?switchCount:SAMPLE_MAX_SWITCHES;
+  this->hasMotion = (motionPin != INPUT_DRIVER_NO_PIN);
+  this->channelCount = 0;
+  for (uint8_t i = 0; i < this->switchCount; i++) {
+    this->channels[this->channelCount++] = { this, switchPins[i], i };
+  }
+  if (this->hasMotion) this->channels[this->channelCount++] = { this, motionPin, this->switchCount };
+  this->edgeQueueOverruns = 0;
+  this->states = this->unpublished = this->settling = this->deferred = 0;
+  for (uint8_t i = 0; i < INPUT_DRIVER_MAX_CHANNELS; i++) this->lastEdgeTimestamp[i] = 0;
+}
+
+/**********************************************************************
+ * Configure the pins, read their initial state and attach an edge
+ * interrupt to every pin that supports one.
+ */
+bool InputDriver::begin() {
+  for (uint8_t i = 0; i < this->channelCount; i++) {
+    pinMode(this->channels[i].pin, (i < this->switchCount)?INPUT_PULLUP:INPUT);
+  }
+  this->readInputs();
+  for (uint8_t i = 0; i < this->channelCount; i++) {
+    if (this->channels[i].pin != INPUT_DRIVER_POLLED_PIN) {
+      attachInterruptArg(digitalPinToInterrupt(this->channels[i].pin), InputDriver::isr, &this->channels[i], CHANGE);
+    }
+  }
+  return(this->channelCount > 0);
+}
+
+void IRAM_ATTR InputDriver::isr(void *arg) {
+  CHANNEL *channel = (CHANNEL*) arg;
+  channel->driver->edgeQueue.push(channel->index, digitalRead(channel->pin));
+}
+
+/**********************************************************************
+ * Apply any changes deferred until the previous ones were published,
+ * then process any queued edges and poll any input which is not
+ * interrupt capable.
+ */
+uint8_t InputDriver::poll() {
+  EDGE_EVENT event;
+  uint8_t result = 0;
+  uint16_t due = (this->deferred & ~this->unpublished);
+
+  if (due) {
+    this->states ^= due;
+    this->unpublished |= due;
+    this->deferred &= ~due;
+    result |= SENSOR_UPDATED;
+  }
+  while (this->edgeQueue.pop(event)) result |= this->processEdge(event);
+  if (this->edgeQueue.getOverruns() != this->edgeQueueOverruns) {
+    this->edgeQueueOverruns = this->edgeQueue.getOverruns();
+    this->readInputs();
+    result |= SENSOR_UPDATED;
+  }
+  for (uint8_t i = 0; i < this->channelCount; i++) {
+    if (!(this->settling & (1 << i))) continue;
+    event.timestamp = micros();
+    if ((event.timestamp - this->lastEdgeTimestamp[i]) < INPUT_DRIVER_DEBOUNCE_INTERVAL) continue;
+    this->settling &= ~(1 << i);
+    event.level = digitalRead(this->channels[i].pin);
+    event.channel = i;
+    result |= this->processEdge(event);
+  }
+  for (uint8_t i = 0; i < this->channelCount; i++) {
+    if (this->channels[i].pin != INPUT_DRIVER_POLLED_PIN) continue;
+    if (this->settling & (1 << i)) continue;
+    event.level = digitalRead(this->channels[i].pin);
+    if (event.level != (((this->states ^ this->deferred) >> i) & 1)) {
+      event.timestamp = micros();
+      event.channel = i;
+      result |= this->processEdge(event);
+    }
+  }
+  return(result);
+}
+
+void InputDriver::describe(SAMPLE_NAMES &names) {
+  for (uint8_t i = 0; i < this->switchCount; i++) names.switches[i] = this->switchNames[i];
+}
+
+void InputDriver::encode(SAMPLE &sample) {
+  sample.switchCount = this->switchCount;
+  sample.switches = (uint8_t) (this->states & ((1 << this->switchCount) - 1));
+  if (this->hasMotion) {
+    sample.flags |= SAMPLE_HAS_MOTION;
+    if ((this->states >> this->switchCount) & 1) sample.flags |= SAMPLE_MOTION;
+  }
+}
+
+void InputDriver::published() {
+  this->unpublished = 0;
+}
+
+/**********************************************************************
+ * Apply a single captured edge to the input states, returning
+ * SENSOR_UPDATED if a state changed. An edge on an input whose last
+ * change has yet to be published only updates its deferred level. A
+ * switch edge inside the debounce interval is dropped and the switch
+ * is marked as settling, so that poll() reads its level again once it
+ * has been quiet for the whole interval.
+ */
+uint8_t InputDriver::processEdge(const EDGE_EVENT &event) {
+  if (event.channel >= this->channelCount) return(0);
+
+  uint16_t bit = (1 << event.channel);
+  bool changed = ((((this->states ^ this->deferred) & bit)?1:0) != event.level);
+
+  if ((event.channel < this->switchCount) && ((event.timestamp - this->lastEdgeTimestamp[event.channel]) < INPUT_DRIVER_DEBOUNCE_INTERVAL)) {
+    this->lastEdgeTimestamp[event.channel] = event.timestamp;
+    this->settling |= bit;
+    return(0);
+  }
+  if (!changed) {
+    this->lastEdgeTimestamp[event.channel] = event.timestamp;
+    return(0);
+  }
+  this->lastEdgeTimestamp[event.channel] = event.timestamp;
+  if (this->unpublished & bit) {
+    this->deferred ^= bit;
+    return(0);
+  }
+  if (event.level) this->states |= bit; else this->states &= ~bit;
+  this->unpublished |= bit;
+  return(SENSOR_UPDATED);
+}
+
+/**********************************************************************
+ * Read the current state of all inputs directly. Used at start up and
+ * to resynchronise if the edge queue ever overflows.
+ */
+void InputDriver::readInputs() {
+  this->states = this->deferred = 0;
+  for (uint8_t i = 0; i < this->channelCount; i++) {
+    if (digitalRead(this->channels[i].pin)) this->states |= (1 << i);
+  }
+}
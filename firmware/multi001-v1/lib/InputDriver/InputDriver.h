@@ -0,0 +1,80 @@
+/**********************************************************************
+ * NAME
+ *   InputDriver.h - SensorDriver for SPST switches and a PIR motion
+ *   sensor.
+ * DESCRIPTION
+ *   Up to SAMPLE_MAX_SWITCHES active-low switches (with the internal
+ *   pull-up enabled) and, optionally, a single PIR sensor output are
+ *   monitored. Edges on each input are captured by an interrupt
+ *   service routine and queued for processing by poll(). GPIO16
+ *   cannot generate interrupts on the ESP8266, so an input connected
+ *   there is instead polled and its edges are handled in exactly the
+ *   same way as queued ones.
+ *
+ *   Switch edges closer together than the debounce interval are
+ *   treated as contact bounce and dropped, and once the switch has
+ *   been quiet for the whole interval its level is read again and any
+ *   change is handled like any other edge. Each accepted change is
+ *   reported by poll() as SENSOR_UPDATED. An input which changes again
+ *   while its previous change has yet to be published goes on
+ *   reporting that change, and only its latest level is remembered.
+ *   Once published() has been called, poll() reports that level as a
+ *   new change if it differs. A short pulse is therefore never lost
+ *   (it is published as two changes, one publication apart), but
+ *   however fast an input chatters it can cause no more publications
+ *   than the publication policy allows, and the edge queue never backs
+ *   up behind it.
+ *
+ *   If the edge queue ever overflows the input states are simply read
+ *   again from the pins.
+ */
+
+#ifndef INPUT_DRIVER_H
+#define INPUT_DRIVER_H
+
+#include <Arduino.h>
+#include <EdgeQueue.h>
+#include <SensorDriver.h>
+
+#define INPUT_DRIVER_NO_PIN 0xFF
+#define INPUT_DRIVER_QUEUE_SIZE 32        // Must be a power of two
+#define INPUT_DRIVER_DEBOUNCE_INTERVAL 20000 // Microseconds
+#define INPUT_DRIVER_MAX_CHANNELS (SAMPLE_MAX_SWITCHES + 1)
+#define INPUT_DRIVER_POLLED_PIN 16        // Pin without interrupt support
+
+class InputDriver : public SensorDriver {
+  public:
+    InputDriver(const uint8_t *switchPins, uint8_t switchCount, const char * const *switchNames, uint8_t motionPin = INPUT_DRIVER_NO_PIN);
+    const char *getName() { return("INPUT"); }
+    bool begin();
+    uint8_t poll();
+    void describe(SAMPLE_NAMES &names);
+    void encode(SAMPLE &sample);
+    void published();
+
+  private:
+    struct CHANNEL {
+      InputDriver *driver;
+      uint8_t pin;
+      uint8_t index;
+    };
+
+    static void IRAM_ATTR isr(void *arg);
+    uint8_t processEdge(const EDGE_EVENT &event);
+    void readInputs();
+
+    const char * const *switchNames;
+    uint8_t switchCount;
+    uint8_t channelCount;                 // Switches then (perhaps) motion
+    bool hasMotion;
+    CHANNEL channels[INPUT_DRIVER_MAX_CHANNELS];
+    EdgeQueue<INPUT_DRIVER_QUEUE_SIZE> edgeQueue;
+    uint32_t edgeQueueOverruns;
+    uint32_t lastEdgeTimestamp[INPUT_DRIVER_MAX_CHANNELS];
+    uint16_t states;                      // Bit n is the level of channel n
+    uint16_t unpublished;                 // Bit n says channel n has an unpublished change
+    uint16_t settling;                    // Bit n says channel n dropped an edge as bounce
+    uint16_t deferred;                    // Bit n says channel n has changed again since its unpublished change
+};
+
+#endif
@@ -0,0 +1,84 @@
+/**********************************************************************
+ * LuxDriver.cpp - SensorDriver for an analogue illumination sensor.
+ */
+
+#include "LuxDriver.h"
+#include <Profiler.h>
+
+/**********************************************************************
+ * Create a driver for the sensor on analogue input <pin>, which is
+ * read once every <interval> milliseconds and whose readings are
+ * scaled by <numerator>/<denominator>.
+ */
+LuxDriver::LuxDriver(uint8_t pin, uint16_t numerator, uint16_t denominator, unsigned long interval) : pin(pin), numerator(numerator), interval(interval) {
+  this->denominator = (denominator)?denominator:1;
+  this->lastRead = 0UL;
+  this->sampleRequested = true;
+  this->sampled = false;
+  this->lux = 0;
+  this->sum = 0;
+  this->count = 0;
+  this->next = 0;
+}
+
+bool LuxDriver::begin() {
+  this->sampleRequested = true;
+  this->read();
+  return(true);
+}
+
+void LuxDriver::startSample() {
+  this->sampleRequested = true;
+}
+
+/**********************************************************************
+ * Take a reading if one is due and, if a sample has been requested,
+ * make the current window average the driver's value.
+ */
+uint8_t LuxDriver::poll() {
+  if ((millis() - this->lastRead) >= this->interval) this->read();
+  if (!this->sampleRequested) return(0);
+  this->lux = this->getValue();
+  this->sampleRequested = false;
+  this->sampled = true;
+  return(SENSOR_UPDATED);
+}
+
+bool LuxDriver::isReady() {
+  return(this->sampled);
+}
+
+void LuxDriver::encode(SAMPLE &sample) {
+  sample.flags |= SAMPLE_HAS_LUX;
+  sample.lux = this->lux;
+}
+
+/**********************************************************************
+ * Returns the scaled average of the readings in the window.
+ */
+int16_t LuxDriver::getValue() {
+  uint32_t lux;
+
+  if (this->count == 0) return(0);
+  lux = ((this->sum * this->numerator) + ((this->count * this->denominator) / 2)) / (this->count * this->denominator);
+  return((lux > LUX_DRIVER_MAX_VALUE)?LUX_DRIVER_MAX_VALUE:(int16_t) lux);
+}
+
+/**********************************************************************
+ * Add a new reading to the window, replacing the oldest once the
+ * window is full.
+ */
+void LuxDriver::read() {
+  uint16_t value;
+
+  {
+    PROFILE_SECTION("lux.analogRead");
+    value = analogRead(this->pin);
+  }
+
+  this->lastRead = millis();
+  if (this->count == LUX_DRIVER_WINDOW) this->sum -= this->window[this->next]; else this->count++;
+  this->window[this->next] = value;
+  this->sum += value;
+  this->next = ((this->next + 1) & (LUX_DRIVER_WINDOW - 1));
+}
@@ -0,0 +1,59 @@
+/**********************************************************************
+ * NAME
+ *   LuxDriver.h - SensorDriver for an analogue illumination sensor.
+ * DESCRIPTION
+ *   Illumination is read from an analogue input (normally the output
+ *   of a luxControl SmartDim Sensor 2) and scaled by an integer
+ *   calibration ratio into the range 0..1023.
+ *
+ *   The SmartDim output is noisy, so rather than take a single reading
+ *   when a sample is requested, poll() oversamples the input in the
+ *   background once every sample interval into a window of the last
+ *   LUX_DRIVER_WINDOW readings. A running sum of the window is kept,
+ *   so the reported value is the window average at O(1) cost.
+ *
+ *   Frequent calls to analogRead() are known to disturb the ESP8266's
+ *   radio, so the sample interval should not be made too short: a few
+ *   tens of milliseconds is plenty.
+ */
+
+#ifndef LUX_DRIVER_H
+#define LUX_DRIVER_H
+
+#include <Arduino.h>
+#include <SensorDriver.h>
+
+#define LUX_DRIVER_MAX_VALUE 1023
+#define LUX_DRIVER_WINDOW 16              // Must be a power of two
+
+class LuxDriver : public SensorDriver {
+  static_assert(((LUX_DRIVER_WINDOW & (LUX_DRIVER_WINDOW - 1)) == 0) && (LUX_DRIVER_WINDOW <= 128), "LUX_DRIVER_WINDOW must be a power of two no greater than 128");
+
+  public:
+    LuxDriver(uint8_t pin, uint16_t numerator, uint16_t denominator, unsigned long interval);
+    const char *getName() { return("LUX"); }
+    bool begin();
+    void startSample();
+    uint8_t poll();
+    bool isReady();
+    void encode(SAMPLE &sample);
+    int16_t getValue();
+
+  private:
+    void read();
+
+    uint8_t pin;
+    uint16_t numerator;
+    uint16_t denominator;
+    unsigned long interval;               // Milliseconds between readings
+    unsigned long lastRead;
+    bool sampleRequested;
+    bool sampled;
+    int16_t lux;
+    uint16_t window[LUX_DRIVER_WINDOW];
+    uint32_t sum;                         // Sum of the readings in window
+    uint8_t count;                        // Readings in window
+    uint8_t next;                         // Next slot in window
+};
+
+#endif
@@ -0,0 +1,67 @@
+/**********************************************************************
+ * Metrics.cpp - cheap run time statistics for publication.
+ */
+
+#include "Metrics.h"
+
+const uint32_t Metrics::LOOP_BOUNDS[] = { 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+const uint32_t Metrics::LATENCY_BOUNDS[] = { 10, 20, 50, 100, 200, 500, 1000, 5000, 60000, 600000 };
+
+Metrics::Metrics() :
+  loop(LOOP_BOUNDS, sizeof(LOOP_BOUNDS) / sizeof(LOOP_BOUNDS[0])),
+  latency(LATENCY_BOUNDS, sizeof(LATENCY_BOUNDS) / sizeof(LATENCY_BOUNDS[0])) {
+  this->published = 0UL;
+  this->failed = 0UL;
+}
+
+void Metrics::recordLoop(unsigned long micros) {
+  this->loop.record(micros);
+}
+
+void Metrics::recordLatency(unsigned long millis) {
+  this->latency.record(millis);
+}
+
+void Metrics::recordPublish(bool success) {
+  if (success) this->published++; else this->failed++;
+}
+
+/**********************************************************************
+ * Start a new period for the histograms.
+ */
+void Metrics::reset() {
+  this->loop.reset();
+  this->latency.reset();
+}
+
+unsigned long Metrics::getPublished() {
+  return(this->published);
+}
+
+unsigned long Metrics::getFailed() {
+  return(this->failed);
+}
+
+/**********************************************************************
+ * Write the metrics, together with the caller's <system> figures, into
+ * <buffer> as a JSON object. Returns the length of the generated
+ * string or zero if it would not fit in <size> bytes.
+ */
+size_t Metrics::toJson(char *buffer, size_t size, const METRICS_SYSTEM &system) {
+  size_t length = 0;
+  size_t n;
+  int m;
+
+  m = snprintf(buffer, size, "{ \"heap\": %lu, \"fragmentation\": %u, \"rssi\": %ld, \"connects\": %lu, \"failures\": %lu, \"published\": %lu, \"failed\": %lu, \"loop\": ", (unsigned long) system.freeHeap, system.heapFragmentation, (long) system.rssi, system.connects, system.connectFailures, this->published, this->failed);
+  if ((m < 0) || ((size_t) m >= size)) return(0);
+  length += m;
+  if (!(n = this->loop.toJson(buffer + length, size - length))) return(0);
+  length += n;
+  if ((m = snprintf(buffer + length, size - length, ", \"latency\": ")) < 0) return(0);
+  length += m;
+  if ((length >= size) || (!(n = this->latency.toJson(buffer + length, size - length)))) return(0);
+  length += n;
+  if ((m = snprintf(buffer + length, size - length, " }")) < 0) return(0);
+  length += m;
+  return((length < size)?length:0);
+}
@@ -0,0 +1,70 @@
+/**********************************************************************
+ * NAME
+ *   Metrics.h - cheap run time statistics for publication.
+ * DESCRIPTION
+ *   Collects, using only counters and fixed arrays, the figures which
+ *   show how a node is behaving in the field:
+ *
+ *   loop        A histogram of loop() iteration times in microseconds,
+ *               with bucket upper bounds of 100, 200, 500, 1000, 2000,
+ *               5000, 10000, 20000, 50000 and 100000.
+ *
+ *   latency     A histogram of the time, in milliseconds, from a
+ *               sample being taken to its successful publication, with
+ *               bucket upper bounds of 10, 20, 50, 100, 200, 500, 1000,
+ *               5000, 60000 and 600000 (queued samples land in the
+ *               upper buckets).
+ *
+ *   published   The number of MQTT publications which succeeded and
+ *   failed      failed.
+ *
+ *   The histograms cover the period since the last call to reset();
+ *   the publication counts run from start up. toJson() renders the
+ *   metrics together with system figures supplied by the caller in
+ *   the form:
+ *
+ *     '{ "heap": n, "fragmentation": n, "rssi": n, "connects": n,
+ *        "failures": n, "published": n, "failed": n,
+ *        "loop": { ... }, "latency": { ... } }'
+ *
+ *   where "connects" and "failures" count MQTT connections and failed
+ *   connection attempts and each histogram is rendered as described in
+ *   Histogram.h.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <Histogram.h>
+
+struct METRICS_SYSTEM {
+  uint32_t freeHeap;                      // Bytes
+  uint8_t heapFragmentation;              // Percent
+  int32_t rssi;                           // dBm
+  unsigned long connects;
+  unsigned long connectFailures;
+};
+
+class Metrics {
+  public:
+    Metrics();
+    void recordLoop(unsigned long micros);
+    void recordLatency(unsigned long millis);
+    void recordPublish(bool success);
+    void reset();
+    unsigned long getPublished();
+    unsigned long getFailed();
+    size_t toJson(char *buffer, size_t size, const METRICS_SYSTEM &system);
+
+  private:
+    static const uint32_t LOOP_BOUNDS[];
+    static const uint32_t LATENCY_BOUNDS[];
+
+    Histogram loop;
+    Histogram latency;
+    unsigned long published;
+    unsigned long failed;
+};
+
+#endif
@@ -0,0 +1,123 @@
+/**********************************************************************
+ * InflightWindow.cpp - track unacknowledged QoS 1 publications.
+ */
+
+#include "InflightWindow.h"
+
+InflightWindow::InflightWindow() {
+  for (uint8_t i = 0; i < INFLIGHT_WINDOW_SIZE; i++) this->entries[i].used = false;
+  this->head = 0;
+  this->span = 0;
+  this->count = 0;
+  this->nextPacketId = 1;
+}
+
+/**********************************************************************
+ * Add an entry of <kind> carrying up to INFLIGHT_WINDOW_SAMPLES of the
+ * <count> <samples> (see getEntry() for how many) and assign it a
+ * packet identifier. Returns the entry's slot, or -1 if the window is
+ * full.
+ */
+int8_t InflightWindow::add(uint8_t kind, const SAMPLE *samples, size_t count) {
+  int8_t slot;
+  INFLIGHT_ENTRY *entry;
+
+  if ((this->isFull()) || (count == 0)) return(-1);
+  slot = ((this->head + this->span) % INFLIGHT_WINDOW_SIZE);
+  entry = &this->entries[slot];
+  entry->count = (count < INFLIGHT_WINDOW_SAMPLES)?count:INFLIGHT_WINDOW_SAMPLES;
+  memcpy(entry->samples, samples, (entry->count * sizeof(SAMPLE)));
+  entry->kind = kind;
+  entry->packetId = this->nextPacketId;
+  entry->transmissions = 0;
+  entry->sentAt = 0UL;
+  entry->used = true;
+  if (++this->nextPacketId == 0) this->nextPacketId = 1;
+  this->span++;
+  this->count++;
+  return(slot);
+}
+
+/**********************************************************************
+ * Record that the entry in <slot> was (re)transmitted at <now>.
+ */
+void InflightWindow::sent(int8_t slot, unsigned long now) {
+  this->entries[slot].sentAt = now;
+  this->entries[slot].transmissions++;
+}
+
+/**********************************************************************
+ * Release the entry whose packet identifier is <packetId>. Returns
+ * its slot, whose contents remain readable until the next add(), or
+ * -1 if no such publication is outstanding (a duplicate
+ * acknowledgement, say).
+ */
+int8_t InflightWindow::acknowledge(uint16_t packetId) {
+  for (uint8_t i = 0; i < this->span; i++) {
+    int8_t slot = ((this->head + i) % INFLIGHT_WINDOW_SIZE);
+
+    if ((this->entries[slot].used) && (this->entries[slot].packetId == packetId)) {
+      this->release(slot);
+      return(slot);
+    }
+  }
+  return(-1);
+}
+
+/**********************************************************************
+ * Return the slot of the oldest entry which was last transmitted at
+ * least <timeout> milliseconds before <now> (or has never been
+ * transmitted), or -1 if there is none.
+ */
+int8_t InflightWindow::getExpired(unsigned long now, unsigned long timeout) {
+  for (uint8_t i = 0; i < this->span; i++) {
+    int8_t slot = ((this->head + i) % INFLIGHT_WINDOW_SIZE);
+    const INFLIGHT_ENTRY &entry = this->entries[slot];
+
+    if ((entry.used) && ((entry.transmissions == 0) || ((now - entry.sentAt) >= timeout))) return(slot);
+  }
+  return(-1);
+}
+
+/**********************************************************************
+ * Return the slot of the oldest entry, or -1 if the window is empty.
+ */
+int8_t InflightWindow::getOldest() {
+  return((this->span)?this->head:-1);
+}
+
+const INFLIGHT_ENTRY &InflightWindow::getEntry(int8_t slot) {
+  return(this->entries[slot]);
+}
+
+/**********************************************************************
+ * Release the entry in <slot> without it having been acknowledged.
+ */
+void InflightWindow::release(int8_t slot) {
+  if (!this->entries[slot].used) return;
+  this->entries[slot].used = false;
+  this->count--;
+  this->slide();
+}
+
+bool InflightWindow::isFull() {
+  return(this->span == INFLIGHT_WINDOW_SIZE);
+}
+
+bool InflightWindow::isEmpty() {
+  return(this->count == 0);
+}
+
+uint8_t InflightWindow::getCount() {
+  return(this->count);
+}
+
+/**********************************************************************
+ * Move the start of the window past any released entries.
+ */
+void InflightWindow::slide() {
+  while ((this->span) && (!this->entries[this->head].used)) {
+    this->head = ((this->head + 1) % INFLIGHT_WINDOW_SIZE);
+    this->span--;
+  }
+}
@@ -0,0 +1,68 @@
+/**********************************************************************
+ * NAME
+ *   InflightWindow.h - track unacknowledged QoS 1 publications.
+ * DESCRIPTION
+ *   A small sliding window of publications which have been sent (or
+ *   are about to be) but not yet acknowledged. Each entry holds a copy
+ *   of the samples it carries, so that it can be re-encoded for
+ *   retransmission and, should the connection be lost, handed back to
+ *   the store-and-forward queue; a caller supplied <kind> says which
+ *   topic it belongs to.
+ *
+ *   Up to INFLIGHT_WINDOW_SIZE publications may be outstanding at once,
+ *   so forwarding continues whilst earlier messages await their
+ *   PUBACKs rather than stopping to wait for each in turn. Entries are
+ *   kept in the order in which they were added and a packet identifier
+ *   (1..65535) is assigned to each. An entry is released when it is
+ *   acknowledged, although the window only slides past it once every
+ *   older entry has been released too.
+ */
+
+#ifndef INFLIGHT_WINDOW_H
+#define INFLIGHT_WINDOW_H
+
+#include <Arduino.h>
+#include <Sample.h>
+
+#ifndef INFLIGHT_WINDOW_SIZE
+#define INFLIGHT_WINDOW_SIZE 4            // Publications awaiting acknowledgement
+#endif
+#ifndef INFLIGHT_WINDOW_SAMPLES
+#define INFLIGHT_WINDOW_SAMPLES 8         // Most samples carried by one publication
+#endif
+
+struct INFLIGHT_ENTRY {
+  SAMPLE samples[INFLIGHT_WINDOW_SAMPLES];
+  unsigned long sentAt;                   // millis() of the latest transmission
+  uint16_t packetId;
+  uint8_t count;                          // Number of samples
+  uint8_t kind;                           // Caller defined
+  uint8_t transmissions;                  // Number of times sent
+  bool used;
+};
+
+class InflightWindow {
+  public:
+    InflightWindow();
+    int8_t add(uint8_t kind, const SAMPLE *samples, size_t count);
+    void sent(int8_t slot, unsigned long now);
+    int8_t acknowledge(uint16_t packetId);
+    int8_t getExpired(unsigned long now, unsigned long timeout);
+    int8_t getOldest();
+    const INFLIGHT_ENTRY &getEntry(int8_t slot);
+    void release(int8_t slot);
+    bool isFull();
+    bool isEmpty();
+    uint8_t getCount();
+
+  private:
+    void slide();
+
+    INFLIGHT_ENTRY entries[INFLIGHT_WINDOW_SIZE];
+    uint8_t head;                         // Oldest slot
+    uint8_t span;                         // Slots from head to the newest entry
+    uint8_t count;                        // Entries in use
+    uint16_t nextPacketId;
+};
+
+#endif
@@ -0,0 +1,179 @@
+/**********************************************************************
+ * QosClient.cpp - QoS 1 publication alongside PubSubClient.
+ */
+
+#include "QosClient.h"
+
+#define MQTT_PACKET_PUBLISH 0x30
+#define MQTT_PACKET_PUBACK 4              // Control packet type
+#define MQTT_PUBLISH_QOS1 0x02
+#define MQTT_PUBLISH_RETAIN 0x01
+#define MQTT_PUBLISH_DUP 0x08
+#define MQTT_MAX_REMAINING_LENGTH 268435455UL
+
+QosClient::QosClient(Client &client) : client(client) {
+  this->ackHead = 0;
+  this->ackCount = 0;
+  this->ackTotal = 0UL;
+  this->reset();
+}
+
+/**********************************************************************
+ * Write the fixed and variable headers of a QoS 1 PUBLISH of a
+ * <length> byte payload to <topic> with packet identifier <packetId>
+ * (which must not be zero). <duplicate> should be set when the
+ * publication is a retransmission. Returns true if the header was
+ * written, in which case the payload must follow.
+ */
+bool QosClient::beginPublish(const char *topic, size_t length, bool retained, uint16_t packetId, bool duplicate) {
+  uint8_t header[7];
+  size_t topicLength = strlen(topic);
+  uint32_t remaining = (2 + topicLength + 2 + length);
+  size_t n = 0;
+
+  if ((packetId == 0) || (topicLength > 0xffff) || (remaining > MQTT_MAX_REMAINING_LENGTH) || (!this->client.connected())) return(false);
+  header[n++] = (MQTT_PACKET_PUBLISH | MQTT_PUBLISH_QOS1 | ((retained)?MQTT_PUBLISH_RETAIN:0) | ((duplicate)?MQTT_PUBLISH_DUP:0));
+  do {
+    header[n] = (remaining & 0x7f);
+    remaining >>= 7;
+    if (remaining) header[n] |= 0x80;
+    n++;
+  } while (remaining);
+  header[n++] = (topicLength >> 8);
+  header[n++] = (topicLength & 0xff);
+  if (this->client.write(header, n) != n) return(false);
+  if (this->client.write((const uint8_t*) topic, topicLength) != topicLength) return(false);
+  header[0] = (packetId >> 8);
+  header[1] = (packetId & 0xff);
+  return(this->client.write(header, 2) == 2);
+}
+
+/**********************************************************************
+ * Get the packet identifier of the oldest acknowledgement not yet
+ * collected into <packetId>. Returns false if there isn't one.
+ */
+bool QosClient::getAck(uint16_t &packetId) {
+  if (this->ackCount == 0) return(false);
+  packetId = this->acks[this->ackHead];
+  this->ackHead = ((this->ackHead + 1) % QOS_CLIENT_ACK_QUEUE);
+  this->ackCount--;
+  return(true);
+}
+
+/**********************************************************************
+ * Return the number of PUBACKs received since boot.
+ */
+unsigned long QosClient::getAcks() {
+  return(this->ackTotal);
+}
+
+int QosClient::connect(IPAddress ip, uint16_t port) {
+  this->reset();
+  return(this->client.connect(ip, port));
+}
+
+int QosClient::connect(const char *host, uint16_t port) {
+  this->reset();
+  return(this->client.connect(host, port));
+}
+
+size_t QosClient::write(uint8_t b) {
+  return(this->client.write(b));
+}
+
+size_t QosClient::write(const uint8_t *buf, size_t size) {
+  return(this->client.write(buf, size));
+}
+
+int QosClient::available() {
+  return(this->client.available());
+}
+
+int QosClient::read() {
+  int b = this->client.read();
+
+  if (b >= 0) this->parse((uint8_t) b);
+  return(b);
+}
+
+int QosClient::read(uint8_t *buf, size_t size) {
+  int n = this->client.read(buf, size);
+
+  for (int i = 0; i < n; i++) this->parse(buf[i]);
+  return(n);
+}
+
+int QosClient::peek() {
+  return(this->client.peek());
+}
+
+bool QosClient::flush(unsigned int maxWaitMs) {
+  return(this->client.flush(maxWaitMs));
+}
+
+bool QosClient::stop(unsigned int maxWaitMs) {
+  this->reset();
+  return(this->client.stop(maxWaitMs));
+}
+
+uint8_t QosClient::connected() {
+  return(this->client.connected());
+}
+
+QosClient::operator bool() {
+  return((bool) this->client);
+}
+
+/**********************************************************************
+ * Start following a new connection's inbound traffic, discarding any
+ * acknowledgements from the previous one.
+ */
+void QosClient::reset() {
+  this->state = PARSER_HEADER;
+  this->type = 0;
+  this->shift = 0;
+  this->remaining = 0UL;
+  this->position = 0UL;
+  this->packetId = 0;
+  this->ackCount = 0;
+}
+
+/**********************************************************************
+ * Follow the inbound packet stream one byte <b> at a time, queueing
+ * the packet identifier of each complete PUBACK. When the queue is
+ * full the oldest acknowledgement is lost, which simply causes its
+ * publication to be retransmitted.
+ */
+void QosClient::parse(uint8_t b) {
+  switch (this->state) {
+    case PARSER_HEADER:
+      this->type = (b >> 4);
+      this->shift = 0;
+      this->remaining = 0UL;
+      this->state = PARSER_LENGTH;
+      return;
+    case PARSER_LENGTH:
+      this->remaining |= ((uint32_t) (b & 0x7f) << this->shift);
+      this->shift += 7;
+      if ((b & 0x80) && (this->shift < 28)) return;
+      this->position = 0UL;
+      this->packetId = 0;
+      this->state = (this->remaining)?PARSER_BODY:PARSER_HEADER;
+      return;
+    case PARSER_BODY:
+      if ((this->type == MQTT_PACKET_PUBACK) && (this->position < 2)) this->packetId = ((this->packetId << 8) | b);
+      this->position++;
+      if (--this->remaining) return;
+      if ((this->type == MQTT_PACKET_PUBACK) && (this->position == 2)) {
+        if (this->ackCount == QOS_CLIENT_ACK_QUEUE) {
+          this->ackHead = ((this->ackHead + 1) % QOS_CLIENT_ACK_QUEUE);
+          this->ackCount--;
+        }
+        this->acks[(this->ackHead + this->ackCount) % QOS_CLIENT_ACK_QUEUE] = this->packetId;
+        this->ackCount++;
+        this->ackTotal++;
+      }
+      this->state = PARSER_HEADER;
+      return;
+  }
+}
@@ -0,0 +1,75 @@
+/**********************************************************************
+ * NAME
+ *   QosClient.h - QoS 1 publication alongside PubSubClient.
+ * DESCRIPTION
+ *   PubSubClient only publishes at QoS 0 and discards any PUBACK it
+ *   receives. A QosClient sits between PubSubClient and the network
+ *   client (it is passed to PubSubClient in place of the WiFiClient)
+ *   and passes everything through unchanged, but:
+ *
+ *   - beginPublish() writes the header of a QoS 1 PUBLISH packet
+ *     carrying a caller supplied packet identifier, after which
+ *     exactly <length> bytes of payload must be written with write().
+ *     This is the QoS 1 equivalent of PubSubClient::beginPublish()
+ *     and is used in the same way, except that there is no
+ *     endPublish(): the broker's PUBACK confirms delivery.
+ *
+ *   - Inbound traffic is followed packet by packet as PubSubClient
+ *     reads it and the packet identifier of every PUBACK is queued
+ *     for collection with getAck().
+ *
+ *   Because PubSubClient reads the network client only from its
+ *   loop() (and whilst connecting), acknowledgements are collected
+ *   after each call to loop(). Packet identifiers are the caller's
+ *   business (see InflightWindow.h); those of QosClient's QoS 1
+ *   publications must not be reused until they are acknowledged.
+ */
+
+#ifndef QOS_CLIENT_H
+#define QOS_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#define QOS_CLIENT_ACK_QUEUE 8            // Acknowledgements held for getAck()
+
+class QosClient : public Client {
+  public:
+    QosClient(Client &client);
+    bool beginPublish(const char *topic, size_t length, bool retained, uint16_t packetId, bool duplicate);
+    bool getAck(uint16_t &packetId);
+    unsigned long getAcks();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    bool flush(unsigned int maxWaitMs = 0) override;
+    bool stop(unsigned int maxWaitMs = 0) override;
+    uint8_t connected() override;
+    operator bool() override;
+
+  private:
+    enum PARSER_STATE { PARSER_HEADER, PARSER_LENGTH, PARSER_BODY };
+
+    void reset();
+    void parse(uint8_t b);
+
+    Client &client;
+    PARSER_STATE state;
+    uint8_t type;                         // Control packet type being read
+    uint8_t shift;                        // Remaining length bits read so far
+    uint32_t remaining;                   // Bytes left in the packet
+    uint32_t position;                    // Bytes of the packet body read
+    uint16_t packetId;
+    uint16_t acks[QOS_CLIENT_ACK_QUEUE];
+    uint8_t ackHead;
+    uint8_t ackCount;
+    unsigned long ackTotal;
+};
+
+#endif
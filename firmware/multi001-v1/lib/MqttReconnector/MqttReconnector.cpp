@@ -0,0 +1,165 @@
+/**********************************************************************
+ * MqttReconnector.cpp - non-blocking MQTT reconnection with backoff.
+ */
+
+#include "MqttReconnector.h"
+
+MqttReconnector::MqttReconnector(PubSubClient &client, unsigned long minBackoff, unsigned long maxBackoff) : client(client) {
+  this->clientId = 0;
+  this->username = 0;
+  this->password = 0;
+  this->minBackoff = minBackoff;
+  this->maxBackoff = (maxBackoff < minBackoff)?minBackoff:maxBackoff;
+  this->backoff = 0UL;
+  this->lastBackoff = 0UL;
+  this->retryDelay = 0UL;
+  this->lastAttempt = 0UL;
+  this->disconnectedAt = 0UL;
+  this->lastDowntime = 0UL;
+  this->connected = false;
+  this->connectedFlag = false;
+  this->attemptedFlag = false;
+  this->attempts = 0;
+  this->connects = 0;
+  this->failures = 0;
+  this->consecutiveFailures = 0;
+  this->lastState = MQTT_DISCONNECTED;
+}
+
+/**********************************************************************
+ * Set the credentials used for connection. The strings are not copied
+ * and must remain valid for the lifetime of the reconnector.
+ */
+void MqttReconnector::begin(const char *clientId, const char *username, const char *password) {
+  this->clientId = clientId;
+  this->username = username;
+  this->password = password;
+  this->disconnectedAt = millis();
+}
+
+/**********************************************************************
+ * Tick the state machine. Returns true if the client is connected.
+ * At most one connection attempt is made per call and only then if
+ * the host network is up and the current retry delay has expired.
+ */
+bool MqttReconnector::loop() {
+  unsigned long now = millis();
+
+  this->connectedFlag = false;
+  this->attemptedFlag = false;
+
+  if (this->client.connected()) return(true);
+
+  if (this->connected) {
+    // Connection has just been lost, so try again after a jittered
+    // minimum backoff rather than with every other node at once.
+    this->connected = false;
+    this->disconnectedAt = now;
+    this->lastAttempt = now;
+    this->backoff = this->minBackoff;
+    this->retryDelay = this->jitter(this->backoff);
+  }
+
+  if (WiFi.status() != WL_CONNECTED) return(false);
+  if ((this->attempts > 0) && ((now - this->lastAttempt) < this->retryDelay)) return(false);
+
+  this->attempts++;
+  this->attemptedFlag = true;
+  if (this->client.connect(this->clientId, this->username, this->password)) {
+    this->connected = true;
+    this->connectedFlag = true;
+    this->connects++;
+    this->consecutiveFailures = 0;
+    this->lastBackoff = this->backoff;
+    this->backoff = 0UL;
+    this->retryDelay = 0UL;
+    this->lastDowntime = (millis() - this->disconnectedAt);
+    this->lastState = MQTT_CONNECTED;
+  } else {
+    this->failures++;
+    this->consecutiveFailures++;
+    this->backoff = (this->backoff == 0UL)?this->minBackoff:(this->backoff * 2);
+    if (this->backoff > this->maxBackoff) this->backoff = this->maxBackoff;
+    this->retryDelay = this->jitter(this->backoff);
+    this->lastState = this->client.state();
+  }
+  this->lastAttempt = millis();
+  return(this->connected);
+}
+
+bool MqttReconnector::isConnected() {
+  return(this->connected);
+}
+
+/**********************************************************************
+ * Returns true if the most recent call to loop() established a new
+ * connection.
+ */
+bool MqttReconnector::justConnected() {
+  return(this->connectedFlag);
+}
+
+/**********************************************************************
+ * Returns true if the most recent call to loop() made a connection
+ * attempt (successful or not).
+ */
+bool MqttReconnector::justAttempted() {
+  return(this->attemptedFlag);
+}
+
+unsigned long MqttReconnector::getAttempts() {
+  return(this->attempts);
+}
+
+unsigned long MqttReconnector::getConnects() {
+  return(this->connects);
+}
+
+unsigned long MqttReconnector::getFailures() {
+  return(this->failures);
+}
+
+unsigned long MqttReconnector::getConsecutiveFailures() {
+  return(this->consecutiveFailures);
+}
+
+unsigned long MqttReconnector::getBackoff() {
+  return(this->backoff);
+}
+
+/**********************************************************************
+ * Returns the backoff period which had been reached when the
+ * connection was most recently established. A lost connection is
+ * always retried after at least <minBackoff>, so this is zero only
+ * if the very first attempt after begin() succeeded.
+ */
+unsigned long MqttReconnector::getLastBackoff() {
+  return(this->lastBackoff);
+}
+
+unsigned long MqttReconnector::getRetryDelay() {
+  return(this->retryDelay);
+}
+
+/**********************************************************************
+ * Returns the number of milliseconds for which the connection was
+ * down before it was most recently re-established.
+ */
+unsigned long MqttReconnector::getLastDowntime() {
+  return(this->lastDowntime);
+}
+
+/**********************************************************************
+ * Returns the PubSubClient state code from the most recent attempt.
+ */
+int MqttReconnector::getLastState() {
+  return(this->lastState);
+}
+
+/**********************************************************************
+ * Returns a retry delay drawn uniformly from the upper half of
+ * <backoff>.
+ */
+unsigned long MqttReconnector::jitter(unsigned long backoff) {
+  return((backoff / 2) + random((backoff / 2) + 1));
+}
@@ -0,0 +1,72 @@
+/**********************************************************************
+ * NAME
+ *   MqttReconnector.h - non-blocking MQTT reconnection with backoff.
+ * DESCRIPTION
+ *   A small state machine, ticked from loop(), which keeps a
+ *   PubSubClient connected to its broker without ever sleeping.
+ *
+ *   When a connection is lost, and after each failed attempt, the next
+ *   attempt is deferred by an exponentially increasing backoff period
+ *   (doubling from <minBackoff> up to <maxBackoff>). The actual delay
+ *   is jittered uniformly across the upper half of the backoff period
+ *   so that a fleet of nodes which lost a broker at the same moment do
+ *   not all come back to it at the same moment. The ESP8266 random()
+ *   draws on the hardware RNG unless randomSeed() has been called, so
+ *   no two nodes share a jitter sequence.
+ *
+ *   Connection statistics, including the backoff period reached
+ *   before the latest connection, are maintained for diagnostic
+ *   reporting.
+ */
+
+#ifndef MQTT_RECONNECTOR_H
+#define MQTT_RECONNECTOR_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+
+class MqttReconnector {
+  public:
+    MqttReconnector(PubSubClient &client, unsigned long minBackoff, unsigned long maxBackoff);
+    void begin(const char *clientId, const char *username, const char *password);
+    bool loop();
+    bool isConnected();
+    bool justConnected();
+    bool justAttempted();
+    unsigned long getAttempts();
+    unsigned long getConnects();
+    unsigned long getFailures();
+    unsigned long getConsecutiveFailures();
+    unsigned long getBackoff();
+    unsigned long getLastBackoff();
+    unsigned long getRetryDelay();
+    unsigned long getLastDowntime();
+    int getLastState();
+
+  private:
+    unsigned long jitter(unsigned long backoff);
+
+    PubSubClient &client;
+    const char *clientId;
+    const char *username;
+    const char *password;
+    unsigned long minBackoff;
+    unsigned long maxBackoff;
+    unsigned long backoff;
+    unsigned long lastBackoff;
+    unsigned long retryDelay;
+    unsigned long lastAttempt;
+    unsigned long disconnectedAt;
+    unsigned long lastDowntime;
+    bool connected;
+    bool connectedFlag;
+    bool attemptedFlag;
+    unsigned long attempts;
+    unsigned long connects;
+    unsigned long failures;
+    unsigned long consecutiveFailures;
+    int lastState;
+};
+
+#endif
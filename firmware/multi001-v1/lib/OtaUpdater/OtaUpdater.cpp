@@ -0,0 +1,143 @@
+/**********************************************************************
+ * OtaUpdater.cpp - manifest driven over-the-air firmware update.
+ */
+
+#include "OtaUpdater.h"
+
+#define OTA_UPDATER_SEPARATORS " \t"
+
+/**********************************************************************
+ * Create an updater for the running <build> and <version>. The
+ * strings are not copied and must remain valid for the lifetime of the
+ * updater.
+ */
+OtaUpdater::OtaUpdater(const char *build, const char *version) {
+  this->build = build;
+  this->version = version;
+  this->pending = false;
+  this->requestedAt = 0UL;
+  this->staggerDelay = 0UL;
+  this->availableVersion[0] = 0;
+  this->error[0] = 0;
+}
+
+/**********************************************************************
+ * Schedule an update at a random time within <window> milliseconds of
+ * <now>. A request made whilst another is pending keeps the original
+ * schedule.
+ */
+void OtaUpdater::request(unsigned long now, unsigned long window) {
+  if (this->pending) return;
+  this->pending = true;
+  this->requestedAt = now;
+  this->staggerDelay = (window)?(unsigned long) random(window):0UL;
+}
+
+bool OtaUpdater::isPending() {
+  return(this->pending);
+}
+
+bool OtaUpdater::isDue(unsigned long now) {
+  return((this->pending) && ((now - this->requestedAt) >= this->staggerDelay));
+}
+
+/**********************************************************************
+ * Fetch the manifest from <manifestUrl> and, if it offers a different
+ * version of this build, download and stage the image using <client>.
+ * Returns OTA_UPDATER_UPDATED if a new image is ready (and the module
+ * should be restarted), OTA_UPDATER_CURRENT if there is nothing to do
+ * or OTA_UPDATER_FAILED (see getError()).
+ */
+uint8_t OtaUpdater::run(WiFiClient &client, const char *manifestUrl) {
+  char manifest[OTA_UPDATER_MANIFEST_SIZE];
+  const char *image;
+
+  this->pending = false;
+  this->availableVersion[0] = 0;
+  this->error[0] = 0;
+  if (!this->readManifest(client, manifestUrl, manifest, sizeof(manifest))) return(OTA_UPDATER_FAILED);
+  if (!(image = this->findImage(manifest))) {
+    strcpy(this->error, "build not in manifest");
+    return(OTA_UPDATER_FAILED);
+  }
+  if (!strcmp(this->availableVersion, this->version)) return(OTA_UPDATER_CURRENT);
+
+  ESPhttpUpdate.rebootOnUpdate(false);
+  switch (ESPhttpUpdate.update(client, image, this->version)) {
+    case HTTP_UPDATE_OK:
+      return(OTA_UPDATER_UPDATED);
+    case HTTP_UPDATE_NO_UPDATES:
+      return(OTA_UPDATER_CURRENT);
+    default:
+      snprintf(this->error, sizeof(this->error), "%s", ESPhttpUpdate.getLastErrorString().c_str());
+      return(OTA_UPDATER_FAILED);
+  }
+}
+
+const char *OtaUpdater::getVersion() {
+  return(this->version);
+}
+
+/**********************************************************************
+ * Returns the version offered by the manifest read by the most recent
+ * run(), or an empty string.
+ */
+const char *OtaUpdater::getAvailableVersion() {
+  return(this->availableVersion);
+}
+
+/**********************************************************************
+ * Returns the reason for the failure of the most recent run(), or an
+ * empty string.
+ */
+const char *OtaUpdater::getError() {
+  return(this->error);
+}
+
+/**********************************************************************
+ * Read up to <size> - 1 bytes of the manifest at <url> into <manifest>
+ * as a string. HTTP/1.0 is used so that the response cannot be chunked.
+ */
+bool OtaUpdater::readManifest(WiFiClient &client, const char *url, char *manifest, size_t size) {
+  HTTPClient http;
+  size_t length = 0;
+  int code;
+
+  if (!http.begin(client, url)) {
+    strcpy(this->error, "bad manifest url");
+    return(false);
+  }
+  http.useHTTP10(true);
+  http.setTimeout(OTA_UPDATER_TIMEOUT);
+  if ((code = http.GET()) == HTTP_CODE_OK) {
+    WiFiClient *stream = http.getStreamPtr();
+
+    stream->setTimeout(OTA_UPDATER_TIMEOUT);
+    length = stream->readBytes(manifest, size - 1);
+  } else {
+    snprintf(this->error, sizeof(this->error), "manifest: %d", code);
+  }
+  manifest[length] = 0;
+  http.end();
+  return(code == HTTP_CODE_OK);
+}
+
+/**********************************************************************
+ * Find the line of <manifest> for our build, tokenising it in place,
+ * and note its version. Returns its image URL or NULL if there isn't
+ * one.
+ */
+const char *OtaUpdater::findImage(char *manifest) {
+  char *context, *line, *build, *version, *image, *lineContext;
+
+  for (line = strtok_r(manifest, "\r\n", &context); line; line = strtok_r(NULL, "\r\n", &context)) {
+    if (!(build = strtok_r(line, OTA_UPDATER_SEPARATORS, &lineContext)) || (build[0] == '#')) continue;
+    if ((strcmp(build, this->build)) && (strcmp(build, "*"))) continue;
+    version = strtok_r(NULL, OTA_UPDATER_SEPARATORS, &lineContext);
+    image = strtok_r(NULL, OTA_UPDATER_SEPARATORS, &lineContext);
+    if ((!version) || (!image) || (strlen(version) >= OTA_UPDATER_VERSION_SIZE)) continue;
+    strcpy(this->availableVersion, version);
+    return(image);
+  }
+  return(NULL);
+}
@@ -0,0 +1,71 @@
+/**********************************************************************
+ * NAME
+ *   OtaUpdater.h - manifest driven over-the-air firmware update.
+ * DESCRIPTION
+ *   Updates the firmware over HTTP from an image named in a manifest,
+ *   but only if the manifest offers a different version from the one
+ *   running, so that an up to date node costs the network nothing more
+ *   than the manifest itself.
+ *
+ *   The manifest is a short text file with one line per build of the
+ *   form:
+ *
+ *     <build> <version> <image url>
+ *
+ *   where <build> is the name of a build environment (or "*" to match
+ *   any). Blank lines and lines starting with '#' are ignored, and the
+ *   first line matching the running build is used.
+ *
+ *   Images may be gzip compressed (by, for example, 'gzip -9
+ *   firmware.bin'). The ESP8266 Updater recognises a compressed image
+ *   and stores it as it is, and the boot loader inflates it when it is
+ *   installed, so a compressed image costs both less download (and
+ *   radio) time and less free flash.
+ *
+ *   A fleet told to update at the same moment would all download at
+ *   once, so request() schedules the update after a random delay of up
+ *   to the given stagger window; isDue() says when it should be run.
+ *   run() blocks for the duration of any download.
+ */
+
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+#include <ESP8266httpUpdate.h>
+
+#define OTA_UPDATER_MANIFEST_SIZE 512     // Bytes of manifest read
+#define OTA_UPDATER_VERSION_SIZE 24
+#define OTA_UPDATER_TIMEOUT 10000         // Milliseconds
+
+#define OTA_UPDATER_CURRENT 0             // run() results
+#define OTA_UPDATER_UPDATED 1             // Restart to complete
+#define OTA_UPDATER_FAILED 2
+
+class OtaUpdater {
+  public:
+    OtaUpdater(const char *build, const char *version);
+    void request(unsigned long now, unsigned long window);
+    bool isPending();
+    bool isDue(unsigned long now);
+    uint8_t run(WiFiClient &client, const char *manifestUrl);
+    const char *getVersion();
+    const char *getAvailableVersion();
+    const char *getError();
+
+  private:
+    bool readManifest(WiFiClient &client, const char *url, char *manifest, size_t size);
+    const char *findImage(char *manifest);
+
+    const char *build;
+    const char *version;
+    bool pending;
+    unsigned long requestedAt;
+    unsigned long staggerDelay;
+    char availableVersion[OTA_UPDATER_VERSION_SIZE];
+    char error[48];
+};
+
+#endif
@@ -0,0 +1,167 @@
+/**********************************************************************
+ * Pipeline.cpp - carry sensor readings through to publication.
+ */
+
+#include "Pipeline.h"
+
+Pipeline::Pipeline(SensorSet &sensors, PublishPolicy &policy, SampleBatch &batch, SampleRollup &rollup, SampleStore &store, const SAMPLE_NAMES &names, PipelineSink &sink) :
+  sensors(sensors), policy(policy), batch(batch), rollup(rollup), store(store), names(names), sink(sink) {
+  memset(&this->config, 0, sizeof(this->config));
+  this->sampleInterval = policy.getSoftInterval();
+}
+
+/**********************************************************************
+ * Put <config> into effect at time <now>. Every setting may be
+ * changed whilst running, although only the policy, sampling and
+ * rollup settings should be: the caller must give the new sample
+ * interval (see getSampleInterval()) to its sample task.
+ */
+void Pipeline::configure(const PIPELINE_CONFIG &config, unsigned long now) {
+  this->config = config;
+  this->policy.setIntervals(config.softInterval, config.hardInterval);
+  this->policy.setImmediate(config.immediateChannels);
+  this->sampleInterval = (config.sampleInterval > 0)?config.sampleInterval:this->policy.getSoftInterval();
+  // Rollup state does not survive deep sleep.
+  this->rollup.configure((config.sleepInterval == 0)?config.rollupWindow:0, now);
+}
+
+const PIPELINE_CONFIG &Pipeline::getConfig() {
+  return(this->config);
+}
+
+unsigned long Pipeline::getSampleInterval() {
+  return(this->sampleInterval);
+}
+
+/**********************************************************************
+ * In sleep mode there is no point in publishing before we connect, so
+ * publication waits (for no longer than the cycle timeout) for the
+ * connection.
+ */
+bool Pipeline::canPublish(unsigned long now, bool connected) {
+  return((this->config.sleepInterval == 0) || (connected) || (now >= this->config.cycleTimeout));
+}
+
+/**********************************************************************
+ * Add the most recent reading to the rollup and ask every sensor for
+ * a new one.
+ */
+void Pipeline::sample() {
+  SAMPLE sample;
+
+  if ((this->rollup.isEnabled()) && (this->sensors.isReady())) {
+    this->sensors.encode(sample);
+    this->rollup.add(sample, this->names);
+  }
+  this->sensors.startSample();
+}
+
+/**********************************************************************
+ * Move the acquisition of the sensor whose index is <index> along.
+ * When a new reading arrives the policy is told if (and in which kinds
+ * of channel) the state now differs from the reference. A driver
+ * whose probes have been renumbered counts as changed.
+ */
+void Pipeline::poll(uint8_t index) {
+  SAMPLE sample, reference;
+  uint8_t status = this->sensors.poll(index);
+  uint8_t changes;
+
+  if (status & SENSOR_RENUMBERED) this->policy.notifyChange();
+  if ((status & SENSOR_UPDATED) && (this->sensors.isReady())) {
+    this->sensors.encode(sample);
+    this->rollup.track(sample, this->names);
+    if (!this->sink.getReference(reference)) {
+      this->policy.notifyChange();
+    } else if ((changes = this->sensors.getChanges(sample, reference))) {
+      this->policy.notifyChange(changes);
+    }
+  }
+}
+
+/**********************************************************************
+ * Publish (or queue) the state at time <now> if the policy says so
+ * and the batch if it is ready. Nothing is published until every
+ * sensor has delivered its first reading. <connected> says whether or
+ * not the caller's connection is up.
+ */
+void Pipeline::publish(unsigned long now, bool connected) {
+  if ((this->sensors.isReady()) && (this->policy.isDue(now)) && ((this->batch.isEnabled()) || (this->canPublish(now, connected)))) this->publishStatus();
+  if ((this->batch.isDue(now)) && (this->canPublish(now, connected))) this->publishBatch();
+}
+
+/**********************************************************************
+ * Publish the current state. If we are not connected, or the
+ * publication fails, then the state is queued for later forwarding.
+ * In batch mode the state is simply added to the current batch.
+ */
+void Pipeline::publishStatus() {
+  bool published = false;
+  SAMPLE sample;
+  size_t encoded;
+
+  this->sensors.encode(sample);
+  if (this->batch.isEnabled()) {
+    this->batch.add(sample);
+    published = true;
+  } else if ((this->sink.isConnected()) && (this->config.reliable) && (!this->config.channelTopics)) {
+    published = this->sink.publishReliable(PIPELINE_STATUS, &sample, 1, encoded);
+  } else if (this->sink.isConnected()) {
+    published = true;
+    if (this->config.payloadFormat != PIPELINE_PAYLOAD_BINARY) {
+      // Without a pending change this is a heartbeat, which in channel
+      // topic mode refreshes every channel.
+      published = (this->config.channelTopics)?this->sink.publishChannels(sample, !this->policy.isPending()):this->sink.publishJson(PIPELINE_STATUS, &sample, 1);
+    }
+    if ((published) && (this->config.payloadFormat != PIPELINE_PAYLOAD_JSON)) {
+      published = this->sink.publishBinary(PIPELINE_STATUS, &sample, 1, encoded);
+    }
+    if (published) this->sink.published(&sample, 1);
+  }
+
+  if (!published) this->store.push(sample);
+  this->sink.setReference(sample);
+  this->policy.published(millis());
+  this->sensors.published();
+}
+
+/**********************************************************************
+ * Publish the accumulated batch or, if that isn't possible, queue its
+ * samples for later forwarding.
+ */
+void Pipeline::publishBatch() {
+  const SAMPLE *samples = this->batch.getSamples();
+  size_t count = this->batch.getCount();
+  size_t offset = 0;
+  size_t encoded;
+
+  while ((offset < count) && (this->sink.isConnected())) {
+    if (!this->publishSamples(PIPELINE_BATCH, samples + offset, count - offset, encoded)) break;
+    offset += encoded;
+  }
+  while (offset < count) this->store.push(samples[offset++]);
+  this->batch.clear();
+}
+
+/**********************************************************************
+ * Publish the <count> <samples> as a message of <kind>: a JSON array
+ * and/or as many of them as will fit in a single binary frame,
+ * depending upon the payload format, or at QoS 1 in reliable delivery
+ * mode. The number of samples encoded is returned in <encoded>.
+ * Returns true if everything was published.
+ */
+bool Pipeline::publishSamples(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) {
+  bool published = true;
+
+  if (this->config.reliable) return(this->sink.publishReliable(kind, samples, count, encoded));
+  encoded = count;
+  if (this->config.payloadFormat != PIPELINE_PAYLOAD_BINARY) {
+    published = ((count > 0) && (this->sink.publishJson(kind, samples, count)));
+    if (!published) encoded = 0;
+  }
+  if ((published) && (this->config.payloadFormat != PIPELINE_PAYLOAD_JSON)) {
+    published = this->sink.publishBinary(kind, samples, encoded, encoded);
+  }
+  if (published) this->sink.published(samples, encoded);
+  return(published);
+}
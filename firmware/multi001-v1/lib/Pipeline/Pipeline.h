@@ -0,0 +1,121 @@
+/**********************************************************************
+ * NAME
+ *   Pipeline.h - carry sensor readings through to publication.
+ * DESCRIPTION
+ *   A Pipeline joins a SensorSet to a PublishPolicy and decides, for
+ *   each reading, whether and how it is published. Its work is done
+ *   from three Scheduler tasks of the caller's:
+ *
+ *   sample()       Once every sample interval: add the last reading
+ *                  to the SampleRollup and ask every sensor for a new
+ *                  one.
+ *   poll()         For each sensor, on every pass: move its
+ *                  acquisition along and tell the policy if (and in
+ *                  which kinds of channel) the state now differs from
+ *                  the reference (the state most recently published).
+ *   publish()      On every pass: publish the state whenever the
+ *                  policy says so, and any SampleBatch which is due.
+ *
+ *   The state is added to the batch in batch mode, published at QoS 1
+ *   in reliable delivery mode (unless every channel has a topic of its
+ *   own) and otherwise published in the configured payload format or
+ *   channel by channel. Anything which cannot be published goes to the
+ *   SampleStore for later forwarding. In sleep mode publication waits,
+ *   for no longer than the cycle timeout, for a connection.
+ *
+ *   The messages themselves are sent by a PipelineSink, which also
+ *   holds the reference:
+ *
+ *   isConnected()      True if messages can be sent.
+ *   publishJson()      Publish samples of a PIPELINE_ kind as JSON: a
+ *                      (retained) object for the status, otherwise an
+ *                      array.
+ *   publishBinary()    Publish as many samples as fit in one binary
+ *                      frame, returning the number in <encoded>.
+ *   publishChannels()  Publish each channel of the status to a topic
+ *                      of its own, either all of them or only those
+ *                      which have changed.
+ *   publishReliable()  Publish samples at QoS 1, returning false only
+ *                      if there is no room for them in flight.
+ *   published()        Told of samples which have been published.
+ *   getReference()     Fetch the reference, returning false if there
+ *   setReference()     is none, and replace it.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+#include <Sample.h>
+#include <SensorSet.h>
+#include <PublishPolicy.h>
+#include <SampleBatch.h>
+#include <SampleRollup.h>
+#include <SampleStore.h>
+
+#define PIPELINE_STATUS 0                 // Message kinds
+#define PIPELINE_BATCH 1
+#define PIPELINE_BACKLOG 2
+
+#define PIPELINE_PAYLOAD_JSON 0           // Payload formats
+#define PIPELINE_PAYLOAD_JSON_AND_BINARY 1
+#define PIPELINE_PAYLOAD_BINARY 2
+
+/**********************************************************************
+ * Settings which have already been checked against their ranges by
+ * the caller. A sampleInterval of zero samples once every soft
+ * interval and a rollupWindow of zero disables the rollup, as does
+ * sleep mode (a non-zero sleepInterval).
+ */
+struct PIPELINE_CONFIG {
+  unsigned long softInterval;
+  unsigned long hardInterval;
+  unsigned long sampleInterval;
+  uint8_t immediateChannels;              // SAMPLE_CHANNEL_ bits
+  unsigned long rollupWindow;
+  unsigned long sleepInterval;
+  unsigned long cycleTimeout;             // Maximum milliseconds awake per wake
+  bool channelTopics;
+  bool reliable;
+  uint8_t payloadFormat;                  // One of the PIPELINE_PAYLOAD_ values
+};
+
+class PipelineSink {
+  public:
+    virtual bool isConnected() = 0;
+    virtual bool publishJson(uint8_t kind, const SAMPLE *samples, size_t count) = 0;
+    virtual bool publishBinary(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) = 0;
+    virtual bool publishChannels(const SAMPLE &sample, bool all) = 0;
+    virtual bool publishReliable(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) = 0;
+    virtual void published(const SAMPLE *samples, size_t count) { }
+    virtual bool getReference(SAMPLE &reference) = 0;
+    virtual void setReference(const SAMPLE &reference) = 0;
+};
+
+class Pipeline {
+  public:
+    Pipeline(SensorSet &sensors, PublishPolicy &policy, SampleBatch &batch, SampleRollup &rollup, SampleStore &store, const SAMPLE_NAMES &names, PipelineSink &sink);
+    void configure(const PIPELINE_CONFIG &config, unsigned long now);
+    const PIPELINE_CONFIG &getConfig();
+    unsigned long getSampleInterval();
+    bool canPublish(unsigned long now, bool connected);
+    void sample();
+    void poll(uint8_t index);
+    void publish(unsigned long now, bool connected);
+    void publishStatus();
+    void publishBatch();
+    bool publishSamples(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded);
+
+  private:
+    SensorSet &sensors;
+    PublishPolicy &policy;
+    SampleBatch &batch;
+    SampleRollup &rollup;
+    SampleStore &store;
+    const SAMPLE_NAMES &names;
+    PipelineSink &sink;
+    PIPELINE_CONFIG config;
+    unsigned long sampleInterval;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/**********************************************************************
+ * Profiler.cpp - cycle counter profiling of named code sections.
+ */
+
+#include "Profiler.h"
+
+Profiler::SECTION Profiler::sections[PROFILER_MAX_SECTIONS];
+uint8_t Profiler::count = 0;
+
+/**********************************************************************
+ * Returns the slot of the section called <name>, claiming a new one if
+ * need be, or -1 if every slot is taken.
+ */
+int8_t Profiler::getSection(const char *name) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (!strcmp(sections[i].name, name)) return(i);
+  }
+  if (count == PROFILER_MAX_SECTIONS) return(-1);
+  sections[count].name = name;
+  sections[count].calls = 0UL;
+  sections[count].min = 0UL;
+  sections[count].max = 0UL;
+  sections[count].total = 0ULL;
+  return(count++);
+}
+
+void Profiler::record(int8_t section, uint32_t cycles) {
+  if ((section < 0) || (section >= count)) return;
+  SECTION &s = sections[section];
+  if ((s.calls == 0) || (cycles < s.min)) s.min = cycles;
+  if (cycles > s.max) s.max = cycles;
+  s.total += cycles;
+  s.calls++;
+}
+
+/**********************************************************************
+ * Clear the statistics of every section, keeping their slots.
+ */
+void Profiler::reset() {
+  for (uint8_t i = 0; i < count; i++) {
+    sections[i].calls = 0UL;
+    sections[i].min = 0UL;
+    sections[i].max = 0UL;
+    sections[i].total = 0ULL;
+  }
+}
+
+uint8_t Profiler::getCount() {
+  return(count);
+}
+
+/**********************************************************************
+ * Write the statistics of every section into <buffer> as a JSON object
+ * (see Profiler.h). Returns the length of the generated string or zero
+ * if it would not fit in <size> bytes.
+ */
+size_t Profiler::toJson(char *buffer, size_t size) {
+  size_t length = 0;
+  int n;
+
+  if ((n = snprintf(buffer, size, "{ ")) < 0) return(0);
+  length += n;
+  for (uint8_t i = 0; i < count; i++) {
+    const SECTION &s = sections[i];
+
+    if (length >= size) return(0);
+    n = snprintf(buffer + length, size - length, "%s\"%s\": { \"calls\": %lu, \"min\": %lu, \"mean\": %lu, \"max\": %lu }", (i)?", ":"", s.name, (unsigned long) s.calls, (unsigned long) s.min, (unsigned long) ((s.calls)?(s.total / s.calls):0ULL), (unsigned long) s.max);
+    if (n < 0) return(0);
+    length += n;
+  }
+  if (length >= size) return(0);
+  if ((n = snprintf(buffer + length, size - length, " }")) < 0) return(0);
+  length += n;
+  return((length < size)?length:0);
+}
+
+/**********************************************************************
+ * Print the statistics of every section to <out>, one per line.
+ */
+void Profiler::dump(Print &out) {
+  for (uint8_t i = 0; i < count; i++) {
+    const SECTION &s = sections[i];
+
+    out.printf("%-20s %8lu calls, min %lu, mean %lu, max %lu cycles\n", s.name, (unsigned long) s.calls, (unsigned long) s.min, (unsigned long) ((s.calls)?(s.total / s.calls):0ULL), (unsigned long) s.max);
+  }
+}
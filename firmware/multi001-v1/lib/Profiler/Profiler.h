@@ -0,0 +1,77 @@
+/**********************************************************************
+ * NAME
+ *   Profiler.h - cycle counter profiling of named code sections.
+ * DESCRIPTION
+ *   PROFILE_SECTION(name) times the remainder of the enclosing block
+ *   with the CPU cycle counter (ESP.getCycleCount(), which counts 80
+ *   or 160 cycles per microsecond) and accumulates the number of
+ *   calls and the minimum, maximum and total cycle counts of each
+ *   distinct <name>, which must be a string literal, in one of
+ *   PROFILER_MAX_SECTIONS static slots. A section claims its slot the
+ *   first time it runs; any sections beyond the last slot go
+ *   unrecorded. The counter wraps after a little under a minute, so
+ *   no single section may take longer than that.
+ *
+ *   Unless PROFILER is defined (with -D PROFILER in the build flags,
+ *   so that libraries see it too) PROFILE_SECTION expands to nothing,
+ *   so instrumentation costs nothing when disabled.
+ *
+ *   toJson() renders the statistics, in cycles, in the form:
+ *
+ *     '{ "name": { "calls": n, "min": c, "mean": c, "max": c }, ... }'
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#define PROFILER_MAX_SECTIONS 12
+
+#ifdef PROFILER
+#define PROFILER_JOIN_(a, b) a##b
+#define PROFILER_JOIN(a, b) PROFILER_JOIN_(a, b)
+#define PROFILE_SECTION(name) \
+  static int8_t PROFILER_JOIN(profilerSection, __LINE__) = Profiler::getSection(name); \
+  ProfilerScope PROFILER_JOIN(profilerScope, __LINE__)(PROFILER_JOIN(profilerSection, __LINE__))
+#else
+#define PROFILE_SECTION(name)
+#endif
+
+class Profiler {
+  public:
+    static int8_t getSection(const char *name);
+    static void record(int8_t section, uint32_t cycles);
+    static void reset();
+    static uint8_t getCount();
+    static size_t toJson(char *buffer, size_t size);
+    static void dump(Print &out);
+
+  private:
+    struct SECTION {
+      const char *name;                   // Not copied
+      uint32_t calls;
+      uint32_t min;
+      uint32_t max;
+      uint64_t total;
+    };
+
+    static SECTION sections[PROFILER_MAX_SECTIONS];
+    static uint8_t count;
+};
+
+/**********************************************************************
+ * The timer behind PROFILE_SECTION. It is inline so that the only
+ * overhead is reading the counter twice and one call to record().
+ */
+class ProfilerScope {
+  public:
+    ProfilerScope(int8_t section) : section(section), start(ESP.getCycleCount()) {}
+    ~ProfilerScope() { Profiler::record(this->section, ESP.getCycleCount() - this->start); }
+
+  private:
+    int8_t section;
+    uint32_t start;
+};
+
+#endif
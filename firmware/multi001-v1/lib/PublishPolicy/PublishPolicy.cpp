@@ -0,0 +1,79 @@
+/**********************************************************************
+ * PublishPolicy.cpp - soft/hard publication interval engine.
+ */
+
+#include "PublishPolicy.h"
+
+PublishPolicy::PublishPolicy(unsigned long softInterval, unsigned long hardInterval) {
+  this->setIntervals(softInterval, hardInterval);
+  this->lastPublished = 0UL;
+  this->immediate = 0;
+  this->hasPublished = false;
+  this->changePending = false;
+  this->urgentPending = false;
+}
+
+/**********************************************************************
+ * Change the intervals in use. A hard interval shorter than the soft
+ * interval makes no sense and is raised to match it.
+ */
+void PublishPolicy::setIntervals(unsigned long softInterval, unsigned long hardInterval) {
+  this->softInterval = softInterval;
+  this->hardInterval = (hardInterval < softInterval)?softInterval:hardInterval;
+}
+
+unsigned long PublishPolicy::getSoftInterval() {
+  return(this->softInterval);
+}
+
+/**********************************************************************
+ * Set the change <classes> which are published without waiting for
+ * the soft interval (zero for none).
+ */
+void PublishPolicy::setImmediate(uint8_t classes) {
+  this->immediate = classes;
+}
+
+/**********************************************************************
+ * Record that something worth publishing has happened.
+ */
+void PublishPolicy::notifyChange() {
+  this->changePending = true;
+}
+
+/**********************************************************************
+ * Record that something worth publishing has happened in the change
+ * <classes>, any of which may be urgent.
+ */
+void PublishPolicy::notifyChange(uint8_t classes) {
+  this->changePending = true;
+  if (classes & this->immediate) this->urgentPending = true;
+}
+
+bool PublishPolicy::isPending() {
+  return(this->changePending);
+}
+
+/**********************************************************************
+ * Returns true if a publication should be made at time <now>: that
+ * is, if nothing has yet been published, if there is an urgent change,
+ * if there is a pending change and the soft interval has expired or
+ * if the hard interval has expired.
+ */
+bool PublishPolicy::isDue(unsigned long now) {
+  unsigned long elapsed = (now - this->lastPublished);
+
+  if ((!this->hasPublished) || (this->urgentPending)) return(true);
+  if (elapsed >= this->hardInterval) return(true);
+  return((this->changePending) && (elapsed >= this->softInterval));
+}
+
+/**********************************************************************
+ * Record that a publication was made at time <now>.
+ */
+void PublishPolicy::published(unsigned long now) {
+  this->lastPublished = now;
+  this->hasPublished = true;
+  this->changePending = false;
+  this->urgentPending = false;
+}
@@ -0,0 +1,59 @@
+/**********************************************************************
+ * NAME
+ *   PublishPolicy.h - soft/hard publication interval engine.
+ * DESCRIPTION
+ *   Decides when a node should publish its status. Three settings
+ *   govern the decision:
+ *
+ *   soft interval   The minimum time between successive publications.
+ *                   A change which occurs inside this hold-off period
+ *                   is published as soon as the period expires, with
+ *                   any other changes made in the meantime.
+ *
+ *   hard interval   The maximum time between successive publications.
+ *                   If nothing has changed for this long, then the
+ *                   status is re-published as a heartbeat.
+ *
+ *   immediate       A mask of change classes (the caller's own bits,
+ *                   such as SAMPLE_CHANNEL_ values) which are urgent.
+ *                   A change reported with any of these bits set is
+ *                   published at once, without waiting for the soft
+ *                   interval to expire.
+ *
+ *   The policy only decides when to publish: how often the sensors are
+ *   sampled is up to the caller, so that latency (sample rate and
+ *   immediate classes) and traffic (soft and hard intervals) can be
+ *   set independently.
+ *
+ *   All time arithmetic is done on differences, so the policy is
+ *   unaffected by millis() wrap-around.
+ */
+
+#ifndef PUBLISH_POLICY_H
+#define PUBLISH_POLICY_H
+
+#include <Arduino.h>
+
+class PublishPolicy {
+  public:
+    PublishPolicy(unsigned long softInterval, unsigned long hardInterval);
+    void setIntervals(unsigned long softInterval, unsigned long hardInterval);
+    unsigned long getSoftInterval();
+    void setImmediate(uint8_t classes);
+    void notifyChange();
+    void notifyChange(uint8_t classes);
+    bool isPending();
+    bool isDue(unsigned long now);
+    void published(unsigned long now);
+
+  private:
+    unsigned long softInterval;
+    unsigned long hardInterval;
+    unsigned long lastPublished;
+    uint8_t immediate;
+    bool hasPublished;
+    bool changePending;
+    bool urgentPending;
+};
+
+#endif
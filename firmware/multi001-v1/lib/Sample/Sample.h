@@ -0,0 +1,61 @@
+/**********************************************************************
+ * NAME
+ *   Sample.h - compact binary representation of a sensor snapshot.
+ * DESCRIPTION
+ *   A SAMPLE records the state of all of a node's sensors at a single
+ *   moment using fixed-point integers so that snapshots can be queued,
+ *   stored and encoded cheaply.
+ *
+ *   Flag bits say which channels are present in a sample: a channel
+ *   which is present but could not be read holds SAMPLE_INVALID_VALUE.
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <Arduino.h>
+
+#ifndef SAMPLE_MAX_PROBES
+#define SAMPLE_MAX_PROBES 20              // DS18B20 readings carried per sample
+#endif
+#define SAMPLE_MAX_SWITCHES 8
+
+#define SAMPLE_HAS_TEMPERATURE 0x01
+#define SAMPLE_HAS_HUMIDITY 0x02
+#define SAMPLE_HAS_LUX 0x04
+#define SAMPLE_HAS_MOTION 0x08
+#define SAMPLE_MOTION 0x10                // Motion detected
+#define SAMPLE_STALE 0x80                 // Timestamp is from an earlier boot
+
+#define SAMPLE_INVALID_VALUE -32768
+
+#define SAMPLE_CHANNEL_TEMPERATURE 0x01   // Channel classes, for reporting change
+#define SAMPLE_CHANNEL_HUMIDITY 0x02
+#define SAMPLE_CHANNEL_LUX 0x04
+#define SAMPLE_CHANNEL_MOTION 0x08
+#define SAMPLE_CHANNEL_SWITCHES 0x10
+#define SAMPLE_CHANNEL_PROBES 0x20
+#define SAMPLE_CHANNEL_ALL 0x3f
+
+struct SAMPLE {
+  uint32_t timestamp;                     // millis() when taken
+  uint8_t flags;                          // SAMPLE_HAS_... and SAMPLE_MOTION bits
+  uint8_t switchCount;                    // Number of switches reported
+  uint8_t switches;                       // Bit n is the state of switch n
+  uint8_t probeCount;                     // Number of entries in probes[]
+  int16_t temperature;                    // Hundredths of a degree Celsius
+  int16_t humidity;                       // Tenths of a percent
+  int16_t lux;                            // 0..1023
+  int16_t probes[SAMPLE_MAX_PROBES];      // Hundredths of a degree Celsius
+};
+
+/**********************************************************************
+ * Names used for the variably named channels when a sample is
+ * rendered as JSON.
+ */
+struct SAMPLE_NAMES {
+  const char *switches[SAMPLE_MAX_SWITCHES];
+  const char *probes[SAMPLE_MAX_PROBES];
+};
+
+#endif
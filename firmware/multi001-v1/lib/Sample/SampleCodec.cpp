@@ -0,0 +1,237 @@
+/**********************************************************************
+ * SampleCodec.cpp - render SAMPLEs for publication.
+ */
+
+#include "SampleCodec.h"
+
+/**********************************************************************
+ * Stream <sample> to <out> as a JSON object or, if <out> is NULL, just
+ * measure it. If <age> is not negative it is the number of
+ * milliseconds since the sample was taken and is included as the
+ * "age" property. Returns the number of bytes written (or
+ * which would be written) or zero if writing failed.
+ */
+size_t SampleCodec::toJson(Print *out, const SAMPLE &sample, const SAMPLE_NAMES &names, long age) {
+  WRITER writer = { NULL, 0, out, 0, false, true };
+
+  writeJson(writer, sample, names, age);
+  return((writer.overflow)?0:writer.length);
+}
+
+/**********************************************************************
+ * Stream all <count> <samples> to <out> as a JSON array of objects,
+ * each with an "age" property computed relative to <now> (or no age if
+ * the sample is SAMPLE_STALE), or if <out> is NULL just measure them.
+ * Returns the number of bytes written (or which would be written) or
+ * zero if writing failed.
+ */
+size_t SampleCodec::toJsonArray(Print *out, const SAMPLE *samples, size_t count, const SAMPLE_NAMES &names, unsigned long now) {
+  WRITER writer = { NULL, 0, out, 0, false, true };
+
+  appendText(writer, "[ ");
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) appendText(writer, ", ");
+    writer.first = true;
+    writeJson(writer, samples[i], names, (samples[i].flags & SAMPLE_STALE)?-1L:(long) (now - samples[i].timestamp));
+  }
+  appendText(writer, " ]");
+  return((writer.overflow)?0:writer.length);
+}
+
+/**********************************************************************
+ * Write the JSON object representing <sample> to <writer>.
+ */
+void SampleCodec::writeJson(WRITER &writer, const SAMPLE &sample, const SAMPLE_NAMES &names, long age) {
+  SAMPLE_CHANNEL_VALUE channel;
+
+  appendText(writer, "{ ");
+  if (age >= 0) appendFixed(writer, "age", age, 0);
+  for (uint8_t i = 0; i < SAMPLE_CODEC_CHANNELS; i++) {
+    if (getChannel(sample, names, i, channel)) appendFixed(writer, channel.name, channel.value, channel.decimals);
+  }
+  appendText(writer, " }");
+}
+
+/**********************************************************************
+ * Get the name and value of channel <index> of <sample> into
+ * <channel>. Returns false if the sample does not have that channel.
+ */
+bool SampleCodec::getChannel(const SAMPLE &sample, const SAMPLE_NAMES &names, uint8_t index, SAMPLE_CHANNEL_VALUE &channel) {
+  channel.decimals = 0;
+  switch (index) {
+    case 0:
+      if (!(sample.flags & SAMPLE_HAS_TEMPERATURE)) return(false);
+      channel.name = "temperature";
+      channel.value = sample.temperature;
+      channel.decimals = 2;
+      return(true);
+    case 1:
+      if (!(sample.flags & SAMPLE_HAS_HUMIDITY)) return(false);
+      channel.name = "humidity";
+      channel.value = sample.humidity;
+      channel.decimals = 1;
+      return(true);
+    case 2:
+      if (!(sample.flags & SAMPLE_HAS_LUX)) return(false);
+      channel.name = "lux";
+      channel.value = sample.lux;
+      return(true);
+    case SAMPLE_CODEC_MOTION_CHANNEL:
+      if (!(sample.flags & SAMPLE_HAS_MOTION)) return(false);
+      channel.name = "motion";
+      channel.value = (sample.flags & SAMPLE_MOTION)?1:0;
+      return(true);
+    default:
+      break;
+  }
+  if (index < SAMPLE_CODEC_PROBE_CHANNEL) {
+    index -= SAMPLE_CODEC_SWITCH_CHANNEL;
+    if (index >= sample.switchCount) return(false);
+    channel.name = names.switches[index];
+    channel.value = ((sample.switches >> index) & 1);
+    return(true);
+  }
+  if (index < SAMPLE_CODEC_CHANNELS) {
+    index -= SAMPLE_CODEC_PROBE_CHANNEL;
+    if (index >= sample.probeCount) return(false);
+    channel.name = names.probes[index];
+    channel.value = sample.probes[index];
+    channel.decimals = 2;
+    return(true);
+  }
+  return(false);
+}
+
+/**********************************************************************
+ * Write the value of <channel> into <buffer> as it would appear in
+ * JSON. Returns the length of the generated string or zero if it would
+ * not fit in <size> bytes.
+ */
+size_t SampleCodec::toText(char *buffer, size_t size, const SAMPLE_CHANNEL_VALUE &channel) {
+  WRITER writer = { buffer, size, NULL, 0, false, true };
+
+  if (size == 0) return(0);
+  buffer[0] = 0;
+  appendValue(writer, channel.value, channel.decimals);
+  return((writer.overflow)?0:writer.length);
+}
+
+/**********************************************************************
+ * Write as many of the <count> <samples> as will fit in <buffer> as a
+ * binary frame (see SampleCodec.h), with ages computed relative to
+ * <now>. The number of samples actually written is returned in
+ * <encoded> and the function returns the length of the frame.
+ */
+size_t SampleCodec::toBinary(uint8_t *buffer, size_t size, const SAMPLE *samples, size_t count, unsigned long now, size_t &encoded) {
+  uint8_t *p = buffer + SAMPLE_BINARY_HEADER_SIZE;
+
+  encoded = 0;
+  if (size < SAMPLE_BINARY_HEADER_SIZE) return(0);
+  for (size_t i = 0; (i < count) && (i < 255); i++) {
+    const SAMPLE &sample = samples[i];
+    uint8_t switchCount = (sample.switchCount < SAMPLE_MAX_SWITCHES)?sample.switchCount:SAMPLE_MAX_SWITCHES;
+    uint8_t probeCount = (sample.probeCount < SAMPLE_MAX_PROBES)?sample.probeCount:SAMPLE_MAX_PROBES;
+
+    if ((size_t) ((p - buffer) + binaryRecordSize(sample)) > size) break;
+    *p++ = sample.flags;
+    *p++ = switchCount;
+    *p++ = probeCount;
+    *p++ = sample.switches;
+    p = put32(p, (sample.flags & SAMPLE_STALE)?0xffffffffUL:(uint32_t) (now - sample.timestamp));
+    if (sample.flags & SAMPLE_HAS_TEMPERATURE) p = put16(p, sample.temperature);
+    if (sample.flags & SAMPLE_HAS_HUMIDITY) p = put16(p, sample.humidity);
+    if (sample.flags & SAMPLE_HAS_LUX) p = put16(p, sample.lux);
+    for (uint8_t j = 0; j < probeCount; j++) p = put16(p, sample.probes[j]);
+    encoded++;
+  }
+  buffer[0] = SAMPLE_BINARY_VERSION;
+  buffer[1] = encoded;
+  return(p - buffer);
+}
+
+/**********************************************************************
+ * Append <text> to <writer>'s buffer or stream (or, if it has neither,
+ * just count it), setting its overflow flag if the text (and, in a
+ * buffer, its terminator) will not fit or cannot be written.
+ */
+void SampleCodec::appendText(WRITER &writer, const char *text) {
+  size_t length = strlen(text);
+
+  if (writer.overflow) return;
+  if (writer.out) {
+    if (writer.out->write((const uint8_t*) text, length) != length) writer.overflow = true;
+  } else if (writer.buffer) {
+    if ((writer.length + length) >= writer.size) writer.overflow = true; else memcpy(writer.buffer + writer.length, text, length + 1);
+  }
+  if (!writer.overflow) writer.length += length;
+}
+
+/**********************************************************************
+ * Append the decimal representation of the fixed-point <value>, which
+ * has <decimals> implied decimal places, to <writer>'s buffer. This
+ * hand-written formatter keeps printf (and floating point) out of the
+ * publication path.
+ */
+void SampleCodec::appendNumber(WRITER &writer, long value, uint8_t decimals) {
+  char digits[24];
+  char text[sizeof(digits) + 1];
+  unsigned long magnitude = (value < 0)?(0UL - (unsigned long) value):(unsigned long) value;
+  uint8_t n = 0, i = 0;
+
+  do {
+    if ((n == decimals) && (n > 0)) digits[n++] = '.';
+    digits[n++] = ('0' + (magnitude % 10));
+    magnitude /= 10;
+  } while (((magnitude > 0) || (n <= decimals)) && (n < (sizeof(digits) - 2)));
+  if (value < 0) digits[n++] = '-';
+  while (n) text[i++] = digits[--n];
+  text[i] = 0;
+  appendText(writer, text);
+}
+
+/**********************************************************************
+ * Append a property called <name> whose <value> is fixed-point with
+ * <decimals> implied decimal places, writing SAMPLE_INVALID_VALUE as
+ * SAMPLE_CODEC_UNDEFINED_VALUE.
+ */
+void SampleCodec::appendFixed(WRITER &writer, const char *name, long value, uint8_t decimals) {
+  if (!writer.first) appendText(writer, ", ");
+  writer.first = false;
+  appendText(writer, "\"");
+  appendText(writer, name);
+  appendText(writer, "\": ");
+  appendValue(writer, value, decimals);
+}
+
+/**********************************************************************
+ * Append the fixed-point <value>, writing SAMPLE_INVALID_VALUE as
+ * SAMPLE_CODEC_UNDEFINED_VALUE.
+ */
+void SampleCodec::appendValue(WRITER &writer, long value, uint8_t decimals) {
+  if (value == SAMPLE_INVALID_VALUE) {
+    appendNumber(writer, SAMPLE_CODEC_UNDEFINED_VALUE, 0);
+  } else {
+    appendNumber(writer, value, decimals);
+  }
+}
+
+size_t SampleCodec::binaryRecordSize(const SAMPLE &sample) {
+  size_t size = 8;
+
+  if (sample.flags & SAMPLE_HAS_TEMPERATURE) size += 2;
+  if (sample.flags & SAMPLE_HAS_HUMIDITY) size += 2;
+  if (sample.flags & SAMPLE_HAS_LUX) size += 2;
+  size += (2 * ((sample.probeCount < SAMPLE_MAX_PROBES)?sample.probeCount:SAMPLE_MAX_PROBES));
+  return(size);
+}
+
+uint8_t *SampleCodec::put16(uint8_t *p, uint16_t value) {
+  *p++ = (value & 0xff);
+  *p++ = (value >> 8);
+  return(p);
+}
+
+uint8_t *SampleCodec::put32(uint8_t *p, uint32_t value) {
+  p = put16(p, (value & 0xffff));
+  return(put16(p, (value >> 16)));
+}
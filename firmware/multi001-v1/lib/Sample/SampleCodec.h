@@ -0,0 +1,89 @@
+/**********************************************************************
+ * NAME
+ *   SampleCodec.h - render SAMPLEs for publication.
+ * DESCRIPTION
+ *   Integer only encoders which render a SAMPLE, or a series of them,
+ *   as JSON or as a compact binary frame.
+ *
+ *   The JSON encoders write fixed-point channels with their implied
+ *   decimal places and invalid channels as
+ *   SAMPLE_CODEC_UNDEFINED_VALUE. They stream straight to a Print
+ *   (such as an MQTT client between beginPublish() and endPublish()).
+ *   Given a NULL Print they simply measure their output, so a message
+ *   can be streamed without ever being held in RAM.
+ *
+ *   Each property of a JSON object is one of the sample's channels.
+ *   getChannel() exposes the same channels one at a time (by an index
+ *   of less than SAMPLE_CODEC_CHANNELS: temperature, humidity, lux,
+ *   motion, then each switch and each probe) and toText() renders a
+ *   single channel value exactly as it appears in JSON, so that
+ *   channels can also be published individually.
+ *
+ *   The binary encoder writes a frame consisting of a version byte
+ *   (SAMPLE_BINARY_VERSION) and a record count byte followed by that
+ *   number of little-endian records of the form:
+ *
+ *   SIZE  CONTENT
+ *   1     Flags (SAMPLE_HAS_..., SAMPLE_MOTION and SAMPLE_STALE bits)
+ *   1     Switch count
+ *   1     Probe count
+ *   1     Switch states (bit n is switch n)
+ *   4     Age in milliseconds (0xFFFFFFFF if unknown)
+ *   2     Temperature (int16 hundredths of a degree) if flagged
+ *   2     Humidity (int16 tenths of a percent) if flagged
+ *   2     Lux (int16) if flagged
+ *   2     Each probe temperature (int16 hundredths of a degree)
+ *
+ *   Invalid values are sent as SAMPLE_INVALID_VALUE.
+ */
+
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <Sample.h>
+
+#define SAMPLE_CODEC_UNDEFINED_VALUE 999
+#define SAMPLE_BINARY_VERSION 2
+#define SAMPLE_BINARY_HEADER_SIZE 2
+#define SAMPLE_BINARY_RECORD_MAX (14 + (2 * SAMPLE_MAX_PROBES))
+#define SAMPLE_CODEC_MOTION_CHANNEL 3     // Index of the motion channel
+#define SAMPLE_CODEC_SWITCH_CHANNEL 4     // Index of the first switch channel
+#define SAMPLE_CODEC_PROBE_CHANNEL (SAMPLE_CODEC_SWITCH_CHANNEL + SAMPLE_MAX_SWITCHES)
+#define SAMPLE_CODEC_CHANNELS (SAMPLE_CODEC_PROBE_CHANNEL + SAMPLE_MAX_PROBES)
+#define SAMPLE_CODEC_TEXT_SIZE 16         // Enough for any channel value
+
+struct SAMPLE_CHANNEL_VALUE {
+  const char *name;                       // Property name
+  long value;                             // Fixed-point value (or SAMPLE_INVALID_VALUE)
+  uint8_t decimals;                       // Implied decimal places
+};
+
+class SampleCodec {
+  public:
+    static size_t toJson(Print *out, const SAMPLE &sample, const SAMPLE_NAMES &names, long age);
+    static size_t toJsonArray(Print *out, const SAMPLE *samples, size_t count, const SAMPLE_NAMES &names, unsigned long now);
+    static size_t toBinary(uint8_t *buffer, size_t size, const SAMPLE *samples, size_t count, unsigned long now, size_t &encoded);
+    static bool getChannel(const SAMPLE &sample, const SAMPLE_NAMES &names, uint8_t index, SAMPLE_CHANNEL_VALUE &channel);
+    static size_t toText(char *buffer, size_t size, const SAMPLE_CHANNEL_VALUE &channel);
+
+  private:
+    struct WRITER {
+      char *buffer;                       // Output buffer, or
+      size_t size;
+      Print *out;                         // output stream, or neither to measure
+      size_t length;
+      bool overflow;
+      bool first;                         // No property written yet
+    };
+
+    static void writeJson(WRITER &writer, const SAMPLE &sample, const SAMPLE_NAMES &names, long age);
+    static void appendText(WRITER &writer, const char *text);
+    static void appendNumber(WRITER &writer, long value, uint8_t decimals);
+    static void appendFixed(WRITER &writer, const char *name, long value, uint8_t decimals);
+    static void appendValue(WRITER &writer, long value, uint8_t decimals);
+    static size_t binaryRecordSize(const SAMPLE &sample);
+    static uint8_t *put16(uint8_t *p, uint16_t value);
+    static uint8_t *put32(uint8_t *p, uint32_t value);
+};
+
+#endif
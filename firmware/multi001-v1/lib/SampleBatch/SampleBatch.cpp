@@ -0,0 +1,64 @@
+/**********************************************************************
+ * SampleBatch.cpp - accumulate SAMPLEs for publication as a batch.
+ */
+
+#include "SampleBatch.h"
+
+SampleBatch::SampleBatch() {
+  this->size = 0;
+  this->window = 0UL;
+  this->count = 0;
+  this->firstAdded = 0UL;
+}
+
+/**********************************************************************
+ * Set the batch <size> (in samples) and latency bound <window> (in
+ * milliseconds). A size of less than two disables batching and a
+ * window of zero means that only the size limit applies. Sizes above
+ * SAMPLE_BATCH_MAX are reduced to that limit.
+ */
+void SampleBatch::configure(unsigned int size, unsigned long window) {
+  this->size = (size < 2)?0:((size > SAMPLE_BATCH_MAX)?SAMPLE_BATCH_MAX:size);
+  this->window = window;
+}
+
+bool SampleBatch::isEnabled() {
+  return(this->size != 0);
+}
+
+/**********************************************************************
+ * Add <sample> to the batch. If the batch is somehow already full the
+ * oldest sample is overwritten, so the caller should publish whenever
+ * isDue() says so.
+ */
+void SampleBatch::add(const SAMPLE &sample) {
+  if (this->count == 0) this->firstAdded = sample.timestamp;
+  if (this->count < SAMPLE_BATCH_MAX) {
+    this->samples[this->count++] = sample;
+  } else {
+    memmove(&this->samples[0], &this->samples[1], (SAMPLE_BATCH_MAX - 1) * sizeof(SAMPLE));
+    this->samples[SAMPLE_BATCH_MAX - 1] = sample;
+  }
+}
+
+/**********************************************************************
+ * Returns true if the batch is non-empty and either full or older
+ * than the configured window.
+ */
+bool SampleBatch::isDue(unsigned long now) {
+  if (this->count == 0) return(false);
+  if (this->count >= this->size) return(true);
+  return((this->window != 0UL) && ((now - this->firstAdded) >= this->window));
+}
+
+const SAMPLE *SampleBatch::getSamples() {
+  return(this->samples);
+}
+
+unsigned int SampleBatch::getCount() {
+  return(this->count);
+}
+
+void SampleBatch::clear() {
+  this->count = 0;
+}
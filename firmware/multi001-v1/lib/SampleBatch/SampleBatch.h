@@ -0,0 +1,40 @@
+/**********************************************************************
+ * NAME
+ *   SampleBatch.h - accumulate SAMPLEs for publication as a batch.
+ * DESCRIPTION
+ *   Collects samples until either a configured number have been
+ *   collected or a configured time has passed since the first of them
+ *   was added, at which point isDue() says that the batch should be
+ *   published. Publishing many samples as a single MQTT message
+ *   saves the per-message protocol and TCP overhead and lets the
+ *   radio stay idle for longer.
+ */
+
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include <Arduino.h>
+#include <Sample.h>
+
+#define SAMPLE_BATCH_MAX 16               // Largest supported batch
+
+class SampleBatch {
+  public:
+    SampleBatch();
+    void configure(unsigned int size, unsigned long window);
+    bool isEnabled();
+    void add(const SAMPLE &sample);
+    bool isDue(unsigned long now);
+    const SAMPLE *getSamples();
+    unsigned int getCount();
+    void clear();
+
+  private:
+    SAMPLE samples[SAMPLE_BATCH_MAX];
+    unsigned int size;
+    unsigned long window;
+    unsigned int count;
+    unsigned long firstAdded;
+};
+
+#endif
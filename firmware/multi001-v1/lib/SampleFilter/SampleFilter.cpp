@@ -0,0 +1,132 @@
+/**********************************************************************
+ * SampleFilter.cpp - smoothing and change detection for the analogue
+ * channels of a SAMPLE.
+ */
+
+#include "SampleFilter.h"
+
+SampleFilter::SampleFilter() {
+  this->configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+}
+
+/**********************************************************************
+ * Select the filter <mode> and the deadbands for each kind of channel
+ * (in the units of the corresponding SAMPLE field). Any filter history
+ * is discarded.
+ */
+void SampleFilter::configure(uint8_t mode, int16_t temperatureDeadband, int16_t humidityDeadband, int16_t luxDeadband) {
+  this->mode = (mode <= SAMPLE_FILTER_MEDIAN)?mode:SAMPLE_FILTER_NONE;
+  this->temperatureDeadband = temperatureDeadband;
+  this->humidityDeadband = humidityDeadband;
+  this->luxDeadband = luxDeadband;
+  this->reset();
+}
+
+/**********************************************************************
+ * Discard the history of every channel, keeping the mode and
+ * deadbands.
+ */
+void SampleFilter::reset() {
+  memset(this->channels, 0, sizeof(this->channels));
+}
+
+/**********************************************************************
+ * Add the channels present in <reading>, which should hold just the
+ * readings that have changed, to the filter.
+ */
+void SampleFilter::update(const SAMPLE &reading) {
+  if (reading.flags & SAMPLE_HAS_TEMPERATURE) this->updateChannel(this->channels[SAMPLE_FILTER_TEMPERATURE], reading.temperature);
+  if (reading.flags & SAMPLE_HAS_HUMIDITY) this->updateChannel(this->channels[SAMPLE_FILTER_HUMIDITY], reading.humidity);
+  if (reading.flags & SAMPLE_HAS_LUX) this->updateChannel(this->channels[SAMPLE_FILTER_LUX], reading.lux);
+  for (uint8_t i = 0; (i < reading.probeCount) && (i < SAMPLE_MAX_PROBES); i++) {
+    this->updateChannel(this->channels[SAMPLE_FILTER_PROBE + i], reading.probes[i]);
+  }
+}
+
+/**********************************************************************
+ * Replace each analogue channel in <sample> with its filtered value.
+ */
+void SampleFilter::apply(SAMPLE &sample) {
+  if (sample.flags & SAMPLE_HAS_TEMPERATURE) sample.temperature = this->getValue(this->channels[SAMPLE_FILTER_TEMPERATURE], sample.temperature);
+  if (sample.flags & SAMPLE_HAS_HUMIDITY) sample.humidity = this->getValue(this->channels[SAMPLE_FILTER_HUMIDITY], sample.humidity);
+  if (sample.flags & SAMPLE_HAS_LUX) sample.lux = this->getValue(this->channels[SAMPLE_FILTER_LUX], sample.lux);
+  for (uint8_t i = 0; (i < sample.probeCount) && (i < SAMPLE_MAX_PROBES); i++) {
+    sample.probes[i] = this->getValue(this->channels[SAMPLE_FILTER_PROBE + i], sample.probes[i]);
+  }
+}
+
+/**********************************************************************
+ * Returns true if <sample> differs meaningfully from <reference> (see
+ * SampleFilter.h).
+ */
+bool SampleFilter::isChanged(const SAMPLE &sample, const SAMPLE &reference) {
+  return(this->getChanges(sample, reference) != 0);
+}
+
+/**********************************************************************
+ * Returns the SAMPLE_CHANNEL_ bits of every class of channel in which
+ * <sample> differs from <reference> in a way worth publishing, or zero
+ * if there is no such difference.
+ */
+uint8_t SampleFilter::getChanges(const SAMPLE &sample, const SAMPLE &reference) {
+  uint8_t flags = ((sample.flags ^ reference.flags) & ~SAMPLE_STALE);
+  uint8_t changes = 0;
+
+  if ((flags & SAMPLE_HAS_TEMPERATURE) || ((sample.flags & SAMPLE_HAS_TEMPERATURE) && (isChannelChanged(sample.temperature, reference.temperature, this->temperatureDeadband)))) changes |= SAMPLE_CHANNEL_TEMPERATURE;
+  if ((flags & SAMPLE_HAS_HUMIDITY) || ((sample.flags & SAMPLE_HAS_HUMIDITY) && (isChannelChanged(sample.humidity, reference.humidity, this->humidityDeadband)))) changes |= SAMPLE_CHANNEL_HUMIDITY;
+  if ((flags & SAMPLE_HAS_LUX) || ((sample.flags & SAMPLE_HAS_LUX) && (isChannelChanged(sample.lux, reference.lux, this->luxDeadband)))) changes |= SAMPLE_CHANNEL_LUX;
+  if (flags & (SAMPLE_HAS_MOTION | SAMPLE_MOTION)) changes |= SAMPLE_CHANNEL_MOTION;
+  if ((sample.switchCount != reference.switchCount) || (sample.switches != reference.switches)) changes |= SAMPLE_CHANNEL_SWITCHES;
+  if (sample.probeCount != reference.probeCount) {
+    changes |= SAMPLE_CHANNEL_PROBES;
+  } else {
+    for (uint8_t i = 0; (i < sample.probeCount) && (i < SAMPLE_MAX_PROBES); i++) {
+      if (isChannelChanged(sample.probes[i], reference.probes[i], this->temperatureDeadband)) changes |= SAMPLE_CHANNEL_PROBES;
+    }
+  }
+  return(changes);
+}
+
+void SampleFilter::updateChannel(CHANNEL &channel, int16_t value) {
+  if (value == SAMPLE_INVALID_VALUE) {
+    channel.count = 0;
+    return;
+  }
+  if (channel.count == 0) {
+    channel.average = ((int32_t) value << SAMPLE_FILTER_EMA_SCALE);
+    for (uint8_t i = 0; i < SAMPLE_FILTER_MEDIAN_WINDOW; i++) channel.history[i] = value;
+    channel.next = 0;
+  } else {
+    channel.average += ((((int32_t) value << SAMPLE_FILTER_EMA_SCALE) - channel.average) >> SAMPLE_FILTER_EMA_SHIFT);
+  }
+  channel.history[channel.next] = value;
+  channel.next = (channel.next + 1) % SAMPLE_FILTER_MEDIAN_WINDOW;
+  if (channel.count < 0xFF) channel.count++;
+}
+
+/**********************************************************************
+ * Returns the filtered value of <channel>, whose latest reading is
+ * <value>.
+ */
+int16_t SampleFilter::getValue(CHANNEL &channel, int16_t value) {
+  int16_t a, b, c;
+
+  if ((value == SAMPLE_INVALID_VALUE) || (channel.count == 0)) return(value);
+  switch (this->mode) {
+    case SAMPLE_FILTER_EMA:
+      return((int16_t) ((channel.average + (1 << (SAMPLE_FILTER_EMA_SCALE - 1))) >> SAMPLE_FILTER_EMA_SCALE));
+    case SAMPLE_FILTER_MEDIAN:
+      a = channel.history[0]; b = channel.history[1]; c = channel.history[2];
+      if (a > b) { int16_t t = a; a = b; b = t; }
+      if (b > c) b = c;
+      return((a > b)?a:b);
+    default:
+      return(value);
+  }
+}
+
+bool SampleFilter::isChannelChanged(int16_t value, int16_t reference, int16_t deadband) {
+  if ((value == SAMPLE_INVALID_VALUE) || (reference == SAMPLE_INVALID_VALUE)) return(value != reference);
+  if (deadband <= 0) return(false);
+  return(abs((int32_t) value - (int32_t) reference) >= deadband);
+}
@@ -0,0 +1,90 @@
+/**********************************************************************
+ * NAME
+ *   SampleFilter.h - smoothing and change detection for the analogue
+ *   channels of a SAMPLE.
+ * DESCRIPTION
+ *   SampleFilter tracks the temperature, humidity, lux and probe
+ *   channels of a node. Each new reading of a channel is passed to
+ *   update() and apply() then replaces the channel values in a SAMPLE
+ *   with their filtered values. The filter mode is one of:
+ *
+ *   SAMPLE_FILTER_NONE    Each channel reports its latest reading.
+ *   SAMPLE_FILTER_EMA     Each channel reports an exponential moving
+ *                         average with a weight of 1/4 on the latest
+ *                         reading.
+ *   SAMPLE_FILTER_MEDIAN  Each channel reports the median of its last
+ *                         three readings.
+ *
+ *   An invalid reading resets a channel's filter, so a failed sensor is
+ *   reported immediately and recovery is not averaged against stale
+ *   values.
+ *
+ *   isChanged() decides whether a sample differs from the one most
+ *   recently published. An analogue channel has changed if either
+ *   value is invalid (and the other is not) or if it has moved by at
+ *   least the deadband for its kind from the published value. Because
+ *   the comparison is made against the published value and not the
+ *   previous reading, a value hovering around some threshold cannot
+ *   cause a stream of publications: it must move a whole deadband
+ *   away before it is published again. A deadband of zero means that
+ *   the channel never counts as a change on its own. Any change in
+ *   switch or motion state, or in the set of channels present, always
+ *   counts. getChanges() makes the same decision but returns the
+ *   SAMPLE_CHANNEL_ class of every channel which has changed, so that
+ *   the caller can treat some kinds of change as more urgent than
+ *   others (a change in the set of channels present is attributed to
+ *   the class of the added or removed channel).
+ *
+ *   Each channel costs twelve bytes of RAM.
+ */
+
+#ifndef SAMPLE_FILTER_H
+#define SAMPLE_FILTER_H
+
+#include <Arduino.h>
+#include <Sample.h>
+
+#define SAMPLE_FILTER_NONE 0
+#define SAMPLE_FILTER_EMA 1
+#define SAMPLE_FILTER_MEDIAN 2
+
+#define SAMPLE_FILTER_EMA_SHIFT 2         // Weight 1/(1 << SHIFT) on each new reading
+#define SAMPLE_FILTER_EMA_SCALE 4         // Fractional bits held in the average
+#define SAMPLE_FILTER_MEDIAN_WINDOW 3
+
+#define SAMPLE_FILTER_TEMPERATURE 0       // Channel indices
+#define SAMPLE_FILTER_HUMIDITY 1
+#define SAMPLE_FILTER_LUX 2
+#define SAMPLE_FILTER_PROBE 3             // First of SAMPLE_MAX_PROBES
+#define SAMPLE_FILTER_CHANNELS (SAMPLE_FILTER_PROBE + SAMPLE_MAX_PROBES)
+
+class SampleFilter {
+  public:
+    SampleFilter();
+    void configure(uint8_t mode, int16_t temperatureDeadband, int16_t humidityDeadband, int16_t luxDeadband);
+    void reset();
+    void update(const SAMPLE &reading);
+    void apply(SAMPLE &sample);
+    bool isChanged(const SAMPLE &sample, const SAMPLE &reference);
+    uint8_t getChanges(const SAMPLE &sample, const SAMPLE &reference);
+
+  private:
+    struct CHANNEL {
+      int32_t average;                    // EMA << SAMPLE_FILTER_EMA_SCALE
+      int16_t history[SAMPLE_FILTER_MEDIAN_WINDOW];
+      uint8_t count;                      // Valid readings seen (0 = none)
+      uint8_t next;                       // Next slot in history
+    };
+
+    void updateChannel(CHANNEL &channel, int16_t value);
+    int16_t getValue(CHANNEL &channel, int16_t value);
+    static bool isChannelChanged(int16_t value, int16_t reference, int16_t deadband);
+
+    uint8_t mode;
+    int16_t temperatureDeadband;          // Hundredths of a degree
+    int16_t humidityDeadband;             // Tenths of a percent
+    int16_t luxDeadband;
+    CHANNEL channels[SAMPLE_FILTER_CHANNELS];
+};
+
+#endif
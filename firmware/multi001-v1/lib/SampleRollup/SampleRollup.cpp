@@ -0,0 +1,185 @@
+/**********************************************************************
+ * SampleRollup.cpp - per-window statistics of every sample channel.
+ */
+
+#include "SampleRollup.h"
+
+#define ROLLUP_STATE_UNKNOWN 0xff
+
+SampleRollup::SampleRollup() {
+  this->window = 0UL;
+  for (uint8_t i = 0; i < SAMPLE_CODEC_CHANNELS; i++) {
+    this->channels[i].name = NULL;
+    this->channels[i].state = ROLLUP_STATE_UNKNOWN;
+  }
+  this->reset(0UL);
+}
+
+/**********************************************************************
+ * Summarise windows of <window> milliseconds (0 = never), starting a
+ * new window at <now> if the length changes.
+ */
+void SampleRollup::configure(unsigned long window, unsigned long now) {
+  if (window == this->window) return;
+  this->window = window;
+  this->reset(now);
+}
+
+bool SampleRollup::isEnabled() {
+  return(this->window > 0);
+}
+
+/**********************************************************************
+ * Add the valid readings of the measured channels of <sample> to the
+ * statistics.
+ */
+void SampleRollup::add(const SAMPLE &sample, const SAMPLE_NAMES &names) {
+  SAMPLE_CHANNEL_VALUE value;
+
+  if (!this->isEnabled()) return;
+  this->samples++;
+  for (uint8_t i = 0; i < SAMPLE_CODEC_CHANNELS; i++) {
+    CHANNEL &channel = this->channels[i];
+
+    if ((isBinary(i)) || (!SampleCodec::getChannel(sample, names, i, value)) || (value.value == SAMPLE_INVALID_VALUE)) continue;
+    if ((channel.count == 0) || (value.value < channel.min)) channel.min = value.value;
+    if ((channel.count == 0) || (value.value > channel.max)) channel.max = value.value;
+    channel.sum += value.value;
+    channel.count++;
+    channel.name = value.name;
+    channel.decimals = value.decimals;
+  }
+}
+
+/**********************************************************************
+ * Follow the binary channels of <sample>, counting each change of
+ * state and the time spent on. A channel which disappears stops
+ * being followed (and will be reported as unchanged and off).
+ */
+void SampleRollup::track(const SAMPLE &sample, const SAMPLE_NAMES &names) {
+  SAMPLE_CHANNEL_VALUE value;
+
+  if (!this->isEnabled()) return;
+  for (uint8_t i = 0; i < SAMPLE_CODEC_CHANNELS; i++) {
+    CHANNEL &channel = this->channels[i];
+
+    if (!isBinary(i)) continue;
+    if (!SampleCodec::getChannel(sample, names, i, value)) {
+      if (channel.state == 1) channel.onTime += (sample.timestamp - channel.since);
+      channel.state = ROLLUP_STATE_UNKNOWN;
+      continue;
+    }
+    if (channel.state == ROLLUP_STATE_UNKNOWN) {
+      channel.since = sample.timestamp;
+    } else if (channel.state != value.value) {
+      if (channel.state == 1) channel.onTime += (sample.timestamp - channel.since);
+      channel.since = sample.timestamp;
+      channel.count++;
+    }
+    channel.state = value.value;
+    channel.name = value.name;
+  }
+}
+
+/**********************************************************************
+ * Returns true if the current window has ended by <now>.
+ */
+bool SampleRollup::isDue(unsigned long now) {
+  return((this->isEnabled()) && ((now - this->start) >= this->window));
+}
+
+/**********************************************************************
+ * Stream the statistics of the window from its start to <now> to
+ * <out> as a JSON object (see SampleRollup.h) or, if <out> is NULL,
+ * just measure them. Channels without a reading are omitted. Returns
+ * the number of bytes written (or which would be written) or zero if
+ * writing failed.
+ */
+size_t SampleRollup::toJson(Print *out, unsigned long now) {
+  unsigned long duration = (now - this->start);
+  size_t length = 0;
+  bool failed = false;
+  char buffer[40];
+
+  snprintf(buffer, sizeof(buffer), "{ \"window\": %lu, \"samples\": %lu", duration, (unsigned long) this->samples);
+  append(out, buffer, length, failed);
+  for (uint8_t i = 0; i < SAMPLE_CODEC_CHANNELS; i++) {
+    const CHANNEL &channel = this->channels[i];
+
+    if (isBinary(i)) {
+      uint32_t onTime = channel.onTime;
+
+      if (channel.name == NULL) continue;
+      if (channel.state == 1) onTime += (now - channel.since);
+      appendObject(out, channel.name, length, failed);
+      appendProperty(out, "duty", (duration)?(long) (((uint64_t) onTime * 1000ULL) / duration):0L, 1, true, length, failed);
+      appendProperty(out, "changes", channel.count, 0, false, length, failed);
+    } else {
+      long rounding = (channel.count / 2);
+
+      if (channel.count == 0) continue;
+      appendObject(out, channel.name, length, failed);
+      appendProperty(out, "min", channel.min, channel.decimals, true, length, failed);
+      appendProperty(out, "max", channel.max, channel.decimals, false, length, failed);
+      appendProperty(out, "mean", (long) ((channel.sum + ((channel.sum < 0)?-rounding:rounding)) / (int64_t) channel.count), channel.decimals, false, length, failed);
+      appendProperty(out, "count", channel.count, 0, false, length, failed);
+    }
+    append(out, " }", length, failed);
+  }
+  append(out, " }", length, failed);
+  return((failed)?0:length);
+}
+
+/**********************************************************************
+ * Start a new window at <now>. Binary channels keep their state, but
+ * their time on is counted afresh from <now>.
+ */
+void SampleRollup::reset(unsigned long now) {
+  for (uint8_t i = 0; i < SAMPLE_CODEC_CHANNELS; i++) {
+    CHANNEL &channel = this->channels[i];
+
+    channel.sum = 0;
+    channel.count = 0;
+    channel.onTime = 0;
+    channel.since = now;
+    if (channel.state == ROLLUP_STATE_UNKNOWN) channel.name = NULL;
+  }
+  this->start = now;
+  this->samples = 0;
+}
+
+bool SampleRollup::isBinary(uint8_t index) {
+  return((index == SAMPLE_CODEC_MOTION_CHANNEL) || ((index >= SAMPLE_CODEC_SWITCH_CHANNEL) && (index < SAMPLE_CODEC_PROBE_CHANNEL)));
+}
+
+void SampleRollup::append(Print *out, const char *text, size_t &length, bool &failed) {
+  size_t n = strlen(text);
+
+  if ((out) && (out->write((const uint8_t*) text, n) != n)) failed = true;
+  length += n;
+}
+
+/**********************************************************************
+ * Open a nested object as the property <name>.
+ */
+void SampleRollup::appendObject(Print *out, const char *name, size_t &length, bool &failed) {
+  append(out, ", \"", length, failed);
+  append(out, name, length, failed);
+  append(out, "\": { ", length, failed);
+}
+
+/**********************************************************************
+ * Append the property <name> with <value> (which has <decimals>
+ * implied decimal places), separated from any previous property
+ * unless it is the <first> in its object.
+ */
+void SampleRollup::appendProperty(Print *out, const char *name, long value, uint8_t decimals, bool first, size_t &length, bool &failed) {
+  SAMPLE_CHANNEL_VALUE channel = { name, value, decimals };
+  char text[SAMPLE_CODEC_TEXT_SIZE];
+
+  append(out, (first)?"\"":", \"", length, failed);
+  append(out, name, length, failed);
+  append(out, "\": ", length, failed);
+  SampleCodec::toText(text, sizeof(text), channel);
+  append(out, text, length, failed);
+}
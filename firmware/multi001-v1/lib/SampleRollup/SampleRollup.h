@@ -0,0 +1,79 @@
+/**********************************************************************
+ * NAME
+ *   SampleRollup.h - per-window statistics of every sample channel.
+ * DESCRIPTION
+ *   Summarises the channels of the samples taken during a window of
+ *   configurable length, so that a trend can be published once a
+ *   minute or once an hour rather than reconstructed from every raw
+ *   sample. Each channel (in the order and with the names of
+ *   SampleCodec::getChannel()) has a fixed accumulator, so memory use
+ *   is independent of the window length:
+ *
+ *   - Measured channels (temperature, humidity, lux and each DS18B20
+ *     probe) have the minimum, maximum, mean and number of valid
+ *     readings, taken from the samples passed to add(). These should
+ *     be taken at regular intervals, since every reading carries the
+ *     same weight in the mean.
+ *
+ *   - Binary channels (motion and each switch) have the percentage of
+ *     the window for which they were on (their duty cycle) and the
+ *     number of times they changed, followed through every sample
+ *     passed to track() so that changes between regular samples are
+ *     not missed.
+ *
+ *   toJson() renders the statistics in the form:
+ *
+ *     '{ "window": ms, "samples": n,
+ *        "temperature": { "min": v, "max": v, "mean": v, "count": n },
+ *        ...
+ *        "motion": { "duty": pc, "changes": n }, ... }'
+ *
+ *   where values have the fixed-point precision of the channel. Like
+ *   the SampleCodec encoders it streams to a Print, or given NULL just
+ *   measures its output. reset() starts a new window; binary channels
+ *   carry their state into it.
+ */
+
+#ifndef SAMPLE_ROLLUP_H
+#define SAMPLE_ROLLUP_H
+
+#include <Arduino.h>
+#include <Sample.h>
+#include <SampleCodec.h>
+
+class SampleRollup {
+  public:
+    SampleRollup();
+    void configure(unsigned long window, unsigned long now);
+    bool isEnabled();
+    void add(const SAMPLE &sample, const SAMPLE_NAMES &names);
+    void track(const SAMPLE &sample, const SAMPLE_NAMES &names);
+    bool isDue(unsigned long now);
+    size_t toJson(Print *out, unsigned long now);
+    void reset(unsigned long now);
+
+  private:
+    struct CHANNEL {
+      const char *name;                   // Property name
+      int64_t sum;                        // Measured: of readings
+      uint32_t count;                     // Measured: readings, binary: changes
+      uint32_t onTime;                    // Binary: milliseconds on before since
+      unsigned long since;                // Binary: millis() of the latest state
+      int16_t min;
+      int16_t max;
+      uint8_t decimals;
+      uint8_t state;                      // Binary: 0, 1 or ROLLUP_STATE_UNKNOWN
+    };
+
+    static bool isBinary(uint8_t index);
+    static void append(Print *out, const char *text, size_t &length, bool &failed);
+    static void appendObject(Print *out, const char *name, size_t &length, bool &failed);
+    static void appendProperty(Print *out, const char *name, long value, uint8_t decimals, bool first, size_t &length, bool &failed);
+
+    CHANNEL channels[SAMPLE_CODEC_CHANNELS];
+    unsigned long window;
+    unsigned long start;                  // millis() at which the window began
+    uint32_t samples;
+};
+
+#endif
@@ -0,0 +1,191 @@
+/**********************************************************************
+ * SampleStore.cpp - store-and-forward queue of SAMPLEs.
+ */
+
+#include "SampleStore.h"
+
+SampleStore::SampleStore() {
+  this->head = 0;
+  this->count = 0;
+  this->flashEnabled = false;
+  this->flashSize = 0;
+  this->flashReadOffset = 0;
+  this->flashStaleLimit = 0;
+  this->dropped = 0UL;
+}
+
+/**********************************************************************
+ * Prepare the store for use. If <useFlash> is true and LittleFS can
+ * be mounted, then the store will overflow into flash and any spool
+ * file surviving from an earlier boot will be queued for forwarding.
+ * A spool whose format does not match this firmware is discarded.
+ */
+void SampleStore::begin(bool useFlash) {
+  uint32_t magic = 0;
+
+  if ((useFlash) && (LittleFS.begin())) {
+    this->flashEnabled = true;
+    if (LittleFS.exists(SAMPLE_STORE_FLASH_FILE)) {
+      File file = LittleFS.open(SAMPLE_STORE_FLASH_FILE, "r");
+      if ((file) && (file.read((uint8_t*) &magic, sizeof(magic)) == sizeof(magic)) && (magic == SAMPLE_STORE_FLASH_MAGIC)) {
+        this->flashSize = (sizeof(magic) + (((file.size() - sizeof(magic)) / sizeof(SAMPLE)) * sizeof(SAMPLE)));
+        this->flashReadOffset = sizeof(magic);
+        this->flashStaleLimit = this->flashSize;
+      }
+      if (file) file.close();
+      if (this->flashSize == 0) removeSpool();
+    }
+  }
+}
+
+/**********************************************************************
+ * Queue <sample> for forwarding, making room if necessary by spilling
+ * to flash or, failing that, by dropping the oldest sample in RAM.
+ */
+void SampleStore::push(const SAMPLE &sample) {
+  if (this->count == SAMPLE_STORE_SIZE) {
+    if (!spill()) {
+      this->head = ((this->head + 1) % SAMPLE_STORE_SIZE);
+      this->count--;
+      this->dropped++;
+    }
+  }
+  this->ring[(this->head + this->count) % SAMPLE_STORE_SIZE] = sample;
+  this->count++;
+}
+
+/**********************************************************************
+ * Copy up to <max> of the oldest samples into <samples> without
+ * removing them from the store, returning the number copied. All of
+ * the returned samples come from a single segment (flash or RAM), so
+ * fewer than <max> samples may be returned even if more are queued.
+ */
+size_t SampleStore::peek(SAMPLE *samples, size_t max) {
+  size_t n = 0;
+
+  if (this->flashReadOffset < this->flashSize) {
+    File file = LittleFS.open(SAMPLE_STORE_FLASH_FILE, "r");
+    if ((file) && (file.seek(this->flashReadOffset))) {
+      uint32_t offset = this->flashReadOffset;
+      while ((n < max) && (offset < this->flashSize) && (file.read((uint8_t*) &samples[n], sizeof(SAMPLE)) == sizeof(SAMPLE))) {
+        if (offset < this->flashStaleLimit) samples[n].flags |= SAMPLE_STALE;
+        offset += sizeof(SAMPLE);
+        n++;
+      }
+    }
+    if (file) file.close();
+    if (n == 0) removeSpool();
+  }
+  if ((n == 0) && (this->flashReadOffset >= this->flashSize)) {
+    for (n = 0; (n < max) && (n < this->count); n++) {
+      samples[n] = this->ring[(this->head + n) % SAMPLE_STORE_SIZE];
+    }
+  }
+  return(n);
+}
+
+/**********************************************************************
+ * Remove the <count> oldest samples from the store. <count> should be
+ * no greater than the value returned by the preceding peek().
+ */
+void SampleStore::discard(size_t count) {
+  if (this->flashReadOffset < this->flashSize) {
+    this->flashReadOffset += (count * sizeof(SAMPLE));
+    if (this->flashReadOffset >= this->flashSize) removeSpool();
+  } else {
+    if (count > this->count) count = this->count;
+    this->head = ((this->head + count) % SAMPLE_STORE_SIZE);
+    this->count -= count;
+  }
+}
+
+/**********************************************************************
+ * Remove up to <max> of the oldest samples held in RAM, copying them
+ * into <samples> and returning the number removed. Samples in flash
+ * are left where they are.
+ */
+size_t SampleStore::drain(SAMPLE *samples, size_t max) {
+  size_t n;
+
+  for (n = 0; (n < max) && (n < this->count); n++) {
+    samples[n] = this->ring[(this->head + n) % SAMPLE_STORE_SIZE];
+  }
+  this->head = ((this->head + n) % SAMPLE_STORE_SIZE);
+  this->count -= n;
+  return(n);
+}
+
+/**********************************************************************
+ * Move every sample held in RAM to flash, for example because RAM is
+ * about to be lost to deep sleep. Returns false if some samples could
+ * not be moved.
+ */
+bool SampleStore::flush() {
+  while (this->count > 0) {
+    if (!spill()) return(false);
+  }
+  return(true);
+}
+
+bool SampleStore::isEmpty() {
+  return((this->count == 0) && (this->flashReadOffset >= this->flashSize));
+}
+
+/**********************************************************************
+ * Returns the number of samples waiting to be forwarded.
+ */
+unsigned long SampleStore::getCount() {
+  unsigned long flashCount = (this->flashReadOffset < this->flashSize)?((this->flashSize - this->flashReadOffset) / sizeof(SAMPLE)):0;
+  return(this->count + flashCount);
+}
+
+/**********************************************************************
+ * Returns the number of samples lost because there was nowhere to
+ * put them.
+ */
+unsigned long SampleStore::getDropped() {
+  return(this->dropped);
+}
+
+/**********************************************************************
+ * Append the SAMPLE_STORE_SPILL oldest samples in RAM to the spool
+ * file, returning false if flash is unavailable or full. They are
+ * written straight from the ring (in two pieces if it wraps) rather
+ * than copied to a block on the stack.
+ */
+bool SampleStore::spill() {
+  uint32_t magic = SAMPLE_STORE_FLASH_MAGIC;
+  size_t n = (this->count < SAMPLE_STORE_SPILL)?this->count:SAMPLE_STORE_SPILL;
+  size_t first = ((this->head + n) > SAMPLE_STORE_SIZE)?(SAMPLE_STORE_SIZE - this->head):n;
+
+  if (!this->flashEnabled) return(false);
+  if ((this->flashSize + sizeof(magic) + (n * sizeof(SAMPLE))) > SAMPLE_STORE_FLASH_LIMIT) return(false);
+
+  File file = LittleFS.open(SAMPLE_STORE_FLASH_FILE, "a");
+  if (!file) return(false);
+  if (this->flashSize == 0) {
+    if (file.write((const uint8_t*) &magic, sizeof(magic)) != sizeof(magic)) { file.close(); return(false); }
+    this->flashSize = this->flashReadOffset = sizeof(magic);
+  }
+  size_t written = file.write((const uint8_t*) &this->ring[this->head], (first * sizeof(SAMPLE)));
+  if ((written == (first * sizeof(SAMPLE))) && (first < n)) written += file.write((const uint8_t*) &this->ring[0], ((n - first) * sizeof(SAMPLE)));
+  if (written != (n * sizeof(SAMPLE))) {
+    // Don't leave a partial record behind to misalign later appends.
+    file.truncate(this->flashSize);
+    file.close();
+    return(false);
+  }
+  file.close();
+
+  this->flashSize += written;
+  this->head = ((this->head + n) % SAMPLE_STORE_SIZE);
+  this->count -= n;
+  return(true);
+}
+
+void SampleStore::removeSpool() {
+  LittleFS.remove(SAMPLE_STORE_FLASH_FILE);
+  this->flashSize = 0;
+  this->flashReadOffset = 0;
+  this->flashStaleLimit = 0;
+}
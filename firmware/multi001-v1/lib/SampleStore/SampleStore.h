@@ -0,0 +1,68 @@
+/**********************************************************************
+ * NAME
+ *   SampleStore.h - store-and-forward queue of SAMPLEs.
+ * DESCRIPTION
+ *   Holds samples which could not be published (typically because the
+ *   MQTT connection is down) until they can be forwarded.
+ *
+ *   Samples are queued in a fixed-size RAM ring. If flash storage is
+ *   enabled, then when the ring fills its oldest SAMPLE_STORE_SPILL
+ *   samples are appended, straight from the ring, to a spool file on
+ *   LittleFS; otherwise the oldest sample is dropped. The spool file
+ *   is only ever appended to and is deleted once it has been fully
+ *   drained, so each flash page is written at most once per outage
+ *   and LittleFS is left to level wear across its blocks. The spool
+ *   is capped at SAMPLE_STORE_FLASH_LIMIT bytes.
+ *
+ *   Samples are always delivered oldest first. A client drains the
+ *   store by calling peek() to copy a batch of samples and discard()
+ *   to remove those it has successfully forwarded.
+ *
+ *   A spool file left over from an earlier boot is drained normally,
+ *   but its samples are marked SAMPLE_STALE because their timestamps
+ *   relate to a millis() clock which no longer exists.
+ */
+
+#ifndef SAMPLE_STORE_H
+#define SAMPLE_STORE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Sample.h>
+
+#ifndef SAMPLE_STORE_SIZE
+#define SAMPLE_STORE_SIZE 64                // Samples held in RAM
+#endif
+#define SAMPLE_STORE_SPILL 32               // Samples moved to flash at a time
+#define SAMPLE_STORE_FLASH_FILE "/spool.bin"
+#define SAMPLE_STORE_FLASH_LIMIT 65536      // Bytes
+#define SAMPLE_STORE_FLASH_MAGIC (0x53500000UL | sizeof(SAMPLE))
+
+class SampleStore {
+  public:
+    SampleStore();
+    void begin(bool useFlash);
+    void push(const SAMPLE &sample);
+    size_t peek(SAMPLE *samples, size_t max);
+    void discard(size_t count);
+    size_t drain(SAMPLE *samples, size_t max);
+    bool flush();
+    bool isEmpty();
+    unsigned long getCount();
+    unsigned long getDropped();
+
+  private:
+    bool spill();
+    void removeSpool();
+
+    SAMPLE ring[SAMPLE_STORE_SIZE];
+    uint16_t head;                          // Index of oldest sample in ring
+    uint16_t count;                         // Number of samples in ring
+    bool flashEnabled;
+    uint32_t flashSize;                     // Bytes in spool file
+    uint32_t flashReadOffset;               // Offset of oldest undrained sample
+    uint32_t flashStaleLimit;               // Samples before this offset are stale
+    unsigned long dropped;
+};
+
+#endif
@@ -0,0 +1,128 @@
+/**********************************************************************
+ * Scheduler.cpp - cooperative scheduler for loop() tasks.
+ */
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler() {
+  this->count = 0;
+}
+
+/**********************************************************************
+ * Add a task called <name> which calls <function> with <arg> once
+ * every <interval> milliseconds, starting on the next pass through
+ * loop(). Returns an identifier for the task or SCHEDULER_NO_TASK if
+ * the task table is full.
+ */
+int Scheduler::add(const char *name, SCHEDULER_TASK_FUNCTION function, void *arg, unsigned long interval) {
+  if (this->count >= SCHEDULER_MAX_TASKS) return(SCHEDULER_NO_TASK);
+  this->tasks[this->count] = { name, function, arg, interval, millis(), 0UL, 0UL, 0UL, 0UL };
+  return(this->count++);
+}
+
+/**********************************************************************
+ * Change the interval of task <id>. The new interval applies from the
+ * task's next run.
+ */
+void Scheduler::setInterval(int id, unsigned long interval) {
+  if ((id >= 0) && (id < this->count)) this->tasks[id].interval = interval;
+}
+
+/**********************************************************************
+ * Make task <id> due on the next pass through loop().
+ */
+void Scheduler::trigger(int id) {
+  if ((id >= 0) && (id < this->count)) this->tasks[id].due = millis();
+}
+
+/**********************************************************************
+ * Run every task which is due, yielding after each.
+ */
+void Scheduler::loop() {
+  for (uint8_t i = 0; i < this->count; i++) {
+    unsigned long now = millis();
+    if ((this->tasks[i].interval == 0) || ((long) (now - this->tasks[i].due) >= 0)) {
+      this->run(this->tasks[i], now);
+      yield();
+    }
+  }
+}
+
+/**********************************************************************
+ * Start a new statistics period for every task.
+ */
+void Scheduler::reset() {
+  for (uint8_t i = 0; i < this->count; i++) {
+    this->tasks[i].runs = this->tasks[i].overruns = 0UL;
+    this->tasks[i].totalTime = this->tasks[i].maxTime = 0UL;
+  }
+}
+
+uint8_t Scheduler::getCount() {
+  return(this->count);
+}
+
+const char *Scheduler::getName(int id) {
+  return(((id >= 0) && (id < this->count))?this->tasks[id].name:"");
+}
+
+unsigned long Scheduler::getRuns(int id) {
+  return(((id >= 0) && (id < this->count))?this->tasks[id].runs:0UL);
+}
+
+unsigned long Scheduler::getOverruns(int id) {
+  return(((id >= 0) && (id < this->count))?this->tasks[id].overruns:0UL);
+}
+
+unsigned long Scheduler::getTotalTime(int id) {
+  return(((id >= 0) && (id < this->count))?this->tasks[id].totalTime:0UL);
+}
+
+unsigned long Scheduler::getMaxTime(int id) {
+  return(((id >= 0) && (id < this->count))?this->tasks[id].maxTime:0UL);
+}
+
+/**********************************************************************
+ * Write the statistics for every task into <buffer> as a JSON object
+ * (see Scheduler.h). Returns the length of the generated string or
+ * zero if it would not fit in <size> bytes.
+ */
+size_t Scheduler::toJson(char *buffer, size_t size) {
+  size_t length = 0;
+  int n;
+
+  if ((n = snprintf(buffer, size, "{ ")) < 0) return(0);
+  length += n;
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (length >= size) return(0);
+    n = snprintf(buffer + length, size - length, "%s\"%s\": { \"runs\": %lu, \"overruns\": %lu, \"total\": %lu, \"max\": %lu }", (i)?", ":"", this->tasks[i].name, this->tasks[i].runs, this->tasks[i].overruns, this->tasks[i].totalTime, this->tasks[i].maxTime);
+    if (n < 0) return(0);
+    length += n;
+  }
+  if (length >= size) return(0);
+  if ((n = snprintf(buffer + length, size - length, " }")) < 0) return(0);
+  length += n;
+  return((length < size)?length:0);
+}
+
+/**********************************************************************
+ * Run <task>, which fell due at or before <now>, and schedule its next
+ * run.
+ */
+void Scheduler::run(TASK &task, unsigned long now) {
+  unsigned long start = micros();
+  unsigned long elapsed;
+
+  task.function(task.arg);
+  elapsed = (micros() - start);
+  task.runs++;
+  task.totalTime += elapsed;
+  if (elapsed > task.maxTime) task.maxTime = elapsed;
+  if (task.interval == 0) return;
+  if ((now - task.due) >= task.interval) {
+    task.overruns++;
+    task.due = now + task.interval;
+  } else {
+    task.due += task.interval;
+  }
+}
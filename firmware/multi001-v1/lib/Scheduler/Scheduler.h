@@ -0,0 +1,75 @@
+/**********************************************************************
+ * NAME
+ *   Scheduler.h - cooperative scheduler for loop() tasks.
+ * DESCRIPTION
+ *   A fixed table of up to SCHEDULER_MAX_TASKS tasks, each of which is
+ *   a function that is called with a task specific argument once every
+ *   interval milliseconds (or on every pass if the interval is zero).
+ *   No memory is allocated at run time.
+ *
+ *   loop() runs each task that is due in the order in which the tasks
+ *   were added and yields to the SDK after every task it runs, so a
+ *   slow task never starves the WiFi stack. Tasks must not block.
+ *
+ *   A task's next due time is advanced by whole intervals from its
+ *   previous due time, so a periodic task does not drift. A task which
+ *   falls so far behind that it misses a whole interval has an overrun
+ *   counted and is rescheduled from the current time. All comparisons
+ *   are made on time differences, so the scheduler is unaffected by
+ *   millis() wrap-around.
+ *
+ *   For each task the scheduler counts the number of runs and overruns
+ *   and accumulates the total and maximum run time (in microseconds).
+ *   The statistics cover the period since the last call to reset(),
+ *   which should be made after each report so that the counters never
+ *   wrap. toJson() reports them in the form:
+ *
+ *     '{ "name": { "runs": n, "overruns": n, "total": us, "max": us }, ... }'
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS 16
+#define SCHEDULER_NO_TASK -1
+
+typedef void (*SCHEDULER_TASK_FUNCTION)(void *arg);
+
+class Scheduler {
+  public:
+    Scheduler();
+    int add(const char *name, SCHEDULER_TASK_FUNCTION function, void *arg, unsigned long interval);
+    void setInterval(int id, unsigned long interval);
+    void trigger(int id);
+    void loop();
+    void reset();
+    uint8_t getCount();
+    const char *getName(int id);
+    unsigned long getRuns(int id);
+    unsigned long getOverruns(int id);
+    unsigned long getTotalTime(int id);
+    unsigned long getMaxTime(int id);
+    size_t toJson(char *buffer, size_t size);
+
+  private:
+    struct TASK {
+      const char *name;                   // Stats name (not copied)
+      SCHEDULER_TASK_FUNCTION function;
+      void *arg;
+      unsigned long interval;             // Milliseconds (0 = every pass)
+      unsigned long due;                  // millis() at which next due
+      unsigned long runs;
+      unsigned long overruns;
+      unsigned long totalTime;            // Microseconds
+      unsigned long maxTime;              // Microseconds
+    };
+
+    void run(TASK &task, unsigned long now);
+
+    TASK tasks[SCHEDULER_MAX_TASKS];
+    uint8_t count;
+};
+
+#endif
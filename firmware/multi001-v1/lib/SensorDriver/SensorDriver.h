@@ -0,0 +1,53 @@
+/**********************************************************************
+ * NAME
+ *   SensorDriver.h - interface implemented by every sensor driver.
+ * DESCRIPTION
+ *   Each kind of sensor a node might carry is supported by a driver
+ *   which implements the following hooks, none of which may block for
+ *   longer than it takes to complete a single bus transaction.
+ *
+ *   getName()      A short name for diagnostics.
+ *   begin()        Detect and initialise the sensor, returning false
+ *                  if it is not present. Absent sensors are never
+ *                  scheduled.
+ *   startSample()  Begin acquiring a new reading. The reading may not
+ *                  be available until poll() says so.
+ *   poll()         Called on every pass through loop() to move any
+ *                  acquisition along. Returns SENSOR_UPDATED if a new
+ *                  reading has become available and SENSOR_RENUMBERED
+ *                  if the devices behind the driver's channels have
+ *                  changed (a probe was added or removed), so that any
+ *                  history of those channels no longer applies.
+ *   isReady()      True once the driver has a reading to encode.
+ *   describe()     Supply names for any variably named channels.
+ *   encode()       Add the most recent reading to a SAMPLE.
+ *   published()    Told that the state last encoded has been
+ *                  published (or queued for publication).
+ *
+ *   A node's drivers are collected in a SensorSet (see SensorSet.h)
+ *   which runs them all side by side, so a slow bus never holds up a
+ *   fast one.
+ */
+
+#ifndef SENSOR_DRIVER_H
+#define SENSOR_DRIVER_H
+
+#include <Arduino.h>
+#include <Sample.h>
+
+#define SENSOR_UPDATED 0x01
+#define SENSOR_RENUMBERED 0x02
+
+class SensorDriver {
+  public:
+    virtual const char *getName() = 0;
+    virtual bool begin() = 0;
+    virtual void startSample() { }
+    virtual uint8_t poll() { return(0); }
+    virtual bool isReady() { return(true); }
+    virtual void describe(SAMPLE_NAMES &names) { }
+    virtual void encode(SAMPLE &sample) = 0;
+    virtual void published() { }
+};
+
+#endif
@@ -0,0 +1,111 @@
+/**********************************************************************
+ * SensorSet.cpp - schedule a fixed table of sensor drivers.
+ */
+
+#include "SensorSet.h"
+
+SensorSet::SensorSet(SensorDriver * const *drivers, uint8_t count, SampleFilter &filter) : drivers(drivers), filter(filter) {
+  this->count = (count < SENSOR_SET_MAX_DRIVERS)?count:SENSOR_SET_MAX_DRIVERS;
+  this->present = 0;
+}
+
+/**********************************************************************
+ * Initialise every driver, returning the number of sensors found.
+ */
+uint8_t SensorSet::begin() {
+  uint8_t found = 0;
+
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->drivers[i]->begin()) {
+      this->present |= (1 << i);
+      found++;
+    }
+  }
+  return(found);
+}
+
+uint8_t SensorSet::getCount() {
+  return(this->count);
+}
+
+SensorDriver *SensorSet::getDriver(uint8_t index) {
+  return((index < this->count)?this->drivers[index]:0);
+}
+
+bool SensorSet::isPresent(uint8_t index) {
+  return((index < this->count) && (this->present & (1 << index)));
+}
+
+void SensorSet::startSample() {
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->present & (1 << i)) this->drivers[i]->startSample();
+  }
+}
+
+/**********************************************************************
+ * Poll driver <index>, returning the SENSOR_ flags it reports.
+ */
+uint8_t SensorSet::poll(uint8_t index) {
+  return((this->isPresent(index))?this->pollDriver(index):0);
+}
+
+/**********************************************************************
+ * Returns true once every sensor present has a reading.
+ */
+bool SensorSet::isReady() {
+  for (uint8_t i = 0; i < this->count; i++) {
+    if ((this->present & (1 << i)) && (!this->drivers[i]->isReady())) return(false);
+  }
+  return(true);
+}
+
+void SensorSet::describe(SAMPLE_NAMES &names) {
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->present & (1 << i)) this->drivers[i]->describe(names);
+  }
+}
+
+/**********************************************************************
+ * Build in <sample> a snapshot of the most recent filtered readings
+ * from every sensor present.
+ */
+void SensorSet::encode(SAMPLE &sample) {
+  clear(sample);
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->present & (1 << i)) this->drivers[i]->encode(sample);
+  }
+  this->filter.apply(sample);
+}
+
+void SensorSet::published() {
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->present & (1 << i)) this->drivers[i]->published();
+  }
+}
+
+uint8_t SensorSet::getChanges(const SAMPLE &sample, const SAMPLE &reference) {
+  return(this->filter.getChanges(sample, reference));
+}
+
+void SensorSet::clear(SAMPLE &sample) {
+  memset(&sample, 0, sizeof(sample));
+  sample.timestamp = millis();
+  sample.temperature = sample.humidity = sample.lux = SAMPLE_INVALID_VALUE;
+}
+
+/**********************************************************************
+ * Poll driver <index> and pass any new reading it makes to the
+ * filter.
+ */
+uint8_t SensorSet::pollDriver(uint8_t index) {
+  SAMPLE reading;
+  uint8_t result = this->drivers[index]->poll();
+
+  if (result & SENSOR_RENUMBERED) this->filter.reset();
+  if (result & SENSOR_UPDATED) {
+    clear(reading);
+    this->drivers[index]->encode(reading);
+    this->filter.update(reading);
+  }
+  return(result);
+}
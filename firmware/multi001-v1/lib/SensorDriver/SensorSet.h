@@ -0,0 +1,59 @@
+/**********************************************************************
+ * NAME
+ *   SensorSet.h - schedule a fixed table of sensor drivers.
+ * DESCRIPTION
+ *   A SensorSet runs a table of SensorDrivers, which is normally built
+ *   at compile time from just those drivers that a particular build
+ *   enables. Drivers whose begin() reports that their sensor is absent
+ *   are skipped thereafter.
+ *
+ *   startSample() asks every driver to begin a new reading and poll()
+ *   then moves a driver along, normally from a Scheduler task of its
+ *   own, so the acquisitions on different buses overlap rather than
+ *   queue.
+ *
+ *   Each new reading is passed to a SampleFilter and the SAMPLE built
+ *   by encode() combines the most recent filtered reading from each
+ *   driver. getChanges() asks the filter which classes of channel
+ *   differ from another sample by enough to be worth publishing. A
+ *   driver which reports SENSOR_RENUMBERED has the filter's history
+ *   discarded, so that no channel is smoothed with readings from the
+ *   device which held its index before.
+ */
+
+#ifndef SENSOR_SET_H
+#define SENSOR_SET_H
+
+#include <Arduino.h>
+#include <Sample.h>
+#include <SensorDriver.h>
+#include <SampleFilter.h>
+
+#define SENSOR_SET_MAX_DRIVERS 8
+
+class SensorSet {
+  public:
+    SensorSet(SensorDriver * const *drivers, uint8_t count, SampleFilter &filter);
+    uint8_t begin();
+    uint8_t getCount();
+    SensorDriver *getDriver(uint8_t index);
+    bool isPresent(uint8_t index);
+    void startSample();
+    uint8_t poll(uint8_t index);
+    bool isReady();
+    void describe(SAMPLE_NAMES &names);
+    void encode(SAMPLE &sample);
+    void published();
+    uint8_t getChanges(const SAMPLE &sample, const SAMPLE &reference);
+
+  private:
+    static void clear(SAMPLE &sample);
+    uint8_t pollDriver(uint8_t index);
+
+    SensorDriver * const *drivers;
+    SampleFilter &filter;
+    uint8_t count;
+    uint8_t present;                      // Bit n set says driver n is present
+};
+
+#endif
@@ -0,0 +1,142 @@
+/**********************************************************************
+ * SleepState.cpp - node state which survives deep sleep.
+ */
+
+#include "SleepState.h"
+
+SleepState::SleepState() {
+  memset(&this->state, 0, sizeof(this->state));
+  this->clockValid = false;
+}
+
+/**********************************************************************
+ * Restore state saved by sleep(), returning true if we have just woken
+ * from a deep sleep with valid state. On any other kind of reset the
+ * state starts empty.
+ */
+bool SleepState::begin() {
+  uint32_t reason = ESP.getResetInfoPtr()->reason;
+
+  if ((reason != REASON_DEEP_SLEEP_AWAKE) && (reason != REASON_EXT_SYS_RST)) return(false);
+  if (!ESP.rtcUserMemoryRead(0, (uint32_t*) &this->state, sizeof(this->state))) return(false);
+  if ((this->state.magic != SLEEP_STATE_MAGIC) || (this->state.crc != crc32(((const uint8_t*) &this->state) + 8, sizeof(this->state) - 8))) {
+    memset(&this->state, 0, sizeof(this->state));
+    return(false);
+  }
+  // Invalidate what we just read so that it can never be restored twice.
+  this->state.magic = 0;
+  ESP.rtcUserMemoryWrite(0, (uint32_t*) &this->state, sizeof(this->state.magic));
+
+  this->clockValid = (reason == REASON_DEEP_SLEEP_AWAKE);
+  this->state.wakes++;
+  this->state.reference.timestamp -= this->state.clock;
+  for (uint8_t i = 0; i < this->state.pendingCount; i++) {
+    this->state.pending[i].timestamp -= this->state.clock;
+    if (!this->clockValid) this->state.pending[i].flags |= SAMPLE_STALE;
+  }
+  return(true);
+}
+
+/**********************************************************************
+ * Returns false if we were woken early and so do not know how long we
+ * slept.
+ */
+bool SleepState::isClockValid() {
+  return(this->clockValid);
+}
+
+/**********************************************************************
+ * Returns the number of times we have woken since the last cold boot.
+ */
+unsigned long SleepState::getWakes() {
+  return(this->state.wakes);
+}
+
+void SleepState::setReference(const SAMPLE &sample) {
+  this->state.reference = sample;
+  this->state.hasReference = 1;
+}
+
+/**********************************************************************
+ * Copy the reference sample into <sample>, returning false if there
+ * isn't one.
+ */
+bool SleepState::getReference(SAMPLE &sample) {
+  if (!this->state.hasReference) return(false);
+  sample = this->state.reference;
+  return(true);
+}
+
+/**********************************************************************
+ * Replace the pending samples with the first SLEEP_STATE_PENDING_MAX
+ * of <samples>.
+ */
+void SleepState::setPending(const SAMPLE *samples, size_t count) {
+  if (count > SLEEP_STATE_PENDING_MAX) count = SLEEP_STATE_PENDING_MAX;
+  memcpy(this->state.pending, samples, (count * sizeof(SAMPLE)));
+  this->state.pendingCount = count;
+}
+
+/**********************************************************************
+ * Copy up to <max> pending samples into <samples>, returning the
+ * number copied.
+ */
+size_t SleepState::getPending(SAMPLE *samples, size_t max) {
+  size_t count = (this->state.pendingCount < max)?this->state.pendingCount:max;
+
+  memcpy(samples, this->state.pending, (count * sizeof(SAMPLE)));
+  return(count);
+}
+
+#ifdef SLEEP_STATE_SESSION_SIZE
+/**********************************************************************
+ * Replace the session with the <length> bytes at <session>, or clear
+ * it if they don't fit.
+ */
+void SleepState::setSession(const void *session, size_t length) {
+  if (length > SLEEP_STATE_SESSION_SIZE) length = 0;
+  memcpy(this->state.session, session, length);
+  this->state.sessionLength = length;
+}
+
+/**********************************************************************
+ * Copy the session into <session>, which has room for <size> bytes,
+ * returning its length or zero if there is none (or it doesn't fit).
+ */
+size_t SleepState::getSession(void *session, size_t size) {
+  if ((this->state.sessionLength == 0) || (this->state.sessionLength > size)) return(0);
+  memcpy(session, this->state.session, this->state.sessionLength);
+  return(this->state.sessionLength);
+}
+#endif
+
+/**********************************************************************
+ * Save state to RTC memory and deep sleep for <duration> milliseconds
+ * (or the hardware maximum, if less). Never returns.
+ */
+void SleepState::sleep(unsigned long duration) {
+  uint64_t maximum = (ESP.deepSleepMax() / 1000ULL);
+  uint32_t clock = this->state.clock;
+
+  if (duration > maximum) duration = maximum;
+  // Timestamps go back into the running clock, which at the moment
+  // we wake will have advanced by our uptime plus <duration>.
+  this->state.reference.timestamp += clock;
+  for (uint8_t i = 0; i < this->state.pendingCount; i++) this->state.pending[i].timestamp += clock;
+  this->state.clock = (clock + millis() + duration);
+  this->state.magic = SLEEP_STATE_MAGIC;
+  this->state.crc = crc32(((const uint8_t*) &this->state) + 8, sizeof(this->state) - 8);
+  ESP.rtcUserMemoryWrite(0, (uint32_t*) &this->state, sizeof(this->state));
+  ESP.deepSleep(duration * 1000ULL);
+  while (true) yield();
+}
+
+uint32_t SleepState::crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xffffffffUL;
+
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320UL & (0UL - (crc & 1)));
+  }
+  return(~crc);
+}
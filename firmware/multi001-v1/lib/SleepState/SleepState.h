@@ -0,0 +1,96 @@
+/**********************************************************************
+ * NAME
+ *   SleepState.h - node state which survives deep sleep.
+ * DESCRIPTION
+ *   Keeps the little a node needs to carry from one deep sleep cycle
+ *   to the next in RTC user memory, which unlike RAM is preserved
+ *   while the ESP8266 sleeps. The state comprises:
+ *
+ *   reference  The most recently published sample, against which
+ *              the next wake's readings are compared to decide if
+ *              anything has changed.
+ *
+ *   pending    Up to SLEEP_STATE_PENDING_MAX samples which have not
+ *              yet been published (a part filled batch or readings
+ *              taken while the broker was unreachable). This is as
+ *              many as fit in the rest of RTC memory, so it shrinks
+ *              as SAMPLE_MAX_PROBES grows: seven (six with MQTT_TLS)
+ *              at the default of 20 probes.
+ *
+ *   session    In builds with -D MQTT_TLS, up to SLEEP_STATE_SESSION_SIZE
+ *              bytes of TLS session (see TlsClient.h), so that each
+ *              wake can resume the previous wake's session rather
+ *              than make a full handshake. RTC memory holds only 512
+ *              bytes, so such builds carry fewer pending samples.
+ *
+ *   millis() restarts from zero on every wake, so SleepState keeps a
+ *   clock which runs on across sleep cycles and translates the
+ *   timestamps of the samples it holds into and out of it. Restored
+ *   timestamps are therefore in the current boot's millis() domain
+ *   (usually in its past, as a wrapped unsigned value) and ages and
+ *   intervals computed from them by wrap-safe differences are
+ *   correct.
+ *
+ *   The chip can be woken early by pulling RST low (for example from
+ *   a PIR or switch edge). The time spent asleep is then unknown, so
+ *   the clock is flagged invalid and restored pending samples are
+ *   marked SAMPLE_STALE.
+ *
+ *   Timer wakes require GPIO16 (D0) to be linked to RST.
+ */
+
+#ifndef SLEEP_STATE_H
+#define SLEEP_STATE_H
+
+#include <Arduino.h>
+#include <Sample.h>
+
+#define SLEEP_STATE_RTC_SIZE 512          // Bytes of RTC user memory
+#define SLEEP_STATE_HEADER_SIZE 20        // Bytes of RTC_STATE before the reference
+#ifdef MQTT_TLS
+#define SLEEP_STATE_SESSION_SIZE 88
+#define SLEEP_STATE_PENDING_MAX (((SLEEP_STATE_RTC_SIZE - SLEEP_STATE_HEADER_SIZE - SLEEP_STATE_SESSION_SIZE) / sizeof(SAMPLE)) - 1)
+#else
+#define SLEEP_STATE_PENDING_MAX (((SLEEP_STATE_RTC_SIZE - SLEEP_STATE_HEADER_SIZE) / sizeof(SAMPLE)) - 1)
+#endif
+#define SLEEP_STATE_MAGIC (0x534c0000UL | sizeof(SAMPLE))
+
+class SleepState {
+  public:
+    SleepState();
+    bool begin();
+    bool isClockValid();
+    unsigned long getWakes();
+    void setReference(const SAMPLE &sample);
+    bool getReference(SAMPLE &sample);
+    void setPending(const SAMPLE *samples, size_t count);
+    size_t getPending(SAMPLE *samples, size_t max);
+    #ifdef SLEEP_STATE_SESSION_SIZE
+    void setSession(const void *session, size_t length);
+    size_t getSession(void *session, size_t size);
+    #endif
+    void sleep(unsigned long duration);
+
+  private:
+    static uint32_t crc32(const uint8_t *data, size_t length);
+
+    struct RTC_STATE {
+      uint32_t magic;
+      uint32_t crc;                         // Of everything which follows
+      uint32_t clock;                       // Running clock at the millis() origin
+      uint32_t wakes;
+      uint8_t hasReference;
+      uint8_t pendingCount;
+      uint8_t sessionLength;
+      uint8_t reserved;
+      SAMPLE reference;
+      SAMPLE pending[SLEEP_STATE_PENDING_MAX];
+      #ifdef SLEEP_STATE_SESSION_SIZE
+      uint8_t session[SLEEP_STATE_SESSION_SIZE];
+      #endif
+    } state;
+    static_assert(sizeof(RTC_STATE) <= SLEEP_STATE_RTC_SIZE, "RTC_STATE does not fit in RTC user memory");
+    bool clockValid;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/**********************************************************************
+ * TlsClient.cpp - TLS connections with cheap reconnection.
+ */
+
+#include "TlsClient.h"
+#include <user_interface.h>
+
+TlsClient::TlsClient() {
+  this->state.mfln = TLS_CLIENT_MFLN_UNKNOWN;
+  this->state.reserved = 0;
+  this->trustAnchors = NULL;
+  this->configured = false;
+  this->connectTime = 0UL;
+  this->error[0] = 0;
+  this->setSession(&this->state.session);
+}
+
+TlsClient::~TlsClient() {
+  if (this->trustAnchors) delete this->trustAnchors;
+}
+
+/**********************************************************************
+ * Authenticate the server by the SHA-1 <fingerprint> of its
+ * certificate, given as 40 hex digits (optionally separated by spaces
+ * or colons). Returns false if <fingerprint> can't be parsed.
+ */
+bool TlsClient::useFingerprint(const char *fingerprint) {
+  this->configured = this->setFingerprint(fingerprint);
+  return(this->configured);
+}
+
+/**********************************************************************
+ * Authenticate the server against the PEM encoded CA certificate
+ * <pem>. Returns false if <pem> holds no certificate.
+ */
+bool TlsClient::useCertificate(const char *pem) {
+  if (this->trustAnchors) delete this->trustAnchors;
+  this->trustAnchors = new BearSSL::X509List(pem);
+  if (this->trustAnchors->getCount() == 0) {
+    delete this->trustAnchors;
+    this->trustAnchors = NULL;
+    return(false);
+  }
+  this->setTrustAnchors(this->trustAnchors);
+  this->configured = true;
+  return(true);
+}
+
+bool TlsClient::isConfigured() {
+  return(this->configured);
+}
+
+void TlsClient::getState(TLS_CLIENT_STATE &state) {
+  state = this->state;
+}
+
+/**********************************************************************
+ * Restore <state> saved by getState(), so that the next connection
+ * can resume its session without probing the server again.
+ */
+void TlsClient::setState(const TLS_CLIENT_STATE &state) {
+  this->state = state;
+  if (this->state.mfln > TLS_CLIENT_MFLN_UNSUPPORTED) this->state.mfln = TLS_CLIENT_MFLN_UNKNOWN;
+}
+
+/**********************************************************************
+ * Returns the number of milliseconds taken by the last connection
+ * attempt, including any probe: a few hundred for a resumed session,
+ * seconds for a full handshake.
+ */
+unsigned long TlsClient::getConnectTime() {
+  return(this->connectTime);
+}
+
+/**********************************************************************
+ * Returns the reason the last connection attempt failed, if any.
+ */
+const char *TlsClient::getError() {
+  return(this->error);
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  unsigned long start = millis();
+  uint8_t frequency = ESP.getCpuFreqMHz();
+  bool supported = false;
+
+  if (!this->prepare()) return(0);
+  system_update_cpu_freq(TLS_CLIENT_BOOST_FREQUENCY);
+  if (this->state.mfln == TLS_CLIENT_MFLN_UNKNOWN) supported = BearSSL::WiFiClientSecure::probeMaxFragmentLength(ip, port, TLS_CLIENT_BUFFER_SIZE);
+  if ((supported) || (this->state.mfln == TLS_CLIENT_MFLN_SUPPORTED)) this->setBufferSizes(TLS_CLIENT_BUFFER_SIZE, TLS_CLIENT_BUFFER_SIZE);
+  return(this->finish(BearSSL::WiFiClientSecure::connect(ip, port), supported, start, frequency));
+}
+
+int TlsClient::connect(const char *host, uint16_t port) {
+  unsigned long start = millis();
+  uint8_t frequency = ESP.getCpuFreqMHz();
+  bool supported = false;
+
+  if (!this->prepare()) return(0);
+  system_update_cpu_freq(TLS_CLIENT_BOOST_FREQUENCY);
+  if (this->state.mfln == TLS_CLIENT_MFLN_UNKNOWN) supported = BearSSL::WiFiClientSecure::probeMaxFragmentLength(host, port, TLS_CLIENT_BUFFER_SIZE);
+  if ((supported) || (this->state.mfln == TLS_CLIENT_MFLN_SUPPORTED)) this->setBufferSizes(TLS_CLIENT_BUFFER_SIZE, TLS_CLIENT_BUFFER_SIZE);
+  return(this->finish(BearSSL::WiFiClientSecure::connect(host, port), supported, start, frequency));
+}
+
+/**********************************************************************
+ * Check that a connection can be authenticated at all, returning
+ * false (with the reason in error) if not.
+ */
+bool TlsClient::prepare() {
+  time_t now = time(NULL);
+
+  this->error[0] = 0;
+  if (!this->configured) {
+    strcpy(this->error, "no fingerprint or certificate");
+    return(false);
+  }
+  if (this->trustAnchors) {
+    if (now < TLS_CLIENT_MIN_TIME) {
+      strcpy(this->error, "time not yet set");
+      return(false);
+    }
+    this->setX509Time(now);
+  }
+  return(true);
+}
+
+/**********************************************************************
+ * Restore the CPU <frequency> and record the outcome of a connection
+ * attempt begun at <start> which returned <connected>. A probe result
+ * (<supported>) is only kept once a connection succeeds, since a
+ * probe of an unreachable server fails too.
+ */
+int TlsClient::finish(int connected, bool supported, unsigned long start, uint8_t frequency) {
+  system_update_cpu_freq(frequency);
+  this->connectTime = (millis() - start);
+  if (connected) {
+    if (this->state.mfln == TLS_CLIENT_MFLN_UNKNOWN) this->state.mfln = (supported)?TLS_CLIENT_MFLN_SUPPORTED:TLS_CLIENT_MFLN_UNSUPPORTED;
+  } else {
+    this->getLastSSLError(this->error, sizeof(this->error));
+  }
+  return(connected);
+}
@@ -0,0 +1,84 @@
+/**********************************************************************
+ * NAME
+ *   TlsClient.h - TLS connections with cheap reconnection.
+ * DESCRIPTION
+ *   A BearSSL::WiFiClientSecure which keeps the cost of reconnecting
+ *   to the same server low. A full TLS handshake costs the ESP8266
+ *   seconds of CPU (and the radio stays up throughout), and the
+ *   default buffers take some 17KB of heap. So:
+ *
+ *   - The session negotiated by each connection is kept and offered
+ *     to the server on the next, so that a reconnection normally
+ *     resumes it and does no public key arithmetic at all. The
+ *     session (see TLS_CLIENT_STATE) can also be saved and restored
+ *     by the caller, for example across deep sleep.
+ *
+ *   - Before the first connection, the server is probed for maximum
+ *     fragment length negotiation. If it is supported, the buffers
+ *     are reduced to TLS_CLIENT_BUFFER_SIZE bytes each. The outcome
+ *     of the probe is remembered (and saved with the session), so it
+ *     is only repeated once per server.
+ *
+ *   - Connections are made with the CPU at 160MHz, which halves the
+ *     duration of any full handshake.
+ *
+ *   The server is authenticated either by the SHA-1 fingerprint of
+ *   its certificate (useFingerprint()), which needs no clock, or
+ *   against a pinned CA certificate (useCertificate()), which needs
+ *   the time of day: until it is set (by SNTP, say) connection
+ *   attempts fail without touching the network. A client which has
+ *   been given neither never connects.
+ */
+
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiClientSecure.h>
+#include <time.h>
+
+#define TLS_CLIENT_BUFFER_SIZE 512        // Negotiated maximum fragment length
+#define TLS_CLIENT_MIN_TIME 1700000000L   // Earliest plausible time of day
+#define TLS_CLIENT_BOOST_FREQUENCY 160    // MHz during a connection
+
+#define TLS_CLIENT_MFLN_UNKNOWN 0
+#define TLS_CLIENT_MFLN_SUPPORTED 1
+#define TLS_CLIENT_MFLN_UNSUPPORTED 2
+
+/**********************************************************************
+ * What a TlsClient remembers from one connection to the next.
+ */
+struct TLS_CLIENT_STATE {
+  uint8_t mfln;                           // One of the TLS_CLIENT_MFLN_ values
+  uint8_t reserved;
+  BearSSL::Session session;
+};
+
+class TlsClient : public BearSSL::WiFiClientSecure {
+  public:
+    TlsClient();
+    ~TlsClient();
+    bool useFingerprint(const char *fingerprint);
+    bool useCertificate(const char *pem);
+    bool isConfigured();
+    void getState(TLS_CLIENT_STATE &state);
+    void setState(const TLS_CLIENT_STATE &state);
+    unsigned long getConnectTime();
+    const char *getError();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+
+  private:
+    bool prepare();
+    int finish(int connected, bool supported, unsigned long start, uint8_t frequency);
+
+    TLS_CLIENT_STATE state;
+    BearSSL::X509List *trustAnchors;
+    bool configured;
+    unsigned long connectTime;            // Milliseconds taken by the last connection
+    char error[64];
+};
+
+#endif
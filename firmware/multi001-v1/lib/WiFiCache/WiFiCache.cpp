@@ -0,0 +1,115 @@
+/**********************************************************************
+ * WiFiCache.cpp - fast WiFi reconnection from cached network details.
+ */
+
+#include "WiFiCache.h"
+
+/**********************************************************************
+ * Create a cache which is persisted at <address> in EEPROM.
+ */
+WiFiCache::WiFiCache(int address) {
+  this->address = address;
+  memset(&this->data, 0, sizeof(this->data));
+}
+
+/**********************************************************************
+ * Read the cache from EEPROM, discarding it if it is not valid.
+ */
+void WiFiCache::load() {
+  EEPROM.begin(WIFI_CACHE_EEPROM_SIZE);
+  EEPROM.get(this->address, this->data);
+  EEPROM.end();
+  if (!this->isValid()) memset(&this->data, 0, sizeof(this->data));
+}
+
+bool WiFiCache::isValid() {
+  return((this->data.magic == WIFI_CACHE_MAGIC) && (this->data.checksum == this->computeChecksum()) && (this->data.channel != 0));
+}
+
+/**********************************************************************
+ * Start a connection to the cached access point, statically
+ * configuring the interface from the cache if <useStaticIp> is true.
+ * Returns immediately, or returns false if there is no valid cache.
+ */
+bool WiFiCache::begin(bool useStaticIp) {
+  if (!this->isValid()) return(false);
+  // Don't let the SDK rewrite its saved station configuration just
+  // because we have specified a BSSID.
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  if ((useStaticIp) && (this->data.ip != 0)) {
+    WiFi.config(IPAddress(this->data.ip), IPAddress(this->data.gateway), IPAddress(this->data.subnet), IPAddress(this->data.dns));
+  }
+  WiFi.begin(WiFi.SSID().c_str(), WiFi.psk().c_str(), this->data.channel, this->data.bssid);
+  return(true);
+}
+
+/**********************************************************************
+ * Connect to the cached access point and wait up to <timeout>
+ * milliseconds for the connection to be made. Returns true if we are
+ * connected. If not, the cache is invalidated and the WiFi interface
+ * restored to its normal configuration.
+ */
+bool WiFiCache::connect(bool useStaticIp, unsigned long timeout) {
+  unsigned long start = millis();
+  wl_status_t status = WL_IDLE_STATUS;
+
+  if (!this->begin(useStaticIp)) return(false);
+  while (((millis() - start) < timeout) && ((status = WiFi.status()) != WL_CONNECTED)) {
+    if ((status == WL_NO_SSID_AVAIL) || (status == WL_CONNECT_FAILED) || (status == WL_WRONG_PASSWORD)) break;
+    delay(10);
+  }
+  if (status == WL_CONNECTED) return(true);
+
+  WiFi.disconnect();
+  WiFi.config(IPAddress((uint32_t) 0), IPAddress((uint32_t) 0), IPAddress((uint32_t) 0));
+  WiFi.persistent(true);
+  this->invalidate();
+  return(false);
+}
+
+/**********************************************************************
+ * Cache the details of the current connection if they differ from
+ * those already cached.
+ */
+void WiFiCache::update() {
+  WIFI_CACHE_DATA previous = this->data;
+
+  if (WiFi.status() != WL_CONNECTED) return;
+  memcpy(this->data.bssid, WiFi.BSSID(), sizeof(this->data.bssid));
+  this->data.channel = WiFi.channel();
+  this->data.ip = (uint32_t) WiFi.localIP();
+  this->data.gateway = (uint32_t) WiFi.gatewayIP();
+  this->data.subnet = (uint32_t) WiFi.subnetMask();
+  this->data.dns = (uint32_t) WiFi.dnsIP();
+  this->data.magic = WIFI_CACHE_MAGIC;
+  this->data.checksum = this->computeChecksum();
+  if (memcmp(&previous, &this->data, sizeof(this->data)) != 0) this->save();
+}
+
+/**********************************************************************
+ * Forget the cached details, so that the next connection is made the
+ * slow way.
+ */
+void WiFiCache::invalidate() {
+  if (this->data.magic == 0) return;
+  memset(&this->data, 0, sizeof(this->data));
+  this->save();
+}
+
+void WiFiCache::save() {
+  EEPROM.begin(WIFI_CACHE_EEPROM_SIZE);
+  EEPROM.put(this->address, this->data);
+  EEPROM.commit();
+  EEPROM.end();
+}
+
+uint8_t WiFiCache::computeChecksum() {
+  const uint8_t *p = (const uint8_t*) &this->data;
+  uint8_t sum = 0xa5;
+
+  for (size_t i = 0; i < sizeof(this->data); i++) {
+    if (&p[i] != &this->data.checksum) sum = ((sum << 1) | (sum >> 7)) ^ p[i];
+  }
+  return(sum);
+}
@@ -0,0 +1,62 @@
+/**********************************************************************
+ * NAME
+ *   WiFiCache.h - fast WiFi reconnection from cached network details.
+ * DESCRIPTION
+ *   A normal connection to the host network begins with a scan of
+ *   every channel and ends with a DHCP exchange, which together take
+ *   seconds. WiFiCache saves the BSSID and channel of the access point
+ *   (and the address, gateway, netmask and DNS server assigned to us)
+ *   in EEPROM after a successful connection, so that later boots can
+ *   go straight to the right access point on the right channel and,
+ *   optionally, configure the interface statically.
+ *
+ *   The SSID and password are not cached: the SDK already persists
+ *   them. If a fast connection fails, then the cache is invalidated
+ *   and DHCP re-enabled so that the caller can fall back to a normal
+ *   connection.
+ *
+ *   The cache is only rewritten when something has changed, so it
+ *   costs nothing in flash wear once a node has settled.
+ */
+
+#ifndef WIFI_CACHE_H
+#define WIFI_CACHE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <EEPROM.h>
+
+#define WIFI_CACHE_MAGIC 0x5743
+#define WIFI_CACHE_EEPROM_SIZE 512
+
+class WiFiCache {
+  public:
+    WiFiCache(int address);
+    void load();
+    bool isValid();
+    bool begin(bool useStaticIp);
+    bool connect(bool useStaticIp, unsigned long timeout);
+    void update();
+    void invalidate();
+
+  private:
+    struct WIFI_CACHE_DATA {
+      uint16_t magic;
+      uint8_t channel;
+      uint8_t checksum;
+      uint8_t bssid[6];
+      uint8_t reserved[2];
+      uint32_t ip;
+      uint32_t gateway;
+      uint32_t subnet;
+      uint32_t dns;
+    };
+
+    void save();
+    uint8_t computeChecksum();
+
+    int address;
+    WIFI_CACHE_DATA data;
+};
+
+#endif
@@ -0,0 +1,15 @@
+# Write a gzip compressed copy of the firmware image alongside it, for
+# over-the-air updates (see lib/OtaUpdater/OtaUpdater.h).
+
+import gzip
+import shutil
+
+Import("env")
+
+def compress_firmware(source, target, env):
+    image = str(target[0])
+    with open(image, "rb") as src, gzip.open(image + ".gz", "wb", compresslevel=9) as dst:
+        shutil.copyfileobj(src, dst)
+    print("Compressed %s to %s.gz" % (image, image))
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", compress_firmware)
@@ -0,0 +1,36 @@
+# Report how each build uses memory, writing firmware.size.txt
+# alongside the image. Static RAM (initialised data, constants and
+# zeroed data) comes out of the 80KB of DRAM and whatever is left is
+# roughly the heap available at boot, before the SDK and the network
+# stack take their share.
+
+import subprocess
+
+Import("env")
+
+DRAM_SIZE = 81920
+DRAM_SECTIONS = (".data", ".rodata", ".bss")
+IRAM_SECTIONS = (".text", ".iram0.text")
+FLASH_SECTIONS = (".irom0.text",)
+
+def report_size(source, target, env):
+    elf = str(source[0])
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-A", elf]).decode()
+    sizes = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if (len(fields) >= 2) and fields[0].startswith(".") and fields[1].isdigit():
+            sizes[fields[0]] = int(fields[1])
+    dram = sum(sizes.get(s, 0) for s in DRAM_SECTIONS)
+    lines = ["%s (%s)" % (env.subst("$PIOENV"), elf)]
+    lines += ["  %-12s %7d" % (s, sizes.get(s, 0)) for s in (DRAM_SECTIONS + IRAM_SECTIONS + FLASH_SECTIONS)]
+    lines.append("  static RAM   %7d of %d" % (dram, DRAM_SIZE))
+    lines.append("  heap at most %7d" % (DRAM_SIZE - dram))
+    lines.append("  IRAM         %7d" % sum(sizes.get(s, 0) for s in IRAM_SECTIONS))
+    lines.append("  flash        %7d" % sum(sizes.get(s, 0) for s in FLASH_SECTIONS))
+    report = "\n".join(lines)
+    with open(env.subst("$BUILD_DIR/firmware.size.txt"), "w") as f:
+        f.write(report + "\n")
+    print(report)
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_size)
@@ -0,0 +1,2322 @@
+/*********************************************************************
+ * NAME
+ *   multi001-v1.cpp - multi-sensor wireless MQTT node.
+ * PLATFORM
+ *   ESP8266/Wemos MINI-D1
+ * SENSORS
+ *   AM2320/AM2322 (I2C humidity and temperature)
+ *   DS18B20 (one-wire temperature)
+ *   Analogue illumination (luxControl SmartDim Sensor 2)
+ *   PIR motion (luxControl SmartDim Sensor 2)
+ *   SPST switches (up to 4)
+ * DESCRIPTION
+ *   This firmware implements an IoT MQTT client which reports sensor
+ *   data from SPST switches and a range of devices connected to the
+ *   host microcontroller over I2C or one-wire busses or to its GPIO
+ *   and analogue inputs.
+ *
+ *   Support for each kind of sensor is provided by a driver (see
+ *   lib/SensorDriver/SensorDriver.h) and only those drivers which are
+ *   enabled by the build flags below are compiled into the firmware.
+ *   Enabled sensors are sampled side by side, so a slow bus never holds
+ *   up a fast one. The build environments in platformio.ini select the
+ *   sensor complement of each of our hardware variants.
+ *
+ *   FLAG                   EFFECT
+ *   SENSOR_AM2322          Enable the AM2320/AM2322 driver
+ *   SENSOR_DS18B20         Enable the DS18B20 driver
+ *   DS18B20_AS_TEMPERATURE Report the first DS18B20 as "temperature"
+ *   SENSOR_LUX             Enable the illumination driver
+ *   SENSOR_PIR             Enable the PIR motion driver
+ *   SWITCH_COUNT=n         Monitor n SPST switches (default 2)
+ *   GPIO_...=n             Override the default pin assignments
+ *
+ *   The generated MQTT message is a JSON object with properties
+ *   reflecting data harvested from one or more of the following
+ *   sensors.
+ * 
+ *   1. SPST switches
+ *      Up to four active-low SPST switches can be connected to
+ *      GPIO14(D5), GPIO12(D6), GPIO13(D7) and GPIO15(D8). A property
+ *      is always included in the output message for each configured
+ *      switch (note that the reported property names can be overriden
+ *      during module configuration).
+ * 
+ *      PROPERTY            VALUE
+ *      sw0 (or alias)      Integer boolean 0 or 1 (OFF or ON) 
+ *      sw1 (or alias)      Integer boolean 0 or 1 (OFF or ON)
+ *      ...
+ * 
+ *   2. AM2320 humidity & temperature
+ *      
+ *      A single sensor of this type can be connected to the I2C bus
+ *      on GPIO5(D1/SCL) and GPIO4(D2/SDA). The sensor is automatically
+ *      detected and no user configuration is required. Presence of the
+ *      sensor adds the following properties to the output message.
+ *      
+ *      PROPERTY            VALUE
+ *      humidity            Percent in the range 0..100 (to 0.1)
+ *      temperature         Celsius in the range -40..80 (to 0.01)
+ * 
+ *   3. DS18B20 temperature sensors
+ * 
+ *      An arbitrary number of sensors of this type can be connected to
+ *      the one-wire bus on GPIO13(D7). Sensors are automatically
+ *      detected and no user configuration is required. Each detected
+ *      sensor adds a property of the following form to the output
+ *      message. GPIO13 is also the third switch input, so a build with
+ *      more than two switches must move the bus with GPIO_ONE_WIRE_BUS.
+ * 
+ *      PROPERTY             VALUE
+ *      DS-address           Celsius in the range -40..120 (to 0.01)
+ *
+ *      If DS18B20_AS_TEMPERATURE is defined then the first sensor is
+ *      instead reported as the "temperature" property.
+ * 
+ *      The bus is searched once at start up and the address of each
+ *      sensor (up to DS18B20_SAMPLER_MAX_DEVICES) cached, so sampling
+ *      even a long string of sensors costs one conversion and one
+ *      read per sensor. Sensors added or removed later are picked up
+ *      by a periodic rescan, even if none were present at start up.
+ *      At most SAMPLE_MAX_PROBES (by default 20) sensors are reported.
+ *      Each adds two bytes to every sample held in RAM, flash and, in
+ *      sleep mode, RTC memory (where fewer pending samples then fit),
+ *      so nodes with fewer can lower it as a build flag.
+ *
+ *   4. Illumination and motion
+ *
+ *      A luxControl SmartDim Sensor 2 can be connected to A0 (light
+ *      level) and GPIO16(D0) (PIR output). These add the following
+ *      properties to the output message.
+ *
+ *      The light level is oversampled (by default ten times a second,
+ *      see LUX_SAMPLE_INTERVAL) and the reported value is the average
+ *      of the last 16 readings.
+ *
+ *      PROPERTY             VALUE
+ *      lux                  Integer in the range 0..1023
+ *      motion               Integer boolean 0 or 1
+ *  
+ *   A JSON object containing properties relating to detected and/or
+ *   configured sensors are published to a user defined topic on a user
+ *   configured MQTT server (see CONFIGURATION below).
+ * 
+ *   The value 999, meaning undefined, is published to indicate that
+ *   reading a detected or configured sensor failed for whatever reason.
+ * 
+ *   The sensors are sampled once every sample interval (by default the
+ *   soft interval). The defined MQTT topic is updated whenever a sensor
+ *   value changes or once every hard interval (by default 30 seconds).
+ *   The maximum update rate is once every soft interval (by default
+ *   three seconds).
+ * 
+ *   Any change in switch state, the start and end of detected motion and
+ *   any change in a temperature, humidity or lux value of at least its
+ *   configured deadband from the value last published results in an
+ *   immediate update, subject to the maximum update rate. Changes in
+ *   the kinds of channel configured as immediate are published without
+ *   waiting for the soft interval. Readings can optionally be smoothed
+ *   (see CONFIGURATION below) before they are compared or published.
+ * 
+ *   Whenever a connection to the MQTT server is (re-)established the
+ *   module publishes connection statistics to the subtopic
+ *   'connection'. Failed connection attempts are retried with a
+ *   randomised exponential backoff of up to five minutes.
+ * 
+ *   Sensor data which falls due for publication while the module is
+ *   not connected to the MQTT server is queued (in RAM, overflowing
+ *   into flash) and forwarded once the connection is restored. Queued
+ *   samples are published in batches to the subtopic 'backlog' as a
+ *   JSON array of objects, each of which includes an "age" property
+ *   giving the number of milliseconds since the sample was taken.
+ *   Values in these objects are reported with their full fixed-point
+ *   precision.
+ * 
+ *   If a batch size of two or more is configured then, rather than
+ *   being published individually, samples are accumulated and
+ *   published as a single JSON array of sample objects (in the same
+ *   form as backlog samples) to the subtopic 'batch' whenever the
+ *   batch is full or its oldest sample is older than the batch window.
+ * 
+ *   JSON messages are streamed directly into the MQTT client as they
+ *   are generated rather than being assembled in RAM first, so their
+ *   size is not limited by any fixed buffer. This matters when many
+ *   DS18B20 probes each contribute a property.
+ * 
+ *   If channel topics are configured then, instead of the JSON object,
+ *   each channel is published as a retained scalar value to a subtopic
+ *   of its own named after its property (for example 'sw0' or
+ *   'temperature'). Only channels whose values have changed since they
+ *   were last published are sent, except that every channel is sent on
+ *   the first publication after each connection to the server and as
+ *   the hard interval heartbeat. The subtopic of a channel which
+ *   disappears (such as a disconnected DS18B20) is cleared. Batches and
+ *   backlog are still published as JSON arrays.
+ * 
+ *   If reliable delivery is configured then the status, batch and
+ *   backlog messages are published at QoS 1 and each is held until the
+ *   server acknowledges it. Up to four messages may await
+ *   acknowledgement at once, so the backlog drains without waiting for
+ *   each acknowledgement in turn. A message which is not acknowledged
+ *   within ten seconds is resent, and one which is still
+ *   unacknowledged after four attempts or when the connection is lost
+ *   rejoins the store-and-forward queue, so a sample may occasionally
+ *   be delivered twice but is never silently lost. Channel topics and
+ *   the binary copy of a JSON message remain QoS 0.
+ * 
+ *   If a binary payload format is configured then each sample, batch
+ *   or backlog is also (or instead) published as a compact binary
+ *   frame (see lib/Sample/SampleCodec.h) to the subtopic 'bin' of the
+ *   topic which would carry the JSON message. In a binary frame
+ *   temperatures are int16 hundredths of a degree, humidity is int16
+ *   tenths of a percent and switch states are a bitfield.
+ * 
+ *   If a sleep interval is configured then the module operates in a
+ *   low power mode, spending most of its time in deep sleep. On each
+ *   wake it takes a single sample, publishes it if the rules above say
+ *   so and goes back to sleep. The most recently published values
+ *   (against which changes are detected) and any samples which have
+ *   yet to be published are carried from one wake to the next in RTC
+ *   memory. Timer wakes require GPIO16(D0) to be linked to RST; switch
+ *   edges can wake the module early if they are coupled (as a short
+ *   low pulse) to RST.
+ * 
+ *   Firmware built with -D MQTT_TLS connects to the MQTT server over
+ *   TLS (by default on port 8883), authenticating the server by the
+ *   configured fingerprint of its certificate or against a pinned CA
+ *   certificate (see CONFIGURATION below). To keep reconnection cheap
+ *   the TLS session is resumed from one connection to the next (and,
+ *   in sleep mode, from one wake to the next), so only the first
+ *   connection after a cold boot pays for a full handshake, and the
+ *   TLS buffers are reduced to 512 bytes if the server supports
+ *   maximum fragment length negotiation (see lib/TlsClient/TlsClient.h).
+ * 
+ *   After each successful connection to the host network the module
+ *   caches the BSSID and channel of the access point (and its assigned
+ *   IP configuration) in EEPROM. Unless fast connect is disabled, later
+ *   boots use these to reconnect without a scan (and, if so configured,
+ *   without DHCP) and only fall back to a normal connection, or to the
+ *   configuration portal, if that fails.
+ * 
+ *   If a rollup window is configured then, alongside the publications
+ *   above, the module summarises every channel over each window and
+ *   publishes the summary to the subtopic 'stats', so that a trend
+ *   needs one message per minute or hour rather than every sample.
+ *   Temperature, humidity, lux and each DS18B20 probe have the
+ *   minimum, maximum and mean of the readings taken at each sample
+ *   interval; motion and each switch have the percentage of the
+ *   window for which they were on and the number of times they
+ *   changed (see lib/SampleRollup/SampleRollup.h for the format). A
+ *   summary which cannot be published is extended until it can be.
+ *   Rollups are not available in sleep mode.
+ * 
+ *   Once per boot, after the first successful publication of sensor
+ *   data, the module publishes the reason for its last reset and the
+ *   time (in microseconds since reset) at which each phase of start up
+ *   completed to the subtopic 'boot' as a JSON object of the form:
+ * 
+ *     '{ "reason": r, "phases": { "serial": t, "config": t, ... } }'
+ * 
+ *   The firmware's work is divided into tasks (MQTT housekeeping,
+ *   polling each sensor, publication and so on) which are run by a
+ *   cooperative scheduler. Every five minutes the module publishes
+ *   the run count, overrun count and total and maximum run time (in
+ *   microseconds) of each task over the preceding period to the
+ *   subtopic 'tasks' as a JSON object of the form:
+ * 
+ *     '{ "mqtt": { "runs": n, "overruns": n, "total": t, "max": t }, ... }'
+ * 
+ *   Every minute the module publishes run time metrics to the subtopic
+ *   'metrics': free heap, heap fragmentation, WiFi signal strength,
+ *   MQTT connection and publication counts and histograms of loop()
+ *   iteration time and of the delay between taking a sample and
+ *   publishing it (see lib/Metrics/Metrics.h for the format).
+ * 
+ *   Firmware built with -D PROFILER also times the blocking calls on
+ *   the hot path (sensor reads, DS18B20 conversion requests, JSON
+ *   measurement, MQTT publication and housekeeping) with the CPU cycle
+ *   counter. Every minute it publishes the number of calls and the
+ *   minimum, mean and maximum cycles of each to the subtopic 'profile'
+ *   (see lib/Profiler/Profiler.h for the format).
+ * 
+ * CONFIGURATION
+ * 
+ * On first use (and also when the device is unable to connect to a
+ * previously configured wireless network) the device will operate as
+ * an open wireless access point with the SSID "MULTISENSOR-xxxxxxxxxxxx",
+ * where "xxxxxxxxxxxx" is the MAC address of the host wireless
+ * interface.
+ * 
+ * Connection to this access point will open a captive portal that
+ * allows the user to configure the following properties:
+ * 
+ * network                 The SSID of the host network to which the
+ *                         device should connect.
+ * 
+ * password                The password (if any) required to connect to
+ *                         specified host network.
+ * 
+ * server name             The name or IP address of the MQTT server to
+ *                         which status updates should be sent.
+ * 
+ * server port             The port on which the server listens (default
+ *                         1886, or 8883 in TLS builds).
+ * 
+ * username                The login user name required for access to
+ *                         server name.
+ * 
+ * password                The login password for username.
+ * 
+ * topic                   The topic on which to publish data.
+ * 
+ * sw0 alias               A JSON property name to be used instead of
+ *                         the default (sw0)
+ *
+ * sw1 alias               A JSON property name to be used instead of
+ *                         the default (sw1)
+ *
+ * sw2 alias, sw3 alias    As above, for builds with more than two
+ *                         switches.
+ * 
+ * soft interval           The minimum number of milliseconds between
+ *                         updates (default 3000).
+ * 
+ * hard interval           The maximum number of milliseconds between
+ *                         updates (default 30000).
+ * 
+ * sample interval         The number of milliseconds between sensor
+ *                         samples (default 0, meaning the soft
+ *                         interval).
+ * 
+ * channel topics          0 to publish the status as a JSON object, 1 to
+ *                         publish changed channels to subtopics of
+ *                         their own (default 0).
+ * 
+ * reliable delivery       0 to publish samples at QoS 0, 1 to publish
+ *                         them at QoS 1 and resend anything which is
+ *                         not acknowledged (default 0).
+ * 
+ * rollup window           The number of milliseconds summarised by each
+ *                         publication to the stats subtopic: 0, or
+ *                         10000 to 86400000 (default 0, meaning no
+ *                         rollups).
+ * 
+ * immediate channels      The sum of the kinds of change which are
+ *                         published without waiting for the soft
+ *                         interval: 1 temperature, 2 humidity, 4 lux,
+ *                         8 motion, 16 switches, 32 DS18B20 probes
+ *                         (default 0, none).
+ * 
+ * batch size              The number of samples to publish together
+ *                         (default 0, meaning no batching).
+ * 
+ * batch window            The maximum number of milliseconds for which
+ *                         a sample may be held in a batch (default
+ *                         60000).
+ * 
+ * payload format          0 to publish JSON, 1 to publish JSON and
+ *                         binary, 2 to publish binary (default 0).
+ * 
+ * sleep interval          The number of milliseconds to deep sleep
+ *                         between wakes (default 0, meaning never
+ *                         sleep).
+ * 
+ * fast connect            0 to always scan for the host network, 1 to
+ *                         reconnect to the cached access point, 2 to
+ *                         also reuse the cached IP configuration rather
+ *                         than use DHCP (default 1).
+ * 
+ * smoothing               0 to publish the latest sensor readings, 1 to
+ *                         publish a moving average or 2 to publish the
+ *                         median of the last three readings (default 0).
+ * 
+ * temperature deadband    The change in any temperature, in hundredths
+ *                         of a degree, from the value last published
+ *                         which triggers an update (default 50, 0 for
+ *                         never).
+ * 
+ * humidity deadband       The change in humidity, in tenths of a
+ *                         percent, which triggers an update (default 10,
+ *                         0 for never).
+ * 
+ * lux deadband            The change in illumination level which
+ *                         triggers an update (default 0, never).
+ * 
+ * ota manifest url        The http URL of the firmware update manifest
+ *                         (default none, meaning no updates).
+ * 
+ * tls fingerprint         In TLS builds only, the SHA-1 fingerprint of
+ *                         the MQTT server's certificate as 40 hex digits
+ *                         (optionally separated by colons). If none is
+ *                         given then the server is instead checked
+ *                         against the CA certificate in /ca.pem on the
+ *                         flash filesystem, which requires the time of
+ *                         day from pool.ntp.org. With neither, the
+ *                         module will not connect.
+ * 
+ * ds18b20 resolution      The resolution, in bits, of DS18B20
+ *                         conversions: 9 (0.5C, 94ms), 10 (0.25C,
+ *                         188ms), 11 (0.125C, 375ms) or 12 (0.0625C,
+ *                         750ms) (default 12).
+ * 
+ * When the configuration is saved the device will immediately reboot
+ * and attempt to enter production with the specified configuration.
+ * 
+ * The portal is only started when the device cannot connect from its
+ * cache, and its fields are kept in flash and copied into RAM only
+ * whilst it runs, so a device in production carries none of its
+ * state.
+ * 
+ * Once in production, the intervals, immediate channels, smoothing,
+ * deadbands, DS18B20 resolution and rollup window can also be changed
+ * by publishing a command to the subtopic 'cmd'. A command is a list
+ * of words separated by spaces or semicolons, each either a setting of
+ * the form 'name=value' (the names are those of the portal fields:
+ * softinterval, hardinterval, sampleinterval, immediatechannels,
+ * filtermode, temperaturedeadband, humiditydeadband, luxdeadband,
+ * ds18b20resolution and rollupwindow) or one of the actions 'sample'
+ * (sample the sensors now), 'publish' (publish the status as soon as
+ * possible), 'rescan' (search the one-wire bus for added or removed
+ * DS18B20 devices), 'update' (see below) and 'reboot'. For example:
+ * 
+ *     'softinterval=5000 hardinterval=60000 sample'
+ * 
+ * A command which contains anything not understood, or a value out
+ * of range, is rejected as a whole. Otherwise its settings take effect
+ * immediately and are saved as if entered in the portal. The outcome
+ * is published to the subtopic 'cmd/result' as a JSON object of the
+ * form '{ "result": "ok"|"error", "command": "<rejected word>" }' and
+ * the command topic is cleared, so a command published as retained
+ * runs only once. Anyone able to publish to the command topic can
+ * reconfigure the module, so access to it should be restricted by
+ * the server.
+ * 
+ * The 'update' command (accepted only if an OTA manifest URL is
+ * configured) makes the module check the manifest for a different
+ * version of its firmware and, if there is one, download it over HTTP,
+ * install it and restart. Unless the module sleeps, the check happens
+ * at a random time within five minutes of the command, so that a
+ * whole fleet can be told to update without every node downloading at
+ * once. The outcome is published to the subtopic 'ota' as a JSON
+ * object of the form:
+ * 
+ *     '{ "build": b, "version": v, "available": v, "result": r, "error": e }'
+ * 
+ * where result is "current", "updated" or "failed". The manifest
+ * format is described in lib/OtaUpdater/OtaUpdater.h; each build
+ * writes a gzip compressed copy of its image (firmware.bin.gz) which
+ * takes less time to download than the uncompressed image.
+ * 
+ * The configuration is held in EEPROM as a versioned, CRC-checked list
+ * of tagged values and is only rewritten when it changes. A
+ * configuration saved by older firmware is converted on first boot.
+ */
+ 
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include <WiFiManager.h>
+#include <EEPROM.h>
+#include <ConfigStore.h>
+#include <SensorDriver.h>
+#include <SensorSet.h>
+#include <SampleFilter.h>
+#ifdef SENSOR_AM2322
+#include <Wire.h>
+#include <AM2322Driver.h>
+#endif
+#ifdef SENSOR_DS18B20
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <DS18B20Driver.h>
+#endif
+#ifdef SENSOR_LUX
+#include <LuxDriver.h>
+#endif
+#include <InputDriver.h>
+#include <PublishPolicy.h>
+#include <Pipeline.h>
+#include <MqttReconnector.h>
+#include <Sample.h>
+#include <SampleCodec.h>
+#include <SampleStore.h>
+#include <SampleBatch.h>
+#include <SampleRollup.h>
+#include <SleepState.h>
+#include <WiFiCache.h>
+#include <BootProfile.h>
+#include <Scheduler.h>
+#include <Metrics.h>
+#include <QosClient.h>
+#include <InflightWindow.h>
+#include <OtaUpdater.h>
+#include <Profiler.h>
+#ifdef MQTT_TLS
+#include <LittleFS.h>
+#include <TlsClient.h>
+#endif
+
+#define FIRMWARE_VERSION "1.1.0"          // Compared with the OTA manifest
+#ifndef FIRMWARE_BUILD
+#define FIRMWARE_BUILD "d1_mini"          // Normally the build environment
+#endif
+
+#define DEBUG_SERIAL                      // Enable debug messages
+#define DEBUG_SERIAL_START_DELAY 2000     // Milliseconds wait before output
+
+// Sensor complement. Normally set by the build environment.
+#ifndef SWITCH_COUNT
+#define SWITCH_COUNT 2                    // Number of SPST switches
+#endif
+#if (SWITCH_COUNT < 0) || (SWITCH_COUNT > 4)
+#error "SWITCH_COUNT must be in the range 0..4"
+#endif
+#if !defined(SENSOR_AM2322) && !defined(SENSOR_DS18B20) && !defined(SENSOR_LUX) && !defined(SENSOR_PIR) && (SWITCH_COUNT == 0)
+#error "No sensors are enabled"
+#endif
+
+#ifndef GPIO_SCL
+#define GPIO_SCL 5                        // D1 - I2C SCL
+#endif
+#ifndef GPIO_SDA
+#define GPIO_SDA 4                        // D2 - I2C SDA
+#endif
+#ifndef GPIO_ONE_WIRE_BUS
+#define GPIO_ONE_WIRE_BUS 13              // D7 - For Dallas temperature sensors
+#endif
+#ifndef GPIO_SW0
+#define GPIO_SW0 14                       // D5 - SPST switch
+#endif
+#ifndef GPIO_SW1
+#define GPIO_SW1 12                       // D6 - SPST switch
+#endif
+#ifndef GPIO_SW2
+#define GPIO_SW2 13                       // D7 - SPST switch
+#endif
+#ifndef GPIO_SW3
+#define GPIO_SW3 15                       // D8 - SPST switch
+#endif
+#ifndef GPIO_PIR_SENSOR
+#define GPIO_PIR_SENSOR 16                // D0 - PIR output (polled)
+#endif
+#ifndef GPIO_LUX_SENSOR
+#define GPIO_LUX_SENSOR A0                // A0 - Light level
+#endif
+#if defined(SENSOR_DS18B20) && (((SWITCH_COUNT > 0) && (GPIO_SW0 == GPIO_ONE_WIRE_BUS)) || ((SWITCH_COUNT > 1) && (GPIO_SW1 == GPIO_ONE_WIRE_BUS)) || ((SWITCH_COUNT > 2) && (GPIO_SW2 == GPIO_ONE_WIRE_BUS)) || ((SWITCH_COUNT > 3) && (GPIO_SW3 == GPIO_ONE_WIRE_BUS)))
+#error "GPIO_ONE_WIRE_BUS is also a switch input: move it (e.g. GPIO_ONE_WIRE_BUS=4) or use fewer switches"
+#endif
+
+#define MODULE_ID_FORMAT "MULTISENSOR-%02x%02x%02x%02x%02x%02x"
+
+// User configuration access-point settings
+#define AP_PORTAL_TIMEOUT 180
+
+// User configuration property settings and defaults
+#define CF_DEFAULT_MQTT_TOPIC_FORMAT "multisensor/%s"
+#ifdef MQTT_TLS
+#define CF_DEFAULT_MQTT_SERVICE_PORT 8883
+#else
+#define CF_DEFAULT_MQTT_SERVICE_PORT 1886
+#endif
+#define CF_DEFAULT_PROPERTY_NAME_FOR_SW0 "sw0"
+#define CF_DEFAULT_PROPERTY_NAME_FOR_SW1 "sw1"
+#define CF_DEFAULT_PROPERTY_NAME_FOR_SW2 "sw2"
+#define CF_DEFAULT_PROPERTY_NAME_FOR_SW3 "sw3"
+#define CF_DEFAULT_MQTT_PUBLISH_SOFT_INTERVAL 3000
+#define CF_DEFAULT_MQTT_PUBLISH_HARD_INTERVAL 30000
+#define CF_DEFAULT_SAMPLE_INTERVAL 0      // Milliseconds (0 = soft interval)
+#define CF_DEFAULT_IMMEDIATE_CHANNELS 0   // SAMPLE_CHANNEL_ bits
+#define CF_DEFAULT_CHANNEL_TOPICS 0
+#define CF_DEFAULT_MQTT_RELIABLE 0
+#define CF_DEFAULT_ROLLUP_WINDOW 0
+#define CF_MIN_ROLLUP_WINDOW 10000
+#define CF_MAX_ROLLUP_WINDOW 86400000
+#define CF_DEFAULT_MQTT_BATCH_SIZE 0
+#define CF_DEFAULT_MQTT_BATCH_WINDOW 60000
+#define CF_DEFAULT_MQTT_PAYLOAD_FORMAT MQTT_PAYLOAD_JSON
+#define CF_DEFAULT_SLEEP_INTERVAL 0
+#define CF_DEFAULT_WIFI_FAST_CONNECT WIFI_FAST_CONNECT_BSSID
+#define CF_DEFAULT_FILTER_MODE SAMPLE_FILTER_NONE
+#define CF_DEFAULT_TEMPERATURE_DEADBAND 50
+#define CF_DEFAULT_HUMIDITY_DEADBAND 10
+#define CF_DEFAULT_LUX_DEADBAND 0
+#define CF_MAX_DEADBAND 10000
+#define CF_DEFAULT_DS18B20_RESOLUTION 12
+#define CF_MIN_DS18B20_RESOLUTION 9       // Bits
+#define CF_MAX_DS18B20_RESOLUTION 12
+
+// MQTT connection management
+#define MQTT_SOCKET_TIMEOUT 5             // Seconds
+#define MQTT_RECONNECT_MIN_BACKOFF 1000   // Milliseconds
+#define MQTT_RECONNECT_MAX_BACKOFF 300000 // Milliseconds
+#define MQTT_CONNECTION_TOPIC_FORMAT "%s/connection"
+#define MQTT_CONNECTION_MESSAGE "{ \"connects\": %lu, \"attempts\": %lu, \"failures\": %lu, \"downtime\": %lu, \"backoff\": %lu, \"rc\": %d }"
+
+// Store-and-forward of samples taken during an outage
+#define MQTT_BACKLOG_TOPIC_FORMAT "%s/backlog"
+#define MQTT_BACKLOG_BATCH_SIZE 8         // Stored samples forwarded per loop()
+#define MQTT_BATCH_TOPIC_FORMAT "%s/batch"
+#define MQTT_BUFFER_SIZE 256              // PubSubClient packet buffer (payloads are streamed)
+#define SAMPLE_STORE_USE_FLASH true       // Overflow into LittleFS
+
+// Reliable (QoS 1) delivery
+#define MQTT_QOS_STATUS PIPELINE_STATUS   // InflightWindow entry kinds
+#define MQTT_QOS_BATCH PIPELINE_BATCH
+#define MQTT_QOS_BACKLOG PIPELINE_BACKLOG
+#define MQTT_QOS_RETRY_TIMEOUT 10000      // Milliseconds to wait for a PUBACK
+#define MQTT_QOS_MAX_TRANSMISSIONS 4      // Before the session is abandoned
+#define MQTT_QOS_BACKLOG_WINDOW (INFLIGHT_WINDOW_SIZE - 1) // Leave room for status
+
+// Binary payloads
+#define MQTT_BINARY_TOPIC_FORMAT "%s/bin"
+#define MQTT_BINARY_MESSAGE_SIZE (SAMPLE_BINARY_HEADER_SIZE + (SAMPLE_BATCH_MAX * SAMPLE_BINARY_RECORD_MAX))
+#define MQTT_PAYLOAD_JSON PIPELINE_PAYLOAD_JSON
+#define MQTT_PAYLOAD_JSON_AND_BINARY PIPELINE_PAYLOAD_JSON_AND_BINARY
+#define MQTT_PAYLOAD_BINARY PIPELINE_PAYLOAD_BINARY
+
+// Topic buffers are sized for the longest configurable topic plus the
+// longest subtopic ("/backlog/bin") or property name.
+#define MQTT_SUBTOPIC_SIZE 12
+#define MQTT_TOPIC_SIZE (sizeof(((USER_CONFIGURATION*) 0)->topic) + MQTT_SUBTOPIC_SIZE)
+#define MQTT_PROPERTY_NAME_SIZE 20        // Switch aliases and DS18B20 names
+
+// Per-channel topics
+#define MQTT_CHANNEL_TOPIC_FORMAT "%s/%s"
+#define MQTT_CHANNEL_TOPIC_SIZE (sizeof(((USER_CONFIGURATION*) 0)->topic) + MQTT_PROPERTY_NAME_SIZE)
+
+// Remote commands
+#define MQTT_COMMAND_TOPIC_FORMAT "%s/cmd"
+#define MQTT_COMMAND_RESULT_TOPIC_FORMAT "%s/cmd/result"
+#define MQTT_COMMAND_RESULT_MESSAGE "{ \"result\": \"%s\", \"command\": \"%s\" }"
+#define MQTT_COMMAND_SIZE 160             // Longest accepted command
+#define MQTT_COMMAND_SEPARATORS " ;\t\r\n"
+#define MQTT_COMMAND_MAX_INTERVAL 3600000 // Milliseconds
+#define MQTT_COMMAND_CHANGED 0x01         // Command action bits
+#define MQTT_COMMAND_SAMPLE 0x02
+#define MQTT_COMMAND_PUBLISH 0x04
+#define MQTT_COMMAND_RESCAN 0x08
+#define MQTT_COMMAND_REBOOT 0x10
+#define MQTT_COMMAND_UPDATE 0x20
+
+// Over-the-air update
+#define MQTT_OTA_TOPIC_FORMAT "%s/ota"
+#define MQTT_OTA_MESSAGE "{ \"build\": \"%s\", \"version\": \"%s\", \"available\": \"%s\", \"result\": \"%s\", \"error\": \"%s\" }"
+#define OTA_STAGGER_WINDOW 300000         // Milliseconds over which a fleet spreads its downloads
+#define OTA_POLL_INTERVAL 1000
+
+// TLS (only with -D MQTT_TLS)
+#define TLS_CA_CERTIFICATE_FILE "/ca.pem"   // Pinned CA, if there is no fingerprint
+#define TLS_CA_CERTIFICATE_MAX 2048
+#define TLS_NTP_SERVER "pool.ntp.org"       // Certificate validity needs the time
+
+// Boot profiling
+#define MQTT_BOOT_TOPIC_FORMAT "%s/boot"
+#define MQTT_BOOT_MESSAGE_SIZE 384
+
+// Channel statistics
+#define MQTT_ROLLUP_TOPIC_FORMAT "%s/stats"
+#define ROLLUP_POLL_INTERVAL 1000
+
+// Task statistics
+#define MQTT_TASKS_TOPIC_FORMAT "%s/tasks"
+#define MQTT_TASKS_FIXED_COUNT 9          // Tasks other than those polling sensors
+#define MQTT_TASKS_RECORD_SIZE 100        // Longest task entry (name of up to eight characters)
+#define MQTT_TASKS_MESSAGE_SIZE (4 + ((MQTT_TASKS_FIXED_COUNT + SENSOR_DRIVER_COUNT) * MQTT_TASKS_RECORD_SIZE))
+#define MQTT_TASKS_INTERVAL 300000        // Milliseconds between reports
+
+// Run time metrics
+#define MQTT_METRICS_TOPIC_FORMAT "%s/metrics"
+#define MQTT_METRICS_MESSAGE_SIZE 512
+#define MQTT_METRICS_INTERVAL 60000       // Milliseconds between reports
+#define MQTT_PROFILE_TOPIC_FORMAT "%s/profile"
+#define MQTT_PROFILE_MESSAGE_SIZE 1024    // Only with -D PROFILER
+
+// Low power operation
+#define SLEEP_MAX_INTERVAL 10800000       // Milliseconds (about the hardware limit)
+#define SLEEP_CYCLE_TIMEOUT 15000         // Maximum milliseconds awake per wake
+
+// Persistent storage addresses and default values
+#define PS_CONFIG_STORE_STORAGE_ADDRESS 0
+#define PS_CONFIG_STORE_SIZE 480
+#define PS_WIFI_CACHE_STORAGE_ADDRESS 480
+#define PS_EEPROM_SIZE 512
+#define PS_CONFIG_VERSION 1               // USER_CONFIGURATION schema version
+
+// Configuration saved by firmware which predates ConfigStore
+#define PS_LEGACY_CONFIGURED_TOKEN_STORAGE_ADDRESS 0
+#define PS_LEGACY_CONFIGURED_TOKEN_VALUE 0xAE
+#define PS_LEGACY_CONFIGURATION_STORAGE_ADDRESS 1
+
+// Fast reconnection to the host network
+#define WIFI_FAST_CONNECT_OFF 0
+#define WIFI_FAST_CONNECT_BSSID 1         // Cached BSSID and channel
+#define WIFI_FAST_CONNECT_STATIC 2        // Also cached IP configuration
+#define WIFI_FAST_CONNECT_TIMEOUT 5000    // Milliseconds
+
+// Miscellaneous sensor configuration settings 
+#define AM2322_STARTUP_DELAY 2000
+#define LUX_FACTOR_NUMERATOR 27           // Lux calibration ratio (2.7)
+#define LUX_FACTOR_DENOMINATOR 10
+#ifndef LUX_SAMPLE_INTERVAL
+#define LUX_SAMPLE_INTERVAL 100           // Milliseconds between ADC readings
+#endif
+
+/**********************************************************************
+ * Structure to store user configuration. Note that the host network
+ * settings are managed and persisted by the module itself.
+ *
+ * The structure is persisted field by field by configStore (see
+ * CONFIG_FIELDS below), so fields can be added anywhere after
+ * PS_LEGACY_CONFIGURATION_SIZE. However, configurations saved by older
+ * firmware are raw images of the structure, so the fields before that
+ * must keep their order and size for loadLegacyConfig() to recover
+ * them.
+ */
+struct USER_CONFIGURATION { 
+  char servername[40];            // MQTT server Hostname or IP address
+  int  serverport;                // MQTT service port (normally 1883)
+  char username[20];              // Name of user who can publish to the server
+  char password[20];              // Password of named user
+  char topic[60];                 // MQTT topic on which to publish
+  int softpublicationinterval;    // Soft publication interval
+  int hardpublicationinterval;    // Hard publication interval
+  char sw0propertyname[20];       // Property name to use for first SPST switch
+  char sw1propertyname[20];       // Property name to use for second SPST switch
+  int batchsize;                  // Number of samples per batch (0 = no batching)
+  int batchwindow;                // Maximum age of a batch in milliseconds
+  int payloadformat;              // One of the MQTT_PAYLOAD_ values
+  int sleepinterval;              // Milliseconds of deep sleep between wakes (0 = never sleep)
+  int fastconnect;                // One of the WIFI_FAST_CONNECT_ values
+  char sw2propertyname[20];       // Property name to use for third SPST switch
+  char sw3propertyname[20];       // Property name to use for fourth SPST switch
+  int filtermode;                 // One of the SAMPLE_FILTER_ values
+  int temperaturedeadband;        // Hundredths of a degree (0 = never)
+  int humiditydeadband;           // Tenths of a percent (0 = never)
+  int luxdeadband;                // Lux units (0 = never)
+  int ds18b20resolution;          // Bits (9..12)
+  int sampleinterval;             // Milliseconds between samples (0 = soft interval)
+  int immediatechannels;          // SAMPLE_CHANNEL_ bits published without hold-off
+  int channeltopics;              // Publish each channel to its own subtopic (0 = no)
+  int reliable;                   // Publish samples at QoS 1 (0 = no)
+  char otamanifest[96];           // URL of the OTA update manifest
+  char fingerprint[60];           // SHA-1 fingerprint of the server's TLS certificate
+  int rollupwindow;               // Milliseconds per channel statistics window (0 = none)
+};
+
+/**********************************************************************
+ * The persistent form of USER_CONFIGURATION. A tag must never be
+ * reused for a different field, but fields can be added (with a new
+ * tag) or dropped freely. Integers which have never been saved take
+ * the given default.
+ */
+#define CONFIG_STRING(tag, field) { tag, CONFIG_STORE_STRING, offsetof(USER_CONFIGURATION, field), sizeof(((USER_CONFIGURATION*) 0)->field), 0 }
+#define CONFIG_INT(tag, field, fallback) { tag, CONFIG_STORE_INT, offsetof(USER_CONFIGURATION, field), sizeof(((USER_CONFIGURATION*) 0)->field), fallback }
+
+const CONFIG_FIELD CONFIG_FIELDS[] = {
+  CONFIG_STRING(1, servername),
+  CONFIG_INT(2, serverport, CF_DEFAULT_MQTT_SERVICE_PORT),
+  CONFIG_STRING(3, username),
+  CONFIG_STRING(4, password),
+  CONFIG_STRING(5, topic),
+  CONFIG_INT(6, softpublicationinterval, CF_DEFAULT_MQTT_PUBLISH_SOFT_INTERVAL),
+  CONFIG_INT(7, hardpublicationinterval, CF_DEFAULT_MQTT_PUBLISH_HARD_INTERVAL),
+  CONFIG_STRING(8, sw0propertyname),
+  CONFIG_STRING(9, sw1propertyname),
+  CONFIG_INT(10, batchsize, CF_DEFAULT_MQTT_BATCH_SIZE),
+  CONFIG_INT(11, batchwindow, CF_DEFAULT_MQTT_BATCH_WINDOW),
+  CONFIG_INT(12, payloadformat, CF_DEFAULT_MQTT_PAYLOAD_FORMAT),
+  CONFIG_INT(13, sleepinterval, CF_DEFAULT_SLEEP_INTERVAL),
+  CONFIG_INT(14, fastconnect, CF_DEFAULT_WIFI_FAST_CONNECT),
+  CONFIG_STRING(15, sw2propertyname),
+  CONFIG_STRING(16, sw3propertyname),
+  CONFIG_INT(17, filtermode, CF_DEFAULT_FILTER_MODE),
+  CONFIG_INT(18, temperaturedeadband, CF_DEFAULT_TEMPERATURE_DEADBAND),
+  CONFIG_INT(19, humiditydeadband, CF_DEFAULT_HUMIDITY_DEADBAND),
+  CONFIG_INT(20, luxdeadband, CF_DEFAULT_LUX_DEADBAND),
+  CONFIG_INT(21, ds18b20resolution, CF_DEFAULT_DS18B20_RESOLUTION),
+  CONFIG_INT(22, sampleinterval, CF_DEFAULT_SAMPLE_INTERVAL),
+  CONFIG_INT(23, immediatechannels, CF_DEFAULT_IMMEDIATE_CHANNELS),
+  CONFIG_INT(24, channeltopics, CF_DEFAULT_CHANNEL_TOPICS),
+  CONFIG_INT(25, reliable, CF_DEFAULT_MQTT_RELIABLE),
+  CONFIG_STRING(26, otamanifest),
+  CONFIG_STRING(27, fingerprint),
+  CONFIG_INT(28, rollupwindow, CF_DEFAULT_ROLLUP_WINDOW),
+};
+#define CONFIG_FIELD_COUNT (sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]))
+
+// Fields from sampleinterval on were added after ConfigStore and so
+// never appear in a legacy image.
+#define PS_LEGACY_CONFIGURATION_SIZE offsetof(USER_CONFIGURATION, sampleinterval)
+
+ConfigStore configStore(PS_CONFIG_STORE_STORAGE_ADDRESS, PS_CONFIG_STORE_SIZE);
+
+/**********************************************************************
+ * Globals representing WiFi and MQTT entities. The configuration
+ * portal has none: see runConfigPortal(). In TLS builds the MQTT
+ * connection is made by a TlsClient, whose session is kept across
+ * reconnections and deep sleep.
+ */
+#ifdef MQTT_TLS
+TlsClient wifiClient;
+static_assert(sizeof(TLS_CLIENT_STATE) <= SLEEP_STATE_SESSION_SIZE, "TLS_CLIENT_STATE does not fit in SleepState");
+#else
+WiFiClient wifiClient;
+#endif
+QosClient qosClient(wifiClient);
+PubSubClient mqttClient(qosClient);
+MqttReconnector mqttReconnector(mqttClient, MQTT_RECONNECT_MIN_BACKOFF, MQTT_RECONNECT_MAX_BACKOFF);
+
+/**********************************************************************
+ * Globals representing sensor entities. Each sensor enabled by the
+ * build has a driver which is registered in sensorDrivers and the
+ * whole set is scheduled by sensors.
+ */
+#ifdef SENSOR_AM2322
+AM2322Driver am2322Driver(Wire, GPIO_SDA, GPIO_SCL, AM2322_STARTUP_DELAY);
+#endif
+#ifdef SENSOR_DS18B20
+OneWire oneWire(GPIO_ONE_WIRE_BUS);
+DallasTemperature DS18B20(&oneWire);
+#ifdef DS18B20_AS_TEMPERATURE
+DS18B20Driver ds18b20Driver(oneWire, DS18B20, true);
+#else
+DS18B20Driver ds18b20Driver(oneWire, DS18B20);
+#endif
+#endif
+#ifdef SENSOR_LUX
+LuxDriver luxDriver(GPIO_LUX_SENSOR, LUX_FACTOR_NUMERATOR, LUX_FACTOR_DENOMINATOR, LUX_SAMPLE_INTERVAL);
+#endif
+#if (SWITCH_COUNT > 0) || defined(SENSOR_PIR)
+const uint8_t switchPins[] = { GPIO_SW0, GPIO_SW1, GPIO_SW2, GPIO_SW3 };
+const char *switchNames[4];
+#ifdef SENSOR_PIR
+InputDriver inputDriver(switchPins, SWITCH_COUNT, switchNames, GPIO_PIR_SENSOR);
+#else
+InputDriver inputDriver(switchPins, SWITCH_COUNT, switchNames);
+#endif
+#endif
+
+SensorDriver * const sensorDrivers[] = {
+  #ifdef SENSOR_DS18B20
+  &ds18b20Driver,
+  #endif
+  #ifdef SENSOR_AM2322
+  &am2322Driver,
+  #endif
+  #ifdef SENSOR_LUX
+  &luxDriver,
+  #endif
+  #if (SWITCH_COUNT > 0) || defined(SENSOR_PIR)
+  &inputDriver,
+  #endif
+};
+#define SENSOR_DRIVER_COUNT (sizeof(sensorDrivers) / sizeof(sensorDrivers[0]))
+SampleFilter sampleFilter;
+SensorSet sensors(sensorDrivers, SENSOR_DRIVER_COUNT, sampleFilter);
+
+/**********************************************************************
+ * Debug dump the content of the specified configuration object.
+ */
+void dumpConfig(USER_CONFIGURATION &config) {
+  #ifdef DEBUG_SERIAL
+  Serial.print("MQTT server name: "); Serial.println(config.servername);
+  Serial.print("MQTT server port: "); Serial.println(config.serverport);
+  Serial.print("MQTT username: "); Serial.println(config.username);
+  Serial.print("MQTT password: "); Serial.println((config.password[0])?"(set)":"(none)");
+  Serial.print("MQTT topic: "); Serial.println(config.topic);
+  Serial.print("MQTT SW0 property name: "); Serial.println(config.sw0propertyname);
+  Serial.print("MQTT SW1 property name: "); Serial.println(config.sw1propertyname);
+  Serial.print("MQTT SW2 property name: "); Serial.println(config.sw2propertyname);
+  Serial.print("MQTT SW3 property name: "); Serial.println(config.sw3propertyname);
+  Serial.print("MQTT soft publication interval: "); Serial.println(config.softpublicationinterval);
+  Serial.print("MQTT hard publication interval: "); Serial.println(config.hardpublicationinterval);
+  Serial.print("Sample interval: "); Serial.println(config.sampleinterval);
+  Serial.print("Immediate channels: "); Serial.println(config.immediatechannels);
+  Serial.print("Channel topics: "); Serial.println(config.channeltopics);
+  Serial.print("Reliable delivery: "); Serial.println(config.reliable);
+  Serial.print("Rollup window: "); Serial.println(config.rollupwindow);
+  Serial.print("OTA manifest: "); Serial.println(config.otamanifest);
+  Serial.print("TLS fingerprint: "); Serial.println(config.fingerprint);
+  Serial.print("MQTT batch size: "); Serial.println(config.batchsize);
+  Serial.print("MQTT batch window: "); Serial.println(config.batchwindow);
+  Serial.print("MQTT payload format: "); Serial.println(config.payloadformat);
+  Serial.print("Sleep interval: "); Serial.println(config.sleepinterval);
+  Serial.print("WiFi fast connect: "); Serial.println(config.fastconnect);
+  Serial.print("Smoothing: "); Serial.println(config.filtermode);
+  Serial.print("Temperature deadband: "); Serial.println(config.temperaturedeadband);
+  Serial.print("Humidity deadband: "); Serial.println(config.humiditydeadband);
+  Serial.print("Lux deadband: "); Serial.println(config.luxdeadband);
+  Serial.print("DS18B20 resolution: "); Serial.println(config.ds18b20resolution);
+  #endif
+}
+
+/**********************************************************************
+ * Save the specified configuration object to EEPROM. Nothing is
+ * written unless the configuration has changed.
+ */
+void saveConfig(USER_CONFIGURATION &config) {
+  #ifdef DEBUG_SERIAL
+  Serial.println("Saving module configuration to EEPROM");
+  dumpConfig(config);
+  #endif
+  if (!configStore.save(&config, CONFIG_FIELDS, CONFIG_FIELD_COUNT, PS_CONFIG_VERSION)) {
+    #ifdef DEBUG_SERIAL
+    Serial.println("Module configuration is too large to save");
+    #endif
+  }
+}
+
+/**********************************************************************
+ * Load the specified configuration object from the raw structure image
+ * saved by firmware which predates ConfigStore. Fields added since
+ * that firmware was built will hold whatever followed the image in
+ * EEPROM, so every field must be validated before use (as it always
+ * has been). Fields which postdate ConfigStore take their defaults.
+ * Returns false if there is no such image.
+ */
+boolean loadLegacyConfig(USER_CONFIGURATION &config) {
+  boolean retval = false;
+
+  ConfigStore::setDefaults(&config, CONFIG_FIELDS, CONFIG_FIELD_COUNT);
+  EEPROM.begin(PS_EEPROM_SIZE);
+  if (EEPROM.read(PS_LEGACY_CONFIGURED_TOKEN_STORAGE_ADDRESS) == PS_LEGACY_CONFIGURED_TOKEN_VALUE) {
+    uint8_t *p = (uint8_t*) &config;
+    for (size_t i = 0; (i < PS_LEGACY_CONFIGURATION_SIZE) && ((PS_LEGACY_CONFIGURATION_STORAGE_ADDRESS + i) < PS_WIFI_CACHE_STORAGE_ADDRESS); i++) {
+      p[i] = EEPROM.read(PS_LEGACY_CONFIGURATION_STORAGE_ADDRESS + i);
+    }
+    retval = true;
+  }
+  EEPROM.end();
+  return(retval);
+}
+
+/**********************************************************************
+ * Load the specified configuration object with data from EEPROM. A
+ * configuration saved by older firmware, or under an older schema
+ * version, is migrated and saved in the current form.
+ */
+boolean loadConfig(USER_CONFIGURATION &config) {
+  #ifdef DEBUG_SERIAL
+  Serial.println("Loading module configuration from EEPROM");
+  #endif
+  boolean retval = configStore.load(&config, CONFIG_FIELDS, CONFIG_FIELD_COUNT);
+  if (!retval) {
+    if ((retval = loadLegacyConfig(config))) saveConfig(config);
+  } else if (configStore.getVersion() != PS_CONFIG_VERSION) {
+    // There have been no changes of meaning since version 1, so
+    // migration is just a matter of recording the current version.
+    saveConfig(config);
+  }
+  #ifdef DEBUG_SERIAL
+  dumpConfig(config);
+  #endif
+  return(retval);
+}
+ 
+/**********************************************************************
+ * Method called when the user updates the module configuration through
+ * the captive portal and a global variable which is used to flag this
+ * fact for subsequent action.
+ */
+
+bool shouldSaveConfig = false;
+
+void saveConfigCallback() {
+  shouldSaveConfig = true; 
+}
+
+byte macAddress[6];
+char moduleId[40];
+USER_CONFIGURATION mqttConfig;
+boolean userConfigurationLoaded = false;
+PublishPolicy publishPolicy(CF_DEFAULT_MQTT_PUBLISH_SOFT_INTERVAL, CF_DEFAULT_MQTT_PUBLISH_HARD_INTERVAL);
+int sampleTaskId = -1;
+
+/**********************************************************************
+ * Samples which cannot be published are held in sampleStore until
+ * they can be forwarded. sampleNames supplies the property names for
+ * every published sample.
+ */
+SampleStore sampleStore;
+SAMPLE_NAMES sampleNames;
+
+/**********************************************************************
+ * In batch mode samples are accumulated in sampleBatch and published
+ * together. JSON payloads are streamed straight into mqttClient, but
+ * mqttBinaryMessage is shared by everything which publishes a binary
+ * frame. It is large enough to hold a full batch, so a binary frame
+ * never carries fewer samples than its JSON counterpart.
+ */
+SampleBatch sampleBatch;
+uint8_t mqttBinaryMessage[MQTT_BINARY_MESSAGE_SIZE];
+
+/**********************************************************************
+ * sampleRollup accumulates the statistics of every channel over each
+ * rollup window for publication to the stats subtopic. Its state does
+ * not survive deep sleep, so it is disabled in sleep mode.
+ */
+SampleRollup sampleRollup;
+
+/**********************************************************************
+ * In channel topic mode channelReference holds the last sample all of
+ * whose channels were successfully published, so that only channels
+ * which have changed since need be published again. It is invalidated
+ * by every new connection to the server (and by any failure), making
+ * the next publication complete.
+ */
+SAMPLE channelReference;
+bool channelReferenceValid = false;
+
+/**********************************************************************
+ * In reliable delivery mode sample messages are published at QoS 1
+ * through qosClient and held in inflightWindow until the server
+ * acknowledges them. Anything still unacknowledged when the
+ * connection is lost goes back into sampleStore.
+ */
+InflightWindow inflightWindow;
+
+/**********************************************************************
+ * Commands received on mqttCommandTopic wait in pendingCommand until
+ * the MQTT housekeeping task can act upon them.
+ */
+char mqttCommandTopic[MQTT_TOPIC_SIZE];
+char pendingCommand[MQTT_COMMAND_SIZE];
+bool commandPending = false;
+bool commandTooLong = false;
+
+/**********************************************************************
+ * otaUpdater performs firmware updates requested by command.
+ */
+OtaUpdater otaUpdater(FIRMWARE_BUILD, FIRMWARE_VERSION);
+
+/**********************************************************************
+ * In sleep mode (a non-zero sleep interval) sleepState carries the last
+ * published sample and anything not yet published between wakes.
+ */
+SleepState sleepState;
+
+/**********************************************************************
+ * wifiCache holds the details of our last connection to the host
+ * network so that we can reconnect without scanning or DHCP.
+ */
+WiFiCache wifiCache(PS_WIFI_CACHE_STORAGE_ADDRESS);
+/**********************************************************************
+ * bootProfile records the time at which each phase of start up
+ * completes (up to the first successful publication) for publication,
+ * once per boot, to the boot subtopic.
+ */
+BootProfile bootProfile;
+bool bootProfilePublished = false;
+
+int fastConnect = CF_DEFAULT_WIFI_FAST_CONNECT;
+int ds18b20Resolution = CF_DEFAULT_DS18B20_RESOLUTION;
+
+/**********************************************************************
+ * Smoothing and deadband settings for sampleFilter.
+ */
+int filterMode = CF_DEFAULT_FILTER_MODE;
+int temperatureDeadband = CF_DEFAULT_TEMPERATURE_DEADBAND;
+int humidityDeadband = CF_DEFAULT_HUMIDITY_DEADBAND;
+int luxDeadband = CF_DEFAULT_LUX_DEADBAND;
+
+/**********************************************************************
+ * loop() simply runs the tasks which setup() adds to scheduler. The
+ * MQTT housekeeping task records in mqttConnected whether or not we
+ * are connected for the tasks which follow it.
+ */
+Scheduler scheduler;
+bool mqttConnected = false;
+
+/**********************************************************************
+ * metrics accumulates the run time statistics published to the
+ * metrics subtopic.
+ */
+Metrics metrics;
+
+/**********************************************************************
+ * pipeline carries each reading from sensors to publication (see
+ * Pipeline.h) and holds the publication settings. Its messages go to
+ * the MQTT server through mqttSink, which keeps the reference sample
+ * in sleepState.
+ */
+class MqttSink : public PipelineSink {
+  public:
+    bool isConnected();
+    bool publishJson(uint8_t kind, const SAMPLE *samples, size_t count);
+    bool publishBinary(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded);
+    bool publishChannels(const SAMPLE &sample, bool all);
+    bool publishReliable(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded);
+    void published(const SAMPLE *samples, size_t count);
+    bool getReference(SAMPLE &reference);
+    void setReference(const SAMPLE &reference);
+};
+
+MqttSink mqttSink;
+Pipeline pipeline(sensors, publishPolicy, sampleBatch, sampleRollup, sampleStore, sampleNames, mqttSink);
+
+/**********************************************************************
+ * Publish the <length> byte <payload> to <topic> by streaming it
+ * through mqttClient rather than having the client copy it into its
+ * packet buffer. A partial write leaves the session unusable, so the
+ * client is disconnected (and will be reconnected by
+ * maintainMqttConnection()). Returns true if the payload was
+ * published.
+ */
+bool publishPayload(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+  PROFILE_SECTION("mqtt.publish");
+  bool published = false;
+
+  if (mqttClient.beginPublish(topic, length, retained)) {
+    if (mqttClient.write(payload, length) == length) {
+      published = (mqttClient.endPublish() > 0);
+    } else {
+      mqttClient.disconnect();
+    }
+  }
+  metrics.recordPublish(published);
+  return(published);
+}
+
+bool publishText(const char *topic, const char *text, bool retained) {
+  return(publishPayload(topic, (const uint8_t*) text, strlen(text), retained));
+}
+
+/**********************************************************************
+ * Stream <count> <samples> to <topic> as JSON: a single object
+ * (without an age) if <array> is false, otherwise an array. The
+ * payload is measured in a first pass, since an MQTT packet must
+ * declare its length up front, and then written field by field
+ * straight into mqttClient. Returns true if the payload was
+ * published.
+ */
+bool publishJson(const char *topic, const SAMPLE *samples, size_t count, bool array, bool retained) {
+  PROFILE_SECTION("mqtt.publish");
+  unsigned long now = millis();
+  size_t length, written;
+
+  {
+    PROFILE_SECTION("json.measure");
+    length = (array)?SampleCodec::toJsonArray((Print*) NULL, samples, count, sampleNames, now):SampleCodec::toJson((Print*) NULL, samples[0], sampleNames, -1);
+  }
+  if ((length == 0) || (!mqttClient.beginPublish(topic, length, retained))) {
+    metrics.recordPublish(false);
+    return(false);
+  }
+  written = (array)?SampleCodec::toJsonArray(&mqttClient, samples, count, sampleNames, now):SampleCodec::toJson(&mqttClient, samples[0], sampleNames, -1);
+  if (written != length) {
+    mqttClient.disconnect();
+    metrics.recordPublish(false);
+    return(false);
+  }
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Publishing ");
+    if (array) SampleCodec::toJsonArray(&Serial, samples, count, sampleNames, now); else SampleCodec::toJson(&Serial, samples[0], sampleNames, -1);
+    Serial.print(" to ");
+    Serial.println(topic);
+  #endif
+
+  written = (mqttClient.endPublish() > 0);
+  metrics.recordPublish(written);
+  return(written);
+}
+
+/**********************************************************************
+ * Record in metrics the publication latency of each of the <count>
+ * <samples> (other than those whose timestamps belong to an earlier
+ * boot).
+ */
+void recordLatency(const SAMPLE *samples, size_t count) {
+  unsigned long now = millis();
+
+  for (size_t i = 0; i < count; i++) {
+    if (!(samples[i].flags & SAMPLE_STALE)) metrics.recordLatency(now - samples[i].timestamp);
+  }
+}
+
+/**********************************************************************
+ * Put every sample still awaiting acknowledgement back into
+ * sampleStore, so that it will be forwarded as backlog. Called when
+ * the session they were sent in ends, since the server keeps no
+ * state for a clean session.
+ */
+void requeueReliable() {
+  int8_t slot;
+
+  while ((slot = inflightWindow.getOldest()) >= 0) {
+    const INFLIGHT_ENTRY &entry = inflightWindow.getEntry(slot);
+
+    for (uint8_t i = 0; i < entry.count; i++) sampleStore.push(entry.samples[i]);
+    inflightWindow.release(slot);
+  }
+}
+
+/**********************************************************************
+ * Used by loop() to keep us connected to the configured MQTT server.
+ * Connection attempts are scheduled by mqttReconnector with a jittered
+ * exponential backoff so that loop() (and with it sensor sampling)
+ * never waits on an unavailable server. Each new connection is
+ * announced by publishing the reconnector's statistics to the
+ * connection subtopic. Returns true if we are connected.
+ */
+bool maintainMqttConnection() {
+  static char mqttConnectionTopic[MQTT_TOPIC_SIZE];
+  static char mqttConnectionMessage[160];
+  bool connected;
+
+  {
+    PROFILE_SECTION("mqtt.connect");
+    connected = mqttReconnector.loop();
+  }
+
+  #ifdef DEBUG_SERIAL
+  if (mqttReconnector.justAttempted()) {
+    Serial.print("Trying to connect to MQTT server ");
+    Serial.print(mqttConfig.servername); Serial.print(":"); Serial.print(mqttConfig.serverport);
+    Serial.print(" as ");
+    Serial.print(mqttConfig.username);
+    Serial.print(" with client id ");
+    Serial.print(moduleId);
+    #ifdef MQTT_TLS
+      Serial.print(" over TLS (");
+      Serial.print(wifiClient.getConnectTime());
+      Serial.print(" ms");
+      if (wifiClient.getError()[0]) { Serial.print(", "); Serial.print(wifiClient.getError()); }
+      Serial.print(")");
+    #endif
+    if (connected) {
+      Serial.println(": connected");
+    } else {
+      Serial.print(": failed (result code = ");
+      Serial.print(mqttReconnector.getLastState());
+      Serial.print("). Will try again in ");
+      Serial.print(mqttReconnector.getRetryDelay());
+      Serial.println(" ms.");
+    }
+  }
+  #endif
+
+  if (mqttReconnector.justConnected()) {
+    bootProfile.mark("mqtt");
+    channelReferenceValid = false;
+    // Publications from a previous session will never be acknowledged.
+    requeueReliable();
+    sprintf(mqttCommandTopic, MQTT_COMMAND_TOPIC_FORMAT, mqttConfig.topic);
+    mqttClient.subscribe(mqttCommandTopic, 1);
+    sprintf(mqttConnectionTopic, MQTT_CONNECTION_TOPIC_FORMAT, mqttConfig.topic);
+    sprintf(mqttConnectionMessage, MQTT_CONNECTION_MESSAGE, mqttReconnector.getConnects(), mqttReconnector.getAttempts(), mqttReconnector.getFailures(), mqttReconnector.getLastDowntime(), mqttReconnector.getLastBackoff(), mqttReconnector.getLastState());
+    publishText(mqttConnectionTopic, mqttConnectionMessage, true);
+    // Make sure the retained status is brought up to date.
+    publishPolicy.notifyChange();
+  }
+  return(connected);
+}
+
+/**********************************************************************
+ * Publish each channel of <sample> as a retained scalar to the
+ * subtopic of the configured topic named after it. Unless <all> is
+ * true (or there is no usable reference) only channels which differ
+ * from channelReference are published, and the subtopic of any
+ * channel which has disappeared is cleared. Returns true if every
+ * publication succeeded.
+ */
+bool publishChannels(const SAMPLE &sample, bool all) {
+  static char mqttChannelTopic[MQTT_CHANNEL_TOPIC_SIZE];
+  char text[SAMPLE_CODEC_TEXT_SIZE];
+  SAMPLE_CHANNEL_VALUE channel, previous;
+  bool published = true, present, wasPresent;
+
+  // Probe names follow their index, so a change in the number of
+  // probes can rename every one of them.
+  if ((!channelReferenceValid) || (sample.probeCount != channelReference.probeCount)) all = true;
+  for (uint8_t i = 0; (i < SAMPLE_CODEC_CHANNELS) && (published); i++) {
+    present = SampleCodec::getChannel(sample, sampleNames, i, channel);
+    wasPresent = ((!all) && (SampleCodec::getChannel(channelReference, sampleNames, i, previous)));
+    if (present) {
+      if ((wasPresent) && (previous.value == channel.value)) continue;
+      snprintf(mqttChannelTopic, sizeof(mqttChannelTopic), MQTT_CHANNEL_TOPIC_FORMAT, mqttConfig.topic, channel.name);
+      published = ((SampleCodec::toText(text, sizeof(text), channel) > 0) && (publishText(mqttChannelTopic, text, true)));
+    } else if (wasPresent) {
+      // An empty retained message removes the retained value.
+      snprintf(mqttChannelTopic, sizeof(mqttChannelTopic), MQTT_CHANNEL_TOPIC_FORMAT, mqttConfig.topic, previous.name);
+      published = publishText(mqttChannelTopic, "", true);
+    }
+
+    #ifdef DEBUG_SERIAL
+      if ((present) || (wasPresent)) {
+        Serial.print("Publishing ");
+        Serial.print((present)?text:"");
+        Serial.print(" to ");
+        Serial.println(mqttChannelTopic);
+      }
+    #endif
+  }
+  channelReferenceValid = published;
+  if (published) channelReference = sample;
+  return(published);
+}
+
+/**********************************************************************
+ * Publish as many of the <count> <samples> as will fit in a single
+ * binary frame to the binary subtopic of <topic>. The number of
+ * samples encoded is returned in <encoded>. Returns true if the frame
+ * was published.
+ */
+bool publishBinary(const char *topic, const SAMPLE *samples, size_t count, bool retained, size_t &encoded) {
+  static char mqttBinaryTopic[MQTT_TOPIC_SIZE];
+  size_t length = SampleCodec::toBinary(mqttBinaryMessage, sizeof(mqttBinaryMessage), samples, count, millis(), encoded);
+
+  if (encoded == 0) return(false);
+  snprintf(mqttBinaryTopic, sizeof(mqttBinaryTopic), MQTT_BINARY_TOPIC_FORMAT, topic);
+  return(publishPayload(mqttBinaryTopic, mqttBinaryMessage, length, retained));
+}
+
+/**********************************************************************
+ * Return the topic which carries sample messages of <kind>.
+ */
+const char *sampleTopic(uint8_t kind) {
+  static char mqttSampleTopic[MQTT_TOPIC_SIZE];
+
+  switch (kind) {
+    case MQTT_QOS_BATCH: sprintf(mqttSampleTopic, MQTT_BATCH_TOPIC_FORMAT, mqttConfig.topic); break;
+    case MQTT_QOS_BACKLOG: sprintf(mqttSampleTopic, MQTT_BACKLOG_TOPIC_FORMAT, mqttConfig.topic); break;
+    default: strcpy(mqttSampleTopic, mqttConfig.topic); break;
+  }
+  return(mqttSampleTopic);
+}
+
+/**********************************************************************
+ * Stream the inflightWindow entry in <slot> to its topic as a QoS 1
+ * publication: a retained JSON object for the status, otherwise a JSON
+ * array, or a binary frame if the payload format is binary only. Ages
+ * are computed afresh, so a retransmission remains accurate. As in
+ * publishJson(), a partial write disconnects the client. Returns true
+ * if the publication was sent.
+ */
+bool transmitReliable(int8_t slot) {
+  PROFILE_SECTION("mqtt.publish");
+  static char mqttReliableBinaryTopic[MQTT_TOPIC_SIZE];
+  const INFLIGHT_ENTRY &entry = inflightWindow.getEntry(slot);
+  const char *topic = sampleTopic(entry.kind);
+  bool array = (entry.kind != MQTT_QOS_STATUS);
+  bool binary = (pipeline.getConfig().payloadFormat == MQTT_PAYLOAD_BINARY);
+  unsigned long now = millis();
+  size_t length, written, encoded;
+
+  if (binary) {
+    length = SampleCodec::toBinary(mqttBinaryMessage, sizeof(mqttBinaryMessage), entry.samples, entry.count, now, encoded);
+    snprintf(mqttReliableBinaryTopic, sizeof(mqttReliableBinaryTopic), MQTT_BINARY_TOPIC_FORMAT, topic);
+    topic = mqttReliableBinaryTopic;
+  } else {
+    length = (array)?SampleCodec::toJsonArray((Print*) NULL, entry.samples, entry.count, sampleNames, now):SampleCodec::toJson((Print*) NULL, entry.samples[0], sampleNames, -1);
+  }
+  if ((length == 0) || (!qosClient.beginPublish(topic, length, !array, entry.packetId, (entry.transmissions > 0)))) {
+    // Part of a header may have been written.
+    if (mqttClient.connected()) mqttClient.disconnect();
+    metrics.recordPublish(false);
+    return(false);
+  }
+  if (binary) {
+    written = qosClient.write(mqttBinaryMessage, length);
+  } else {
+    written = (array)?SampleCodec::toJsonArray(&qosClient, entry.samples, entry.count, sampleNames, now):SampleCodec::toJson(&qosClient, entry.samples[0], sampleNames, -1);
+  }
+  if (written != length) {
+    mqttClient.disconnect();
+    metrics.recordPublish(false);
+    return(false);
+  }
+  inflightWindow.sent(slot, now);
+
+  #ifdef DEBUG_SERIAL
+    Serial.print((entry.transmissions > 1)?"Retransmitting ":"Publishing ");
+    Serial.print(entry.count);
+    Serial.print(" samples as packet ");
+    Serial.print(entry.packetId);
+    Serial.print(" to ");
+    Serial.println(topic);
+  #endif
+
+  return(true);
+}
+
+/**********************************************************************
+ * Add up to INFLIGHT_WINDOW_SAMPLES of the <count> <samples> to
+ * inflightWindow as an entry of <kind> and send it. The number of
+ * samples taken is returned in <encoded>. In the JSON and binary
+ * payload format the binary frame is an unacknowledged extra. Returns
+ * false if the window is full. Once in the window the samples are
+ * retransmitted or requeued by serviceReliable() until they are
+ * acknowledged, so a failed transmission still counts as published.
+ */
+bool publishReliable(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) {
+  int8_t slot = inflightWindow.add(kind, samples, count);
+  size_t n;
+
+  encoded = 0;
+  if (slot < 0) return(false);
+  encoded = inflightWindow.getEntry(slot).count;
+  if ((transmitReliable(slot)) && (pipeline.getConfig().payloadFormat == MQTT_PAYLOAD_JSON_AND_BINARY)) {
+    publishBinary(sampleTopic(kind), samples, encoded, (kind == MQTT_QOS_STATUS), n);
+  }
+  return(true);
+}
+
+/**********************************************************************
+ * Release every inflightWindow entry which qosClient has seen
+ * acknowledged and retransmit (as a duplicate) the oldest entry whose
+ * acknowledgement is overdue. A publication which goes unacknowledged
+ * MQTT_QOS_MAX_TRANSMISSIONS times suggests a broken session, so the
+ * client is disconnected and everything in flight requeued.
+ */
+void serviceReliable(bool connected) {
+  uint16_t packetId;
+  int8_t slot;
+
+  while (qosClient.getAck(packetId)) {
+    if ((slot = inflightWindow.acknowledge(packetId)) < 0) continue;
+    const INFLIGHT_ENTRY &entry = inflightWindow.getEntry(slot);
+    metrics.recordPublish(true);
+    bootProfile.mark("publish");
+    recordLatency(entry.samples, entry.count);
+  }
+  if (!connected) {
+    requeueReliable();
+    return;
+  }
+  if ((slot = inflightWindow.getExpired(millis(), MQTT_QOS_RETRY_TIMEOUT)) < 0) return;
+  if (inflightWindow.getEntry(slot).transmissions > 0) metrics.recordPublish(false);
+  if (inflightWindow.getEntry(slot).transmissions >= MQTT_QOS_MAX_TRANSMISSIONS) {
+    mqttClient.disconnect();
+    requeueReliable();
+    return;
+  }
+  transmitReliable(slot);
+}
+
+/**********************************************************************
+ * In reliable delivery mode, returns true if there is room in
+ * inflightWindow for another backlog message. One entry is always
+ * left for the status.
+ */
+bool isBacklogWindowOpen() {
+  return((!inflightWindow.isFull()) && (inflightWindow.getCount() < MQTT_QOS_BACKLOG_WINDOW));
+}
+
+/**********************************************************************
+ * Forward up to MQTT_BACKLOG_BATCH_SIZE samples queued during an
+ * outage to the backlog subtopic in a single message. Called from
+ * loop() whilst we are connected, so the backlog drains a batch at a
+ * time without holding up sampling. In reliable delivery mode as many
+ * batches are sent as inflightWindow has room for, so forwarding does
+ * not wait for each acknowledgement in turn.
+ */
+void forwardBacklog() {
+  SAMPLE samples[MQTT_BACKLOG_BATCH_SIZE];
+  bool reliable = pipeline.getConfig().reliable;
+  size_t count, forwarded;
+
+  if ((sampleStore.isEmpty()) || ((reliable) && (!isBacklogWindowOpen()))) return;
+  do {
+    count = sampleStore.peek(samples, MQTT_BACKLOG_BATCH_SIZE);
+    if (!pipeline.publishSamples(MQTT_QOS_BACKLOG, samples, count, forwarded)) {
+      if (forwarded) return;
+      // A sample which cannot be encoded would otherwise block the queue.
+      forwarded = (count)?1:0;
+    }
+    sampleStore.discard(forwarded);
+
+    #ifdef DEBUG_SERIAL
+      Serial.print("Forwarded ");
+      Serial.print(forwarded);
+      Serial.print(" queued samples (");
+      Serial.print(sampleStore.getCount());
+      Serial.println(" remaining)");
+    #endif
+  } while ((reliable) && (!sampleStore.isEmpty()) && (isBacklogWindowOpen()) && (mqttClient.connected()));
+}
+
+/**********************************************************************
+ * The pipeline's messages are published to the topic of their kind
+ * (see sampleTopic()), retained if they carry the status.
+ */
+bool MqttSink::isConnected() {
+  return(mqttClient.connected());
+}
+
+bool MqttSink::publishJson(uint8_t kind, const SAMPLE *samples, size_t count) {
+  return(::publishJson(sampleTopic(kind), samples, count, (kind != MQTT_QOS_STATUS), (kind == MQTT_QOS_STATUS)));
+}
+
+bool MqttSink::publishBinary(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) {
+  return(::publishBinary(sampleTopic(kind), samples, count, (kind == MQTT_QOS_STATUS), encoded));
+}
+
+bool MqttSink::publishChannels(const SAMPLE &sample, bool all) {
+  return(::publishChannels(sample, all));
+}
+
+bool MqttSink::publishReliable(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) {
+  return(::publishReliable(kind, samples, count, encoded));
+}
+
+void MqttSink::published(const SAMPLE *samples, size_t count) {
+  bootProfile.mark("publish");
+  recordLatency(samples, count);
+}
+
+bool MqttSink::getReference(SAMPLE &reference) {
+  return(sleepState.getReference(reference));
+}
+
+void MqttSink::setReference(const SAMPLE &reference) {
+  sleepState.setReference(reference);
+}
+
+/**********************************************************************
+ * Publish the boot profile and the reason for the most recent reset to
+ * the boot subtopic. This happens once per boot, after the first
+ * successful publication of sensor data.
+ */
+void publishBootProfile() {
+  static char mqttBootTopic[MQTT_TOPIC_SIZE];
+  static char mqttBootMessage[MQTT_BOOT_MESSAGE_SIZE];
+
+  sprintf(mqttBootTopic, MQTT_BOOT_TOPIC_FORMAT, mqttConfig.topic);
+  if (bootProfile.toJson(mqttBootMessage, sizeof(mqttBootMessage), ESP.getResetReason().c_str())) {
+    if (!publishText(mqttBootTopic, mqttBootMessage, true)) return;
+
+    #ifdef DEBUG_SERIAL
+      Serial.print("Publishing ");
+      Serial.print(mqttBootMessage);
+      Serial.print(" to ");
+      Serial.println(mqttBootTopic);
+    #endif
+  }
+  bootProfilePublished = true;
+}
+
+/**********************************************************************
+ * Pick up where the previous wake left off by requeueing its pending
+ * samples and, if we know how long we slept, restoring the time of its
+ * last publication. The values last published remain in sleepState as
+ * the reference against which pollSensorTask() detects change.
+ */
+void restoreSleepState() {
+  SAMPLE samples[SLEEP_STATE_PENDING_MAX];
+  SAMPLE reference;
+  size_t count = sleepState.getPending(samples, SLEEP_STATE_PENDING_MAX);
+
+  for (size_t i = 0; i < count; i++) {
+    if ((sampleBatch.isEnabled()) && (!sampleBatch.isDue(millis()))) {
+      sampleBatch.add(samples[i]);
+    } else {
+      sampleStore.push(samples[i]);
+    }
+  }
+  if ((sleepState.getReference(reference)) && (sleepState.isClockValid())) {
+    publishPolicy.published(reference.timestamp);
+  }
+  #ifdef MQTT_TLS
+  TLS_CLIENT_STATE tlsState;
+  if (sleepState.getSession(&tlsState, sizeof(tlsState)) == sizeof(tlsState)) wifiClient.setState(tlsState);
+  #endif
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Woke from sleep (wake ");
+    Serial.print(sleepState.getWakes());
+    Serial.print(", ");
+    Serial.print(count);
+    Serial.println(" pending samples)");
+  #endif
+}
+
+/**********************************************************************
+ * Save anything which has yet to be published and deep sleep for the
+ * sleep interval (or until RST is pulled low by an input edge). The
+ * newest of any batch or outage samples which do not fit in RTC memory
+ * are moved to flash.
+ */
+void goToSleep() {
+  SAMPLE samples[SLEEP_STATE_PENDING_MAX];
+  unsigned long sleepInterval = pipeline.getConfig().sleepInterval;
+  size_t count = sampleBatch.getCount();
+
+  requeueReliable();
+  if (count > SLEEP_STATE_PENDING_MAX) count = SLEEP_STATE_PENDING_MAX;
+  memcpy(samples, sampleBatch.getSamples(), (count * sizeof(SAMPLE)));
+  for (size_t i = count; i < sampleBatch.getCount(); i++) sampleStore.push(sampleBatch.getSamples()[i]);
+  count += sampleStore.drain(samples + count, SLEEP_STATE_PENDING_MAX - count);
+  sampleStore.flush();
+  sleepState.setPending(samples, count);
+  #ifdef MQTT_TLS
+  TLS_CLIENT_STATE tlsState;
+  wifiClient.getState(tlsState);
+  sleepState.setSession(&tlsState, sizeof(tlsState));
+  #endif
+  if (fastConnect != WIFI_FAST_CONNECT_OFF) {
+    if (WiFi.status() == WL_CONNECTED) wifiCache.update(); else wifiCache.invalidate();
+  }
+  if (mqttClient.connected()) mqttClient.disconnect();
+  wifiClient.flush();
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Sleeping for ");
+    Serial.print(sleepInterval);
+    Serial.println(" ms");
+    Serial.flush();
+  #endif
+
+  sleepState.sleep(sleepInterval);
+}
+
+/**********************************************************************
+ * In sleep mode, sleep as soon as this wake's work is done: that is,
+ * once the sensors have been sampled and nothing remains to publish
+ * or (whilst we are connected) to forward. A wake which cannot finish
+ * within SLEEP_CYCLE_TIMEOUT sleeps anyway.
+ */
+void maintainSleep(unsigned long now, bool sampled, bool connected) {
+  bool busy = ((!sampled) || (publishPolicy.isDue(now)) || (publishPolicy.isPending()) || (sampleBatch.isDue(now)) || ((connected) && ((!sampleStore.isEmpty()) || (!inflightWindow.isEmpty()))) || (otaUpdater.isPending()));
+
+  if ((pipeline.getConfig().sleepInterval == 0) || ((busy) && (now < SLEEP_CYCLE_TIMEOUT))) return;
+  goToSleep();
+}
+
+/**********************************************************************
+ * Resume the WiFi connection after a wake from deep sleep. The SDK
+ * still holds the network credentials, so there is no need to involve
+ * the WiFi manager, and MQTT connection waits on the result in loop().
+ * A cached connection which fails is invalidated by goToSleep().
+ */
+bool resumeWiFi() {
+  if ((fastConnect == WIFI_FAST_CONNECT_OFF) || (!wifiCache.begin(fastConnect == WIFI_FAST_CONNECT_STATIC))) {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin();
+  }
+  return(true);
+}
+
+/**********************************************************************
+ * Try to connect to the host network using the details cached from
+ * our previous connection, returning false if that is not possible.
+ */
+bool fastConnectWiFi() {
+  return((fastConnect != WIFI_FAST_CONNECT_OFF) && (wifiCache.connect((fastConnect == WIFI_FAST_CONNECT_STATIC), WIFI_FAST_CONNECT_TIMEOUT)));
+}
+
+/**********************************************************************
+ * Load the filter settings from <config>, falling back to the default
+ * for any which are out of range (as they will be in a configuration
+ * saved by older firmware).
+ */
+void loadFilterConfig(USER_CONFIGURATION &config) {
+  filterMode = ((config.filtermode >= SAMPLE_FILTER_NONE) && (config.filtermode <= SAMPLE_FILTER_MEDIAN))?config.filtermode:CF_DEFAULT_FILTER_MODE;
+  temperatureDeadband = ((config.temperaturedeadband >= 0) && (config.temperaturedeadband <= CF_MAX_DEADBAND))?config.temperaturedeadband:CF_DEFAULT_TEMPERATURE_DEADBAND;
+  humidityDeadband = ((config.humiditydeadband >= 0) && (config.humiditydeadband <= CF_MAX_DEADBAND))?config.humiditydeadband:CF_DEFAULT_HUMIDITY_DEADBAND;
+  luxDeadband = ((config.luxdeadband >= 0) && (config.luxdeadband <= CF_MAX_DEADBAND))?config.luxdeadband:CF_DEFAULT_LUX_DEADBAND;
+}
+
+/**********************************************************************
+ * Put the settings in <config> into effect, falling back to the
+ * default for any which are out of range. Those in COMMAND_SETTINGS
+ * can be changed whilst running (see runCommand()); the others only
+ * take effect from setup().
+ */
+void applyConfig(USER_CONFIGURATION &config) {
+  PIPELINE_CONFIG pipelineConfig;
+
+  pipelineConfig.softInterval = (config.softpublicationinterval > 0)?config.softpublicationinterval:CF_DEFAULT_MQTT_PUBLISH_SOFT_INTERVAL;
+  pipelineConfig.hardInterval = (config.hardpublicationinterval > 0)?config.hardpublicationinterval:CF_DEFAULT_MQTT_PUBLISH_HARD_INTERVAL;
+  pipelineConfig.sampleInterval = (config.sampleinterval > 0)?config.sampleinterval:CF_DEFAULT_SAMPLE_INTERVAL;
+  pipelineConfig.immediateChannels = ((config.immediatechannels >= 0) && (config.immediatechannels <= SAMPLE_CHANNEL_ALL))?config.immediatechannels:CF_DEFAULT_IMMEDIATE_CHANNELS;
+  pipelineConfig.rollupWindow = ((config.rollupwindow == 0) || ((config.rollupwindow >= CF_MIN_ROLLUP_WINDOW) && (config.rollupwindow <= CF_MAX_ROLLUP_WINDOW)))?config.rollupwindow:CF_DEFAULT_ROLLUP_WINDOW;
+  pipelineConfig.sleepInterval = ((config.sleepinterval > 0) && (config.sleepinterval <= SLEEP_MAX_INTERVAL))?config.sleepinterval:CF_DEFAULT_SLEEP_INTERVAL;
+  pipelineConfig.cycleTimeout = SLEEP_CYCLE_TIMEOUT;
+  pipelineConfig.channelTopics = ((config.channeltopics == 0) || (config.channeltopics == 1))?config.channeltopics:CF_DEFAULT_CHANNEL_TOPICS;
+  pipelineConfig.reliable = ((config.reliable == 0) || (config.reliable == 1))?config.reliable:CF_DEFAULT_MQTT_RELIABLE;
+  pipelineConfig.payloadFormat = ((config.payloadformat >= MQTT_PAYLOAD_JSON) && (config.payloadformat <= MQTT_PAYLOAD_BINARY))?config.payloadformat:CF_DEFAULT_MQTT_PAYLOAD_FORMAT;
+  pipeline.configure(pipelineConfig, millis());
+  scheduler.setInterval(sampleTaskId, pipeline.getSampleInterval());
+  loadFilterConfig(config);
+  sampleFilter.configure(filterMode, temperatureDeadband, humidityDeadband, luxDeadband);
+  #ifdef SENSOR_DS18B20
+  ds18b20Resolution = ((config.ds18b20resolution >= CF_MIN_DS18B20_RESOLUTION) && (config.ds18b20resolution <= CF_MAX_DS18B20_RESOLUTION))?config.ds18b20resolution:CF_DEFAULT_DS18B20_RESOLUTION;
+  ds18b20Driver.setResolution(ds18b20Resolution);
+  #endif
+}
+
+/**********************************************************************
+ * Settings which can be changed through the command topic, named as
+ * in the configuration portal, and the values accepted for each.
+ */
+struct COMMAND_SETTING {
+  const char *name;
+  size_t offset;                          // Of an int in USER_CONFIGURATION
+  long min;
+  long max;
+};
+#define COMMAND_INT(name, field, min, max) { name, offsetof(USER_CONFIGURATION, field), min, max }
+
+const COMMAND_SETTING COMMAND_SETTINGS[] = {
+  COMMAND_INT("softinterval", softpublicationinterval, 1, MQTT_COMMAND_MAX_INTERVAL),
+  COMMAND_INT("hardinterval", hardpublicationinterval, 1, MQTT_COMMAND_MAX_INTERVAL),
+  COMMAND_INT("sampleinterval", sampleinterval, 0, MQTT_COMMAND_MAX_INTERVAL),
+  COMMAND_INT("immediatechannels", immediatechannels, 0, SAMPLE_CHANNEL_ALL),
+  COMMAND_INT("filtermode", filtermode, SAMPLE_FILTER_NONE, SAMPLE_FILTER_MEDIAN),
+  COMMAND_INT("temperaturedeadband", temperaturedeadband, 0, CF_MAX_DEADBAND),
+  COMMAND_INT("humiditydeadband", humiditydeadband, 0, CF_MAX_DEADBAND),
+  COMMAND_INT("luxdeadband", luxdeadband, 0, CF_MAX_DEADBAND),
+  COMMAND_INT("ds18b20resolution", ds18b20resolution, CF_MIN_DS18B20_RESOLUTION, CF_MAX_DS18B20_RESOLUTION),
+  COMMAND_INT("rollupwindow", rollupwindow, 0, CF_MAX_ROLLUP_WINDOW),
+};
+#define COMMAND_SETTING_COUNT (sizeof(COMMAND_SETTINGS) / sizeof(COMMAND_SETTINGS[0]))
+
+/**********************************************************************
+ * Apply each word of <command> to <config>: "name=value" changes a
+ * setting and a bare name requests one of the MQTT_COMMAND_ actions,
+ * whose bits are returned in <actions> (along with
+ * MQTT_COMMAND_CHANGED if any setting actually changed). Returns NULL
+ * on success, otherwise the name of the first word which is not
+ * understood (or whose value is out of range).
+ */
+const char *parseCommand(char *command, USER_CONFIGURATION &config, uint8_t &actions) {
+  char *context, *token, *value, *end;
+  const COMMAND_SETTING *setting;
+  long n;
+
+  actions = 0;
+  for (token = strtok_r(command, MQTT_COMMAND_SEPARATORS, &context); token; token = strtok_r(NULL, MQTT_COMMAND_SEPARATORS, &context)) {
+    if ((value = strchr(token, '='))) {
+      *value++ = 0;
+      setting = NULL;
+      for (uint8_t i = 0; (i < COMMAND_SETTING_COUNT) && (!setting); i++) {
+        if (!strcmp(token, COMMAND_SETTINGS[i].name)) setting = &COMMAND_SETTINGS[i];
+      }
+      n = strtol(value, &end, 10);
+      if ((!setting) || (end == value) || (*end) || (n < setting->min) || (n > setting->max)) return(token);
+      int *field = (int*) (((uint8_t*) &config) + setting->offset);
+      if (*field != n) actions |= MQTT_COMMAND_CHANGED;
+      *field = n;
+    } else if (!strcmp(token, "sample")) {
+      actions |= MQTT_COMMAND_SAMPLE;
+    } else if (!strcmp(token, "publish")) {
+      actions |= MQTT_COMMAND_PUBLISH;
+    } else if (!strcmp(token, "rescan")) {
+      actions |= MQTT_COMMAND_RESCAN;
+    } else if (!strcmp(token, "reboot")) {
+      actions |= MQTT_COMMAND_REBOOT;
+    } else if ((!strcmp(token, "update")) && (config.otamanifest[0])) {
+      actions |= MQTT_COMMAND_UPDATE;
+    } else {
+      return(token);
+    }
+  }
+  return(NULL);
+}
+
+/**********************************************************************
+ * MQTT callback: take a copy of each command received on the command
+ * topic for runPendingCommand(). Nothing may be published from here,
+ * since that would overwrite the client's buffer (and with it
+ * <payload>). The empty message which clears the topic is ignored.
+ */
+void commandCallback(char *topic, uint8_t *payload, unsigned int length) {
+  if ((length == 0) || (strcmp(topic, mqttCommandTopic))) return;
+  commandTooLong = (length >= sizeof(pendingCommand));
+  if (commandTooLong) length = 0;
+  memcpy(pendingCommand, payload, length);
+  pendingCommand[length] = 0;
+  commandPending = true;
+}
+
+/**********************************************************************
+ * Act upon the command most recently received, if any. A command is
+ * applied in full or not at all: changed settings take effect at once
+ * and are saved to EEPROM, then any requested actions are performed.
+ * The outcome is published to the command result subtopic. A retained
+ * command would run again on every connection, so the command topic
+ * is then cleared.
+ */
+void runPendingCommand() {
+  static char mqttCommandResultTopic[MQTT_TOPIC_SIZE];
+  static char mqttCommandResultMessage[MQTT_COMMAND_SIZE + 40];
+  USER_CONFIGURATION config;
+  const char *error;
+  uint8_t actions = 0;
+
+  if (!commandPending) return;
+  commandPending = false;
+  config = mqttConfig;
+  error = (commandTooLong)?"(too long)":parseCommand(pendingCommand, config, actions);
+  if (!error) {
+    if (actions & MQTT_COMMAND_CHANGED) {
+      // New devices settle on a new resolution only when scanned.
+      if (config.ds18b20resolution != mqttConfig.ds18b20resolution) actions |= MQTT_COMMAND_RESCAN;
+      mqttConfig = config;
+      applyConfig(mqttConfig);
+      saveConfig(mqttConfig);
+    }
+    if (actions & MQTT_COMMAND_SAMPLE) scheduler.trigger(sampleTaskId);
+    if (actions & MQTT_COMMAND_PUBLISH) publishPolicy.notifyChange();
+    // In sleep mode wakes are already spread out.
+    if (actions & MQTT_COMMAND_UPDATE) otaUpdater.request(millis(), (pipeline.getConfig().sleepInterval)?0UL:OTA_STAGGER_WINDOW);
+    #ifdef SENSOR_DS18B20
+    if (actions & MQTT_COMMAND_RESCAN) ds18b20Driver.rescan();
+    #endif
+  }
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Command ");
+    if (error) {
+      Serial.print("failed at ");
+      Serial.println(error);
+    } else {
+      Serial.println("succeeded");
+    }
+  #endif
+
+  snprintf(mqttCommandResultTopic, sizeof(mqttCommandResultTopic), MQTT_COMMAND_RESULT_TOPIC_FORMAT, mqttConfig.topic);
+  snprintf(mqttCommandResultMessage, sizeof(mqttCommandResultMessage), MQTT_COMMAND_RESULT_MESSAGE, (error)?"error":"ok", (error)?error:"");
+  publishText(mqttCommandResultTopic, mqttCommandResultMessage, false);
+  publishText(mqttCommandTopic, "", true);
+  if ((!error) && (actions & MQTT_COMMAND_REBOOT)) {
+    // Keep anything yet to be published.
+    requeueReliable();
+    sampleStore.flush();
+    mqttClient.disconnect();
+    ESP.restart();
+  }
+}
+
+/**********************************************************************
+ * Task: keep us connected to the MQTT server and, if we are connected,
+ * perform the client's connection housekeeping (which is when any
+ * QoS 1 acknowledgements arrive). Failed connection attempts are
+ * retried with an increasing backoff, but we never wait here so
+ * sampling continues through any outage.
+ */
+void mqttTask(void *arg) {
+  mqttConnected = maintainMqttConnection();
+  if (mqttConnected) {
+    {
+      PROFILE_SECTION("mqtt.loop");
+      mqttClient.loop();
+    }
+    runPendingCommand();
+  }
+  serviceReliable((mqttConnected) && (mqttClient.connected()));
+}
+
+/**********************************************************************
+ * Task: once every sample interval ask every sensor for a new
+ * reading.
+ */
+void sampleTask(void *arg) {
+  pipeline.sample();
+}
+
+/**********************************************************************
+ * Task: move the acquisition of the sensor whose index is <arg> along,
+ * telling publishPolicy of any change.
+ */
+void pollSensorTask(void *arg) {
+  pipeline.poll((uint8_t) (uintptr_t) arg);
+}
+
+/**********************************************************************
+ * Task: publish (or queue) the sensor state whenever publishPolicy
+ * says so and any batch which is ready.
+ */
+void publishTask(void *arg) {
+  pipeline.publish(millis(), mqttConnected);
+}
+
+/**********************************************************************
+ * Task: whilst we are connected forward a batch of anything queued
+ * during an outage and, once per boot, the boot profile.
+ */
+void forwardTask(void *arg) {
+  if (!mqttConnected) return;
+  forwardBacklog();
+  if ((!bootProfilePublished) && (bootProfile.isMarked("publish"))) publishBootProfile();
+}
+
+/**********************************************************************
+ * Task: in sleep mode go back to sleep as soon as there is nothing
+ * left to do.
+ */
+void sleepTask(void *arg) {
+  maintainSleep(millis(), sensors.isReady(), mqttConnected);
+}
+
+/**********************************************************************
+ * Task: once the rollup window has ended, stream the channel
+ * statistics to the stats subtopic (measuring them first, as in
+ * publishJson()) and start a new window. Whilst they can't be
+ * published the window simply grows, so no readings are lost and the
+ * "window" property says how long it was.
+ */
+void rollupTask(void *arg) {
+  static char mqttRollupTopic[MQTT_TOPIC_SIZE];
+  unsigned long now = millis();
+  size_t length, written;
+  bool published;
+
+  if ((!mqttConnected) || (!sampleRollup.isDue(now))) return;
+  sprintf(mqttRollupTopic, MQTT_ROLLUP_TOPIC_FORMAT, mqttConfig.topic);
+  length = sampleRollup.toJson((Print*) NULL, now);
+  if ((length == 0) || (!mqttClient.beginPublish(mqttRollupTopic, length, false))) {
+    metrics.recordPublish(false);
+    return;
+  }
+  written = sampleRollup.toJson(&mqttClient, now);
+  if (written != length) {
+    mqttClient.disconnect();
+    metrics.recordPublish(false);
+    return;
+  }
+  published = (mqttClient.endPublish() > 0);
+  metrics.recordPublish(published);
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Publishing ");
+    sampleRollup.toJson(&Serial, now);
+    Serial.print(" to ");
+    Serial.println(mqttRollupTopic);
+  #endif
+
+  if (published) sampleRollup.reset(now);
+}
+
+/**********************************************************************
+ * Task: publish the scheduler's task statistics to the tasks subtopic
+ * and start a new period for them.
+ */
+void statsTask(void *arg) {
+  static char mqttTasksTopic[MQTT_TOPIC_SIZE];
+  static char mqttTasksMessage[MQTT_TASKS_MESSAGE_SIZE];
+
+  if ((!mqttConnected) || (!scheduler.toJson(mqttTasksMessage, sizeof(mqttTasksMessage)))) return;
+  sprintf(mqttTasksTopic, MQTT_TASKS_TOPIC_FORMAT, mqttConfig.topic);
+  if (publishText(mqttTasksTopic, mqttTasksMessage, false)) scheduler.reset();
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Publishing ");
+    Serial.print(mqttTasksMessage);
+    Serial.print(" to ");
+    Serial.println(mqttTasksTopic);
+  #endif
+}
+
+#ifdef PROFILER
+/**********************************************************************
+ * Publish the cycle counts of the profiled sections to the profile
+ * subtopic (and dump them to serial) and start a new period.
+ */
+void publishProfile() {
+  static char mqttProfileTopic[MQTT_TOPIC_SIZE];
+  static char mqttProfileMessage[MQTT_PROFILE_MESSAGE_SIZE];
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Profile (cycles at ");
+    Serial.print(ESP.getCpuFreqMHz());
+    Serial.println(" MHz):");
+    Profiler::dump(Serial);
+  #endif
+
+  if (!Profiler::toJson(mqttProfileMessage, sizeof(mqttProfileMessage))) return;
+  sprintf(mqttProfileTopic, MQTT_PROFILE_TOPIC_FORMAT, mqttConfig.topic);
+  if (publishText(mqttProfileTopic, mqttProfileMessage, false)) Profiler::reset();
+}
+#endif
+
+/**********************************************************************
+ * Task: publish run time metrics to the metrics subtopic and start a
+ * new period for the histograms.
+ */
+void metricsTask(void *arg) {
+  static char mqttMetricsTopic[MQTT_TOPIC_SIZE];
+  static char mqttMetricsMessage[MQTT_METRICS_MESSAGE_SIZE];
+  METRICS_SYSTEM system;
+
+  if (!mqttConnected) return;
+  system.freeHeap = ESP.getFreeHeap();
+  system.heapFragmentation = ESP.getHeapFragmentation();
+  system.rssi = WiFi.RSSI();
+  system.connects = mqttReconnector.getConnects();
+  system.connectFailures = mqttReconnector.getFailures();
+  if (!metrics.toJson(mqttMetricsMessage, sizeof(mqttMetricsMessage), system)) return;
+  sprintf(mqttMetricsTopic, MQTT_METRICS_TOPIC_FORMAT, mqttConfig.topic);
+  if (publishText(mqttMetricsTopic, mqttMetricsMessage, false)) metrics.reset();
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Publishing ");
+    Serial.print(mqttMetricsMessage);
+    Serial.print(" to ");
+    Serial.println(mqttMetricsTopic);
+  #endif
+
+  #ifdef PROFILER
+  publishProfile();
+  #endif
+}
+
+/**********************************************************************
+ * Task: once a requested update falls due, update the firmware from
+ * the configured manifest and report the outcome to the OTA subtopic.
+ * A new image is installed by restarting, after saving anything yet
+ * to be published.
+ */
+void otaTask(void *arg) {
+  static char mqttOtaTopic[MQTT_TOPIC_SIZE];
+  static char mqttOtaMessage[200];
+  WiFiClient otaClient;
+  uint8_t result;
+
+  if ((!otaUpdater.isDue(millis())) || (WiFi.status() != WL_CONNECTED)) return;
+
+  #ifdef DEBUG_SERIAL
+    Serial.print("Checking for an update from ");
+    Serial.println(mqttConfig.otamanifest);
+  #endif
+
+  result = otaUpdater.run(otaClient, mqttConfig.otamanifest);
+  sprintf(mqttOtaTopic, MQTT_OTA_TOPIC_FORMAT, mqttConfig.topic);
+  snprintf(mqttOtaMessage, sizeof(mqttOtaMessage), MQTT_OTA_MESSAGE, FIRMWARE_BUILD, FIRMWARE_VERSION, otaUpdater.getAvailableVersion(), (result == OTA_UPDATER_UPDATED)?"updated":((result == OTA_UPDATER_CURRENT)?"current":"failed"), otaUpdater.getError());
+  if (mqttClient.connected()) publishText(mqttOtaTopic, mqttOtaMessage, false);
+
+  #ifdef DEBUG_SERIAL
+    Serial.println(mqttOtaMessage);
+  #endif
+
+  if (result == OTA_UPDATER_UPDATED) {
+    requeueReliable();
+    sampleStore.flush();
+    if (mqttClient.connected()) mqttClient.disconnect();
+    ESP.restart();
+  }
+}
+
+/**********************************************************************
+ * Returns <name> if it is a usable JSON property name, otherwise
+ * <fallback>.
+ */
+const char *validPropertyName(char *name, const char *fallback) {
+  size_t length = strnlen(name, MQTT_PROPERTY_NAME_SIZE);
+
+  if ((length == 0) || (length == MQTT_PROPERTY_NAME_SIZE)) return(fallback);
+  for (size_t i = 0; i < length; i++) {
+    if ((name[i] < ' ') || (name[i] > '~') || (name[i] == '"') || (name[i] == '\\')) return(fallback);
+  }
+  return(name);
+}
+
+/**********************************************************************
+ * The fields offered by the configuration portal, in the order in
+ * which they appear. On the ESP8266 string literals occupy RAM for
+ * the life of the program, so the table (names and all) is kept in
+ * flash and only copied into RAM by runConfigPortal(). A string
+ * field accepts as many characters as USER_CONFIGURATION can hold.
+ */
+struct PORTAL_FIELD {
+  char id[20];                    // Form parameter name
+  char label[24];                 // Placeholder text
+  uint16_t offset;                // Of the field in USER_CONFIGURATION
+  uint8_t length;                 // Characters accepted
+  bool string;                    // Otherwise an int
+};
+#define PORTAL_STRING(id, label, field) { id, label, offsetof(USER_CONFIGURATION, field), (sizeof(((USER_CONFIGURATION*) 0)->field) - 1), true }
+#define PORTAL_INT(id, label, field, length) { id, label, offsetof(USER_CONFIGURATION, field), length, false }
+
+const PORTAL_FIELD PORTAL_FIELDS[] PROGMEM = {
+  PORTAL_STRING("server", "mqtt server", servername),
+  PORTAL_INT("port", "mqtt port", serverport, 6),
+  PORTAL_STRING("user", "mqtt user", username),
+  PORTAL_STRING("pass", "mqtt pass", password),
+  PORTAL_STRING("topic", "mqtt topic", topic),
+  PORTAL_INT("softinterval", "mqtt soft interval", softpublicationinterval, 6),
+  PORTAL_INT("hardinterval", "mqtt hard interval", hardpublicationinterval, 6),
+  PORTAL_INT("sampleinterval", "sample interval", sampleinterval, 6),
+  PORTAL_INT("immediatechannels", "immediate channels", immediatechannels, 3),
+  PORTAL_INT("channeltopics", "channel topics", channeltopics, 2),
+  PORTAL_INT("reliable", "reliable delivery", reliable, 2),
+  PORTAL_INT("rollupwindow", "rollup window", rollupwindow, 8),
+  PORTAL_STRING("otamanifest", "ota manifest url", otamanifest),
+  #ifdef MQTT_TLS
+  PORTAL_STRING("fingerprint", "tls fingerprint", fingerprint),
+  #endif
+  #if SWITCH_COUNT > 0
+  PORTAL_STRING("sw0alias", "alias for sw0", sw0propertyname),
+  #endif
+  #if SWITCH_COUNT > 1
+  PORTAL_STRING("sw1alias", "alias for sw1", sw1propertyname),
+  #endif
+  #if SWITCH_COUNT > 2
+  PORTAL_STRING("sw2alias", "alias for sw2", sw2propertyname),
+  #endif
+  #if SWITCH_COUNT > 3
+  PORTAL_STRING("sw3alias", "alias for sw3", sw3propertyname),
+  #endif
+  PORTAL_INT("batchsize", "mqtt batch size", batchsize, 3),
+  PORTAL_INT("batchwindow", "mqtt batch window", batchwindow, 7),
+  PORTAL_INT("payloadformat", "mqtt payload format", payloadformat, 2),
+  PORTAL_INT("sleepinterval", "sleep interval", sleepinterval, 9),
+  PORTAL_INT("fastconnect", "wifi fast connect", fastconnect, 2),
+  PORTAL_INT("filtermode", "smoothing", filtermode, 2),
+  PORTAL_INT("temperaturedeadband", "temperature deadband", temperaturedeadband, 6),
+  PORTAL_INT("humiditydeadband", "humidity deadband", humiditydeadband, 6),
+  PORTAL_INT("luxdeadband", "lux deadband", luxdeadband, 6),
+  PORTAL_INT("ds18b20resolution", "ds18b20 resolution", ds18b20resolution, 3),
+};
+#define PORTAL_FIELD_COUNT (sizeof(PORTAL_FIELDS) / sizeof(PORTAL_FIELDS[0]))
+
+/**********************************************************************
+ * Connect to the host network through WiFiManager, which opens the
+ * configuration portal if it can't connect with the credentials it
+ * already has (and always if there is no user configuration). The
+ * portal is initialised with either the loaded configuration or with
+ * some anaemic defaults and, if the user saves it, the new settings
+ * are saved to EEPROM. Returns true if we are connected.
+ *
+ * WiFiManager and its parameters exist only for the duration of this
+ * call, so a node which connects from its cache never allocates them
+ * and one which doesn't has given back their heap before production
+ * starts.
+ */
+bool runConfigPortal() {
+  USER_CONFIGURATION config = mqttConfig;
+  PORTAL_FIELD *fields = new PORTAL_FIELD[PORTAL_FIELD_COUNT];
+  WiFiManagerParameter *parameters[PORTAL_FIELD_COUNT];
+  WiFiManager wifiManager;
+  uint8_t *base = (uint8_t*) &config;
+  char buffer[12];
+  bool res;
+
+  // The portal shows the settings in effect, which may be defaults
+  // standing in for values which are missing or out of range.
+  if (!userConfigurationLoaded) {
+    wifiManager.resetSettings();
+    sprintf(config.topic, CF_DEFAULT_MQTT_TOPIC_FORMAT, moduleId);
+    strcpy(config.sw0propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW0);
+    strcpy(config.sw1propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW1);
+    strcpy(config.sw2propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW2);
+    strcpy(config.sw3propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW3);
+  }
+  config.fastconnect = fastConnect;
+  config.filtermode = filterMode;
+  config.temperaturedeadband = temperatureDeadband;
+  config.humiditydeadband = humidityDeadband;
+  config.luxdeadband = luxDeadband;
+  config.ds18b20resolution = ds18b20Resolution;
+
+  // Create a parameter for each field and configure the WiFiManager.
+  memcpy_P(fields, PORTAL_FIELDS, sizeof(PORTAL_FIELDS));
+  wifiManager.setConfigPortalTimeout(AP_PORTAL_TIMEOUT);
+  wifiManager.setSaveConfigCallback(saveConfigCallback);
+  wifiManager.setBreakAfterConfig(true);
+  for (size_t i = 0; i < PORTAL_FIELD_COUNT; i++) {
+    const char *value = (const char*) (base + fields[i].offset);
+
+    if (!fields[i].string) {
+      sprintf(buffer, "%d", *((int*) (base + fields[i].offset)));
+      value = buffer;
+    }
+    parameters[i] = new WiFiManagerParameter(fields[i].id, fields[i].label, value, fields[i].length);
+    wifiManager.addParameter(parameters[i]);
+  }
+
+  res = wifiManager.autoConnect(moduleId);
+
+  // The WiFi manager may have connected to its host network or not as
+  // indicated by the value of res. In either case, it may have been in
+  // configuration mode and had its configuration settings changed (as
+  // indicated by shouldSaveConfig) and we need in this case to make
+  // sure we preserve our user configuration.
+  if (shouldSaveConfig) {
+    for (size_t i = 0; i < PORTAL_FIELD_COUNT; i++) {
+      if (fields[i].string) {
+        strcpy((char*) (base + fields[i].offset), parameters[i]->getValue());
+      } else {
+        *((int*) (base + fields[i].offset)) = atoi(parameters[i]->getValue());
+      }
+    }
+    mqttConfig = config;
+    saveConfig(mqttConfig);
+  }
+
+  for (size_t i = 0; i < PORTAL_FIELD_COUNT; i++) delete parameters[i];
+  delete[] fields;
+  return(res);
+}
+
+#ifdef MQTT_TLS
+/**********************************************************************
+ * Tell wifiClient how to authenticate the MQTT server: by the
+ * configured certificate fingerprint or, failing that, against the CA
+ * certificate in TLS_CA_CERTIFICATE_FILE on the flash filesystem
+ * (uploaded with 'pio run -t uploadfs'), in which case the clock is
+ * set by SNTP. With neither, we never connect: credentials are not
+ * sent to a server we can't authenticate.
+ */
+void configureTls() {
+  File file;
+  char *pem;
+  size_t length;
+
+  if (mqttConfig.fingerprint[0]) {
+    if (!wifiClient.useFingerprint(mqttConfig.fingerprint)) {
+      #ifdef DEBUG_SERIAL
+        Serial.println("TLS fingerprint is invalid");
+      #endif
+    }
+    return;
+  }
+  if ((!LittleFS.begin()) || (!(file = LittleFS.open(TLS_CA_CERTIFICATE_FILE, "r")))) {
+    #ifdef DEBUG_SERIAL
+      Serial.println("No TLS fingerprint or CA certificate: MQTT disabled");
+    #endif
+    return;
+  }
+  length = file.size();
+  if ((length > 0) && (length <= TLS_CA_CERTIFICATE_MAX)) {
+    pem = new char[length + 1];
+    pem[file.readBytes(pem, length)] = 0;
+    if (wifiClient.useCertificate(pem)) configTime(0, 0, TLS_NTP_SERVER);
+    delete[] pem;
+  }
+  file.close();
+
+  #ifdef DEBUG_SERIAL
+    Serial.println((wifiClient.isConfigured())?"Using pinned CA certificate":"CA certificate is invalid");
+  #endif
+}
+#endif
+
+void setup() {
+  
+  #ifdef DEBUG_SERIAL
+  Serial.begin(57600);
+  delay(DEBUG_SERIAL_START_DELAY);
+  #endif
+  bootProfile.mark("serial");
+
+  // Recover device MAC address and make from it a module identifier
+  // that will be used as access point name, MQTT client id and a
+  // component of the topic path (unless overriden by the user).
+  WiFi.macAddress(macAddress);
+  sprintf(moduleId, MODULE_ID_FORMAT, macAddress[0], macAddress[1], macAddress[2], macAddress[3], macAddress[4], macAddress[5]);
+
+  // Try to load user configuration. If we are configured to sleep then
+  // we may also have state saved by the previous wake.
+  userConfigurationLoaded = loadConfig(mqttConfig);
+  bootProfile.mark("config");
+  fastConnect = ((userConfigurationLoaded) && (mqttConfig.fastconnect >= WIFI_FAST_CONNECT_OFF) && (mqttConfig.fastconnect <= WIFI_FAST_CONNECT_STATIC))?mqttConfig.fastconnect:CF_DEFAULT_WIFI_FAST_CONNECT;
+  if (userConfigurationLoaded) wifiCache.load();
+  if (userConfigurationLoaded) loadFilterConfig(mqttConfig);
+  ds18b20Resolution = ((userConfigurationLoaded) && (mqttConfig.ds18b20resolution >= CF_MIN_DS18B20_RESOLUTION) && (mqttConfig.ds18b20resolution <= CF_MAX_DS18B20_RESOLUTION))?mqttConfig.ds18b20resolution:CF_DEFAULT_DS18B20_RESOLUTION;
+  bool woke = ((userConfigurationLoaded) && (mqttConfig.sleepinterval > 0) && (mqttConfig.sleepinterval <= SLEEP_MAX_INTERVAL) && (sleepState.begin()));
+
+  // Now connect to the host network. When waking we don't wait
+  // for the connection. Otherwise we try the cached connection and
+  // fall back to the configuration portal if that fails.
+  bool res = (woke)?resumeWiFi():((fastConnectWiFi()) || (runConfigPortal()));
+  bootProfile.mark("wifi");
+
+  // If we are connected to our host network, then we can continue into
+  // production; if not, then let's reboot and go around again.
+  if (!res) {
+    #ifdef DEBUG_SERIAL
+      Serial.println("WiFi configuration or connection failure: restarting system.");
+    #endif
+    ESP.restart();
+  } else {
+    #ifdef DEBUG_SERIAL
+      Serial.print("Connected to wireless network '");
+      Serial.print(WiFi.SSID());
+      Serial.println("'");
+    #endif
+
+    // We have a WiFi connection, so configure the MQTT connection. 
+    // We'll leave actually registering with the MQTT server until we
+    // are in the loop().
+    mqttClient.setServer(mqttConfig.servername, mqttConfig.serverport);
+    mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+    mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
+    mqttReconnector.begin(moduleId, mqttConfig.username, mqttConfig.password);
+    mqttClient.setCallback(commandCallback);
+    sampleBatch.configure(
+      ((mqttConfig.batchsize > 0) && (mqttConfig.batchsize <= SAMPLE_BATCH_MAX))?mqttConfig.batchsize:CF_DEFAULT_MQTT_BATCH_SIZE,
+      (mqttConfig.batchwindow > 0)?mqttConfig.batchwindow:CF_DEFAULT_MQTT_BATCH_WINDOW
+    );
+    fastConnect = ((mqttConfig.fastconnect >= WIFI_FAST_CONNECT_OFF) && (mqttConfig.fastconnect <= WIFI_FAST_CONNECT_STATIC))?mqttConfig.fastconnect:CF_DEFAULT_WIFI_FAST_CONNECT;
+    if ((!woke) && (fastConnect != WIFI_FAST_CONNECT_OFF)) wifiCache.update();
+    applyConfig(mqttConfig);
+
+    // Time now to detect, set-up and initialise any connected sensors.
+    // Switch names saved by older firmware (or not yet saved at all)
+    // may be missing, so fall back to the defaults.
+    #if (SWITCH_COUNT > 0) || defined(SENSOR_PIR)
+    switchNames[0] = validPropertyName(mqttConfig.sw0propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW0);
+    switchNames[1] = validPropertyName(mqttConfig.sw1propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW1);
+    switchNames[2] = validPropertyName(mqttConfig.sw2propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW2);
+    switchNames[3] = validPropertyName(mqttConfig.sw3propertyname, CF_DEFAULT_PROPERTY_NAME_FOR_SW3);
+    #endif
+    sensors.begin();
+
+    #ifdef DEBUG_SERIAL
+      Serial.print("Detected sensors: ");
+      for (uint8_t i = 0; i < sensors.getCount(); i++) {
+        if (sensors.isPresent(i)) { Serial.print(sensors.getDriver(i)->getName()); Serial.print(" "); }
+      }
+      Serial.println();
+    #endif
+
+    // Prepare to publish, or queue, anything we sample.
+    sensors.describe(sampleNames);
+    sampleStore.begin(SAMPLE_STORE_USE_FLASH);
+    #ifdef MQTT_TLS
+    configureTls();
+    #endif
+    if (woke) restoreSleepState();
+    bootProfile.mark("sensors");
+
+    // Finally, set up the tasks which loop() will run. Each sensor
+    // present has a task of its own, so its statistics show how much
+    // time its bus costs us.
+    scheduler.add("mqtt", mqttTask, NULL, 0);
+    sampleTaskId = scheduler.add("sample", sampleTask, NULL, pipeline.getSampleInterval());
+    for (uint8_t i = 0; i < sensors.getCount(); i++) {
+      if (sensors.isPresent(i)) scheduler.add(sensors.getDriver(i)->getName(), pollSensorTask, (void*) (uintptr_t) i, 0);
+    }
+    scheduler.add("publish", publishTask, NULL, 0);
+    scheduler.add("forward", forwardTask, NULL, 0);
+    scheduler.add("ota", otaTask, NULL, OTA_POLL_INTERVAL);
+    scheduler.add("sleep", sleepTask, NULL, 0);
+    scheduler.add("stats", statsTask, NULL, MQTT_TASKS_INTERVAL);
+    scheduler.add("metrics", metricsTask, NULL, MQTT_METRICS_INTERVAL);
+    scheduler.add("rollup", rollupTask, NULL, ROLLUP_POLL_INTERVAL);
+
+    #ifdef DEBUG_SERIAL
+      Serial.print("Free heap entering production: ");
+      Serial.println(ESP.getFreeHeap());
+    #endif
+  }
+}
+
+/**********************************************************************
+ * Everything is done by the tasks added to scheduler in setup(), in
+ * order: MQTT housekeeping, sensor sampling, publication, forwarding
+ * of anything queued during an outage, any requested firmware update
+ * and, in sleep mode, going back to sleep as soon as there is nothing
+ * left to do. The publication rules are those of publishPolicy, which
+ * publishes changes no more often than the soft interval and
+ * otherwise re-publishes once every hard interval. The time taken by
+ * each pass is recorded in metrics.
+ */
+void loop() {
+  unsigned long start = micros();
+
+  scheduler.loop();
+  metrics.recordLoop(micros() - start);
+}
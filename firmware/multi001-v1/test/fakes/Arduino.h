@@ -0,0 +1,192 @@
+/**********************************************************************
+ * NAME
+ *   Arduino.h - host fake of the parts of the Arduino core used by
+ *   the libraries under test.
+ * DESCRIPTION
+ *   Everything is inline, so the fakes need no source files of their
+ *   own. The clock only moves when a test moves it: fakeMillis and
+ *   fakeMicros are returned by millis() and micros(), and fakeAdvance()
+ *   moves both along together.
+ *
+ *   Pins are simulated by fakePinLevels[]. fakeSetPin() changes the
+ *   level of a pin and, if the level changed and an interrupt is
+ *   attached to the pin with attachInterruptArg(), calls its handler
+ *   exactly as a CHANGE interrupt would.
+ *
+ *   Print keeps the interface of the real class but only write() is
+ *   needed by the code under test. FakePrint collects everything
+ *   written to it into a std::string and can be told to fail after a
+ *   given number of bytes.
+ *
+ *   unsigned long is 64 bits wide on most hosts, so code which relies
+ *   on 32-bit millis() wrap-around cannot be tested here and the clock
+ *   should be kept well away from the 32-bit limit.
+ */
+
+#ifndef FAKE_ARDUINO_H
+#define FAKE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define memcpy_P memcpy
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define FAKE_PINS 18                      // GPIO0..16 and A0
+#define digitalPinToInterrupt(p) (p)
+
+inline unsigned long fakeMillis = 0UL;
+inline unsigned long fakeMicros = 0UL;
+inline uint8_t fakePinLevels[FAKE_PINS];
+inline uint8_t fakePinModes[FAKE_PINS];
+inline void (*fakeHandlers[FAKE_PINS])(void*);
+inline void *fakeHandlerArgs[FAKE_PINS];
+inline unsigned long fakeRandomState = 1UL;
+
+inline unsigned long millis() { return(fakeMillis); }
+inline unsigned long micros() { return(fakeMicros); }
+
+/**********************************************************************
+ * Move the clock on by <ms> milliseconds.
+ */
+inline void fakeAdvance(unsigned long ms) {
+  fakeMillis += ms;
+  fakeMicros += (ms * 1000UL);
+}
+
+inline void fakeAdvanceMicros(unsigned long us) {
+  fakeMicros += us;
+  fakeMillis = (fakeMicros / 1000UL);
+}
+
+inline void delay(unsigned long ms) { fakeAdvance(ms); }
+inline void delayMicroseconds(unsigned int us) { fakeAdvanceMicros(us); }
+inline void yield() { }
+
+inline void pinMode(uint8_t pin, uint8_t mode) { if (pin < FAKE_PINS) fakePinModes[pin] = mode; }
+inline int digitalRead(uint8_t pin) { return((pin < FAKE_PINS)?fakePinLevels[pin]:LOW); }
+inline void digitalWrite(uint8_t pin, uint8_t level) { if (pin < FAKE_PINS) fakePinLevels[pin] = (level)?HIGH:LOW; }
+inline int analogRead(uint8_t pin) { return((pin < FAKE_PINS)?fakePinLevels[pin]:0); }
+
+inline void attachInterruptArg(uint8_t pin, void (*handler)(void*), void *arg, int mode) {
+  if (pin >= FAKE_PINS) return;
+  fakeHandlers[pin] = handler;
+  fakeHandlerArgs[pin] = arg;
+}
+
+inline void detachInterrupt(uint8_t pin) {
+  if (pin < FAKE_PINS) fakeHandlers[pin] = NULL;
+}
+
+/**********************************************************************
+ * Drive <pin> to <level>, raising its interrupt (if one is attached)
+ * when the level changes.
+ */
+inline void fakeSetPin(uint8_t pin, uint8_t level) {
+  if (pin >= FAKE_PINS) return;
+  level = (level)?HIGH:LOW;
+  if (fakePinLevels[pin] == level) return;
+  fakePinLevels[pin] = level;
+  if (fakeHandlers[pin]) fakeHandlers[pin](fakeHandlerArgs[pin]);
+}
+
+/**********************************************************************
+ * Put the clock, the pins and random() back to their initial state.
+ */
+inline void fakeReset() {
+  fakeMillis = fakeMicros = 0UL;
+  for (uint8_t i = 0; i < FAKE_PINS; i++) {
+    fakePinLevels[i] = LOW;
+    fakePinModes[i] = INPUT;
+    fakeHandlers[i] = NULL;
+    fakeHandlerArgs[i] = NULL;
+  }
+  fakeRandomState = 1UL;
+}
+
+inline long random(long howBig) {
+  fakeRandomState = ((fakeRandomState * 1103515245UL) + 12345UL) & 0x7fffffffUL;
+  return((howBig > 0)?(long) (fakeRandomState % howBig):0L);
+}
+
+inline long random(long howSmall, long howBig) {
+  return((howBig > howSmall)?(howSmall + random(howBig - howSmall)):howSmall);
+}
+
+inline void randomSeed(unsigned long seed) { fakeRandomState = seed; }
+
+class Print {
+  public:
+    virtual ~Print() { }
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+      size_t n = 0;
+      while ((size--) && (this->write(*buffer++))) n++;
+      return(n);
+    }
+    size_t write(const char *text) { return(this->write((const uint8_t*) text, strlen(text))); }
+    size_t print(const char *text) { return(this->write(text)); }
+    size_t print(long value) { char text[24]; snprintf(text, sizeof(text), "%ld", value); return(this->write(text)); }
+    size_t print(unsigned long value) { char text[24]; snprintf(text, sizeof(text), "%lu", value); return(this->write(text)); }
+    size_t print(int value) { return(this->print((long) value)); }
+    size_t print(unsigned int value) { return(this->print((unsigned long) value)); }
+    size_t println() { return(this->write("\r\n")); }
+    size_t println(const char *text) { return(this->print(text) + this->println()); }
+    virtual void flush() { }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+/**********************************************************************
+ * A Print which collects its output in <text>, accepting at most
+ * <limit> bytes before every further write fails.
+ */
+class FakePrint : public Print {
+  public:
+    FakePrint(size_t limit = (size_t) -1) : limit(limit) { }
+    using Print::write;
+    size_t write(uint8_t b) override {
+      if (this->text.size() >= this->limit) return(0);
+      this->text += (char) b;
+      return(1);
+    }
+    size_t write(const uint8_t *buffer, size_t size) override {
+      size_t n = (size < (this->limit - this->text.size()))?size:(this->limit - this->text.size());
+      this->text.append((const char*) buffer, n);
+      return(n);
+    }
+
+    std::string text;
+    size_t limit;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/**********************************************************************
+ * NAME
+ *   Client.h - host fake of the Arduino network client interface.
+ * DESCRIPTION
+ *   Client is the abstract interface of the real core. FakeClient is
+ *   a connection to nowhere: everything written to it is collected in
+ *   <sent>, and whatever a test appends to <received> is what it reads
+ *   back, so a test can play the broker's side of a conversation.
+ */
+
+#ifndef FAKE_CLIENT_H
+#define FAKE_CLIENT_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class Client : public Stream {
+  public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t *buf, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual bool flush(unsigned int maxWaitMs = 0) = 0;
+    virtual bool stop(unsigned int maxWaitMs = 0) = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+};
+
+class FakeClient : public Client {
+  public:
+    int connect(IPAddress ip, uint16_t port) override { this->isConnected = true; return(1); }
+    int connect(const char *host, uint16_t port) override { this->isConnected = true; return(1); }
+    size_t write(uint8_t b) override { return(this->write(&b, 1)); }
+    size_t write(const uint8_t *buf, size_t size) override {
+      if (!this->isConnected) return(0);
+      this->sent.append((const char*) buf, size);
+      return(size);
+    }
+    int available() override { return((int) (this->received.size() - this->position)); }
+    int read() override { return((this->position < this->received.size())?(uint8_t) this->received[this->position++]:-1); }
+    int read(uint8_t *buf, size_t size) override {
+      size_t n = 0;
+      while ((n < size) && (this->position < this->received.size())) buf[n++] = (uint8_t) this->received[this->position++];
+      return((int) n);
+    }
+    int peek() override { return((this->position < this->received.size())?(uint8_t) this->received[this->position]:-1); }
+    bool flush(unsigned int maxWaitMs = 0) override { return(true); }
+    bool stop(unsigned int maxWaitMs = 0) override { this->isConnected = false; return(true); }
+    uint8_t connected() override { return(this->isConnected); }
+    operator bool() override { return(this->isConnected); }
+
+    std::string sent;
+    std::string received;
+    size_t position = 0;
+    bool isConnected = true;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**********************************************************************
+ * NAME
+ *   EEPROM.h - host fake of the ESP8266 emulated EEPROM.
+ * DESCRIPTION
+ *   The EEPROM is a RAM array which survives begin() and end(), so a
+ *   test can save a configuration, "reboot" and load it again. As on
+ *   the target, commit() is what makes writes permanent: end() without
+ *   commit() discards any writes made since begin(). The commits
+ *   member counts the commits which changed the contents, so that a
+ *   test can check that nothing is written when nothing has changed.
+ */
+
+#ifndef FAKE_EEPROM_H
+#define FAKE_EEPROM_H
+
+#include <Arduino.h>
+
+#define FAKE_EEPROM_SIZE 4096
+
+class EEPROMClass {
+  public:
+    void begin(size_t size) {
+      this->size = (size < FAKE_EEPROM_SIZE)?size:FAKE_EEPROM_SIZE;
+      memcpy(this->data, this->flash, this->size);
+      this->open = true;
+    }
+    uint8_t read(int address) {
+      return(((this->open) && (address >= 0) && ((size_t) address < this->size))?this->data[address]:0);
+    }
+    void write(int address, uint8_t value) {
+      if ((this->open) && (address >= 0) && ((size_t) address < this->size)) this->data[address] = value;
+    }
+    bool commit() {
+      if (!this->open) return(false);
+      if (memcmp(this->flash, this->data, this->size) != 0) this->commits++;
+      memcpy(this->flash, this->data, this->size);
+      return(true);
+    }
+    bool end() {
+      this->open = false;
+      return(true);
+    }
+    size_t length() { return(this->size); }
+
+    /******************************************************************
+     * Erase the whole device to 0xFF, as from the factory.
+     */
+    void fakeErase() {
+      memset(this->flash, 0xff, sizeof(this->flash));
+      memset(this->data, 0xff, sizeof(this->data));
+      this->commits = 0;
+    }
+
+    uint8_t flash[FAKE_EEPROM_SIZE];      // Committed contents
+    unsigned long commits = 0;
+
+  private:
+    uint8_t data[FAKE_EEPROM_SIZE];       // Contents since begin()
+    size_t size = 0;
+    bool open = false;
+};
+
+inline EEPROMClass EEPROM;
+
+#endif
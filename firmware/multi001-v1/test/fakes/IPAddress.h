@@ -0,0 +1,23 @@
+/**********************************************************************
+ * NAME
+ *   IPAddress.h - host fake of the Arduino IPv4 address class.
+ */
+
+#ifndef FAKE_IP_ADDRESS_H
+#define FAKE_IP_ADDRESS_H
+
+#include <Arduino.h>
+
+class IPAddress {
+  public:
+    IPAddress() : address(0) { }
+    IPAddress(uint32_t address) : address(address) { }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | (b << 8) | (c << 16) | ((uint32_t) d << 24)) { }
+    operator uint32_t() const { return(this->address); }
+    bool isSet() const { return(this->address != 0); }
+
+  private:
+    uint32_t address;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/**********************************************************************
+ * NAME
+ *   LittleFS.h - host fake of the ESP8266 LittleFS filesystem.
+ * DESCRIPTION
+ *   Files are held in memory by name and survive end() and begin(),
+ *   so a test can leave a file behind, "reboot" and find it again.
+ *   Only the modes "r", "w" and "a" are supported.
+ *
+ *   fakeCapacity limits the total number of bytes held in all files,
+ *   so that a test can fill the filesystem: a write which does not fit
+ *   is shortened, as on the target. fakeMountable says whether begin()
+ *   succeeds and fakeWrites counts the calls to File::write().
+ */
+
+#ifndef FAKE_LITTLE_FS_H
+#define FAKE_LITTLE_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+
+class FS;
+
+class File : public Stream {
+  public:
+    File() : fs(NULL), offset(0), writable(false) { }
+    File(FS *fs, std::shared_ptr<std::string> data, size_t offset, bool writable) : fs(fs), data(data), offset(offset), writable(writable) { }
+    using Print::write;
+    size_t write(uint8_t b) override { return(this->write(&b, 1)); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override { return((this->data)?(int) (this->data->size() - this->offset):0); }
+    int read() override {
+      uint8_t b;
+      return((this->read(&b, 1) == 1)?b:-1);
+    }
+    size_t read(uint8_t *buf, size_t size) {
+      size_t n = 0;
+      if (!this->data) return(0);
+      while ((n < size) && (this->offset < this->data->size())) buf[n++] = (uint8_t) (*this->data)[this->offset++];
+      return(n);
+    }
+    int peek() override { return(((this->data) && (this->offset < this->data->size()))?(uint8_t) (*this->data)[this->offset]:-1); }
+    bool seek(uint32_t offset) {
+      if ((!this->data) || (offset > this->data->size())) return(false);
+      this->offset = offset;
+      return(true);
+    }
+    bool truncate(uint32_t size) {
+      if ((!this->data) || (!this->writable) || (size > this->data->size())) return(false);
+      this->data->resize(size);
+      if (this->offset > size) this->offset = size;
+      return(true);
+    }
+    size_t position() const { return(this->offset); }
+    size_t size() const { return((this->data)?this->data->size():0); }
+    void close() { this->data.reset(); }
+    operator bool() const { return((bool) this->data); }
+
+  private:
+    FS *fs;
+    std::shared_ptr<std::string> data;
+    size_t offset;
+    bool writable;
+};
+
+class FS {
+  public:
+    bool begin() { return(this->fakeMountable); }
+    void end() { }
+    File open(const char *path, const char *mode) {
+      std::shared_ptr<std::string> &data = this->files[path];
+
+      if ((mode[0] == 'r') && (!data)) {
+        this->files.erase(path);
+        return(File());
+      }
+      if ((!data) || (mode[0] == 'w')) data = std::make_shared<std::string>();
+      return(File(this, data, (mode[0] == 'a')?data->size():0, (mode[0] != 'r')));
+    }
+    bool exists(const char *path) { return(this->files.count(path) > 0); }
+    bool remove(const char *path) { return(this->files.erase(path) > 0); }
+    bool format() { this->files.clear(); return(true); }
+
+    /******************************************************************
+     * Returns the number of bytes held in all files.
+     */
+    size_t fakeUsed() {
+      size_t used = 0;
+      for (auto &file : this->files) used += file.second->size();
+      return(used);
+    }
+
+    /******************************************************************
+     * Remove every file and restore the default behaviour.
+     */
+    void fakeReset() {
+      this->files.clear();
+      this->fakeCapacity = (size_t) -1;
+      this->fakeMountable = true;
+      this->fakeWrites = 0;
+    }
+
+    std::map<std::string, std::shared_ptr<std::string>> files;
+    size_t fakeCapacity = (size_t) -1;
+    bool fakeMountable = true;
+    unsigned long fakeWrites = 0;
+};
+
+inline size_t File::write(const uint8_t *buf, size_t size) {
+  size_t space, n;
+
+  if ((!this->data) || (!this->writable)) return(0);
+  this->fs->fakeWrites++;
+  space = this->fs->fakeCapacity - std::min(this->fs->fakeCapacity, this->fs->fakeUsed());
+  n = (size < space)?size:space;
+  if (this->offset > this->data->size()) this->data->resize(this->offset);
+  this->data->replace(this->offset, n, (const char*) buf, n);
+  this->offset += n;
+  return(n);
+}
+
+inline FS LittleFS;
+
+#endif
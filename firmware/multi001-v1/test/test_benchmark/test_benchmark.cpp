@@ -0,0 +1,203 @@
+/**********************************************************************
+ * test_benchmark.cpp - host timings of sample encoding, change
+ * detection and scheduler overhead.
+ *
+ * Nothing here asserts a timing: each test prints the mean time per
+ * call so that a change to one of the hot paths can be compared
+ * before and after. The baselines are snprintf() and the ArduinoJson
+ * document with which the original firmware both built its message
+ * and detected change; the ArduinoJson tests are skipped if the
+ * library is not installed. Host timings only rank alternatives and
+ * say nothing about absolute cost on the ESP8266, which is measured
+ * with the Profiler instead.
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <SampleCodec.h>
+#include <SampleFilter.h>
+#include <Scheduler.h>
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define BENCHMARK_ARDUINOJSON
+#endif
+
+#define ITERATIONS 20000UL
+
+static const SAMPLE_NAMES names = { { "door", "window" }, { "probe1", "probe2" } };
+static SAMPLE sample;
+static volatile size_t sink;              // Keeps results from being optimised away
+
+/**********************************************************************
+ * Report the mean time of an iteration started at <start>.
+ */
+static void report(const char *name, std::chrono::steady_clock::time_point start) {
+  double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  char message[80];
+
+  snprintf(message, sizeof(message), "%-24s %10.1f ns", name, (elapsed / ITERATIONS));
+  TEST_MESSAGE(message);
+}
+
+static void idle(void *arg) { }
+
+void setUp(void) {
+  fakeReset();
+  memset(&sample, 0, sizeof(sample));
+  sample.timestamp = 1000;
+  sample.flags = (SAMPLE_HAS_TEMPERATURE | SAMPLE_HAS_HUMIDITY | SAMPLE_HAS_MOTION);
+  sample.temperature = 2150;
+  sample.humidity = 455;
+  sample.lux = SAMPLE_INVALID_VALUE;
+  sample.switchCount = 2;
+  sample.switches = 0x01;
+  sample.probeCount = 2;
+  sample.probes[0] = 1875;
+  sample.probes[1] = -250;
+}
+
+void tearDown(void) { }
+
+/**********************************************************************
+ * The way status messages were built before SampleCodec, for
+ * comparison.
+ */
+void test_benchmark_snprintf_json(void) {
+  char message[256];
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned long i = 0; i < ITERATIONS; i++) {
+    sink = snprintf(message, sizeof(message), "{ \"temperature\": %.2f, \"humidity\": %.1f, \"motion\": %d, \"%s\": %d, \"%s\": %d, \"%s\": %.2f, \"%s\": %.2f }",
+      (sample.temperature / 100.0), (sample.humidity / 10.0), ((sample.flags & SAMPLE_MOTION)?1:0),
+      names.switches[0], (sample.switches & 1), names.switches[1], ((sample.switches >> 1) & 1),
+      names.probes[0], (sample.probes[0] / 100.0), names.probes[1], (sample.probes[1] / 100.0));
+  }
+  report("snprintf JSON", start);
+  TEST_ASSERT_GREATER_THAN(0, sink);
+}
+
+/**********************************************************************
+ * Build and serialise a document as the original firmware did.
+ */
+void test_benchmark_arduinojson(void) {
+#ifdef BENCHMARK_ARDUINOJSON
+  char message[256];
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned long i = 0; i < ITERATIONS; i++) {
+    StaticJsonDocument<300> document;
+
+    document["temperature"] = (sample.temperature / 100.0);
+    document["humidity"] = (sample.humidity / 10.0);
+    document["motion"] = ((sample.flags & SAMPLE_MOTION)?1:0);
+    document[names.switches[0]] = (sample.switches & 1);
+    document[names.switches[1]] = ((sample.switches >> 1) & 1);
+    document[names.probes[0]] = (sample.probes[0] / 100.0);
+    document[names.probes[1]] = (sample.probes[1] / 100.0);
+    sink = serializeJson(document, message, sizeof(message));
+  }
+  report("ArduinoJson", start);
+  TEST_ASSERT_GREATER_THAN(0, sink);
+#else
+  TEST_IGNORE_MESSAGE("ArduinoJson is not installed");
+#endif
+}
+
+void test_benchmark_codec_json(void) {
+  FakePrint out;
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned long i = 0; i < ITERATIONS; i++) {
+    out.text.clear();
+    sink = SampleCodec::toJson(&out, sample, names, -1);
+  }
+  report("SampleCodec::toJson", start);
+  TEST_ASSERT_EQUAL(out.text.size(), sink);
+}
+
+void test_benchmark_codec_measure(void) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned long i = 0; i < ITERATIONS; i++) sink = SampleCodec::toJson((Print*) NULL, sample, names, -1);
+  report("SampleCodec measure", start);
+  TEST_ASSERT_GREATER_THAN(0, sink);
+}
+
+void test_benchmark_codec_binary(void) {
+  uint8_t frame[64];
+  size_t encoded;
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned long i = 0; i < ITERATIONS; i++) sink = SampleCodec::toBinary(frame, sizeof(frame), &sample, 1, 2000, encoded);
+  report("SampleCodec::toBinary", start);
+  TEST_ASSERT_GREATER_THAN(0, sink);
+}
+
+void test_benchmark_change_detection(void) {
+  SampleFilter filter;
+  SAMPLE reference = sample;
+  auto start = std::chrono::steady_clock::now();
+
+  filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  for (unsigned long i = 0; i < ITERATIONS; i++) {
+    reference.temperature = (int16_t) (2150 + (2 * (i & 63)));
+    sink = filter.getChanges(sample, reference);
+  }
+  report("SampleFilter::getChanges", start);
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_TEMPERATURE, sink);
+}
+
+/**********************************************************************
+ * Change detection as the original firmware did it, comparing each
+ * reading with the value held in the published document.
+ */
+void test_benchmark_arduinojson_change_detection(void) {
+#ifdef BENCHMARK_ARDUINOJSON
+  StaticJsonDocument<300> document;
+  auto start = std::chrono::steady_clock::now();
+  bool dirty = false;
+
+  document["temperature"] = 21;
+  document["humidity"] = 46;
+  for (unsigned long i = 0; i < ITERATIONS; i++) {
+    int temperature = (int) ((sample.temperature + (2 * (i & 63)) + 50) / 100);
+    dirty = false;
+    if ((int) document["temperature"] != temperature) { document["temperature"] = temperature; dirty = true; }
+    if ((int) document["humidity"] != ((sample.humidity + 5) / 10)) { document["humidity"] = ((sample.humidity + 5) / 10); dirty = true; }
+    sink = dirty;
+  }
+  report("ArduinoJson change", start);
+  TEST_ASSERT_GREATER_THAN(0, document["temperature"].as<int>());
+#else
+  TEST_IGNORE_MESSAGE("ArduinoJson is not installed");
+#endif
+}
+
+/**********************************************************************
+ * One pass through a full task table in which nothing is due, which
+ * is what most passes through loop() are.
+ */
+void test_benchmark_scheduler_pass(void) {
+  Scheduler scheduler;
+  std::chrono::steady_clock::time_point start;
+
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) scheduler.add("idle", idle, NULL, 60000);
+  scheduler.loop();
+  start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < ITERATIONS; i++) scheduler.loop();
+  report("Scheduler::loop (idle)", start);
+  TEST_ASSERT_EQUAL(1, scheduler.getRuns(0));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_benchmark_snprintf_json);
+  RUN_TEST(test_benchmark_arduinojson);
+  RUN_TEST(test_benchmark_codec_json);
+  RUN_TEST(test_benchmark_codec_measure);
+  RUN_TEST(test_benchmark_codec_binary);
+  RUN_TEST(test_benchmark_change_detection);
+  RUN_TEST(test_benchmark_arduinojson_change_detection);
+  RUN_TEST(test_benchmark_scheduler_pass);
+  return(UNITY_END());
+}
@@ -0,0 +1,180 @@
+/**********************************************************************
+ * test_config_store.cpp - record encoding, CRC checking and minimal
+ * commits of ConfigStore.
+ */
+
+#include <unity.h>
+#include <ConfigStore.h>
+
+#define ADDRESS 16
+#define SIZE 128
+
+struct CONFIG {
+  char name[12];
+  int32_t interval;
+  int16_t offset;
+  uint8_t enabled;
+};
+
+static const CONFIG_FIELD fields[] = {
+  { 1, CONFIG_STORE_STRING, offsetof(CONFIG, name), sizeof(CONFIG::name), 0 },
+  { 2, CONFIG_STORE_INT, offsetof(CONFIG, interval), sizeof(CONFIG::interval), 30000 },
+  { 3, CONFIG_STORE_INT, offsetof(CONFIG, offset), sizeof(CONFIG::offset), -40 },
+  { 4, CONFIG_STORE_INT, offsetof(CONFIG, enabled), sizeof(CONFIG::enabled), 1 }
+};
+
+#define FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+static CONFIG make() {
+  CONFIG config;
+
+  memset(&config, 0, sizeof(config));
+  strcpy(config.name, "kitchen");
+  config.interval = 120000;
+  config.offset = -300;
+  config.enabled = 0;
+  return(config);
+}
+
+void setUp(void) {
+  EEPROM.fakeErase();
+}
+
+void tearDown(void) { }
+
+void test_blank_store_loads_defaults(void) {
+  ConfigStore store(ADDRESS, SIZE);
+  CONFIG config = make();
+
+  TEST_ASSERT_FALSE(store.load(&config, fields, FIELDS));
+  TEST_ASSERT_EQUAL_STRING("", config.name);
+  TEST_ASSERT_EQUAL(30000, config.interval);
+  TEST_ASSERT_EQUAL(-40, config.offset);
+  TEST_ASSERT_EQUAL(1, config.enabled);
+  TEST_ASSERT_EQUAL(0, store.getVersion());
+}
+
+void test_round_trip(void) {
+  ConfigStore store(ADDRESS, SIZE), reloaded(ADDRESS, SIZE);
+  CONFIG config = make(), loaded;
+
+  TEST_ASSERT_TRUE(store.save(&config, fields, FIELDS, 3));
+  TEST_ASSERT_EQUAL(1, EEPROM.commits);
+  TEST_ASSERT_TRUE(reloaded.load(&loaded, fields, FIELDS));
+  TEST_ASSERT_EQUAL_STRING("kitchen", loaded.name);
+  TEST_ASSERT_EQUAL(120000, loaded.interval);
+  TEST_ASSERT_EQUAL(-300, loaded.offset);
+  TEST_ASSERT_EQUAL(0, loaded.enabled);
+  TEST_ASSERT_EQUAL(3, reloaded.getVersion());
+  TEST_ASSERT_EQUAL(0xff, EEPROM.flash[ADDRESS - 1]);
+}
+
+/**********************************************************************
+ * Saving the configuration already stored must not commit, so that
+ * the flash is not worn by a node which saves on every boot.
+ */
+void test_unchanged_save_does_not_commit(void) {
+  ConfigStore store(ADDRESS, SIZE);
+  CONFIG config = make();
+
+  store.save(&config, fields, FIELDS, 1);
+  TEST_ASSERT_TRUE(store.save(&config, fields, FIELDS, 1));
+  TEST_ASSERT_EQUAL(1, EEPROM.commits);
+  config.offset = -301;
+  store.save(&config, fields, FIELDS, 1);
+  TEST_ASSERT_EQUAL(2, EEPROM.commits);
+  store.save(&config, fields, FIELDS, 2);
+  TEST_ASSERT_EQUAL(3, EEPROM.commits);
+}
+
+void test_damaged_store_is_rejected(void) {
+  ConfigStore store(ADDRESS, SIZE);
+  CONFIG config = make(), loaded;
+
+  store.save(&config, fields, FIELDS, 1);
+  EEPROM.flash[ADDRESS + CONFIG_STORE_HEADER_SIZE + 3] ^= 0x01;
+  TEST_ASSERT_FALSE(store.load(&loaded, fields, FIELDS));
+  TEST_ASSERT_EQUAL(30000, loaded.interval);
+  TEST_ASSERT_EQUAL(0, store.getVersion());
+}
+
+/**********************************************************************
+ * Integers take the fewest bytes which sign extend back to the same
+ * value: the record for offset -300 is two bytes and enabled is one.
+ */
+void test_integers_are_stored_minimally(void) {
+  ConfigStore store(ADDRESS, SIZE);
+  CONFIG config = make();
+  const uint8_t expected[] = {
+    1, 7, 'k', 'i', 't', 'c', 'h', 'e', 'n',
+    2, 3, 0xc0, 0xd4, 0x01,
+    3, 2, 0xd4, 0xfe,
+    4, 1, 0x00
+  };
+
+  store.save(&config, fields, FIELDS, 1);
+  TEST_ASSERT_EQUAL(sizeof(expected), EEPROM.flash[ADDRESS + 5]);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, EEPROM.flash + ADDRESS + CONFIG_STORE_HEADER_SIZE, sizeof(expected));
+}
+
+void test_sign_extension_at_byte_boundaries(void) {
+  ConfigStore store(ADDRESS, SIZE);
+  CONFIG config = make(), loaded;
+  const int32_t values[] = { 0, 127, 128, -128, -129, 32767, 32768, -32768, INT32_MAX, INT32_MIN };
+
+  for (size_t i = 0; i < (sizeof(values) / sizeof(values[0])); i++) {
+    config.interval = values[i];
+    store.save(&config, fields, FIELDS, 1);
+    store.load(&loaded, fields, FIELDS);
+    TEST_ASSERT_EQUAL(values[i], loaded.interval);
+  }
+}
+
+/**********************************************************************
+ * A node upgraded to firmware which has dropped a field, added one and
+ * shrunk another must keep the values which still apply.
+ */
+void test_schema_changes(void) {
+  struct SMALLER {
+    char name[5];
+    int32_t interval;
+    int32_t added;
+  };
+  const CONFIG_FIELD smaller[] = {
+    { 1, CONFIG_STORE_STRING, offsetof(SMALLER, name), sizeof(SMALLER::name), 0 },
+    { 2, CONFIG_STORE_INT, offsetof(SMALLER, interval), sizeof(SMALLER::interval), 30000 },
+    { 5, CONFIG_STORE_INT, offsetof(SMALLER, added), sizeof(SMALLER::added), 7 }
+  };
+  ConfigStore store(ADDRESS, SIZE);
+  CONFIG config = make();
+  SMALLER loaded;
+
+  store.save(&config, fields, FIELDS, 1);
+  TEST_ASSERT_TRUE(store.load(&loaded, smaller, 3));
+  TEST_ASSERT_EQUAL_STRING("kitc", loaded.name);
+  TEST_ASSERT_EQUAL(120000, loaded.interval);
+  TEST_ASSERT_EQUAL(7, loaded.added);
+}
+
+void test_configuration_too_large_is_not_saved(void) {
+  ConfigStore store(ADDRESS, CONFIG_STORE_HEADER_SIZE + 16);
+  CONFIG config = make();
+
+  TEST_ASSERT_FALSE(store.save(&config, fields, FIELDS, 1));
+  TEST_ASSERT_EQUAL(0, EEPROM.commits);
+  strcpy(config.name, "k");
+  TEST_ASSERT_TRUE(store.save(&config, fields, FIELDS, 1));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_store_loads_defaults);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_unchanged_save_does_not_commit);
+  RUN_TEST(test_damaged_store_is_rejected);
+  RUN_TEST(test_integers_are_stored_minimally);
+  RUN_TEST(test_sign_extension_at_byte_boundaries);
+  RUN_TEST(test_schema_changes);
+  RUN_TEST(test_configuration_too_large_is_not_saved);
+  return(UNITY_END());
+}
@@ -0,0 +1,74 @@
+/**********************************************************************
+ * test_edge_queue.cpp - ordering and overruns of EdgeQueue.
+ */
+
+#include <unity.h>
+#include <EdgeQueue.h>
+
+void setUp(void) {
+  fakeReset();
+}
+
+void tearDown(void) { }
+
+void test_edges_are_popped_in_order(void) {
+  EdgeQueue<4> queue;
+  EDGE_EVENT event;
+
+  TEST_ASSERT_TRUE(queue.isEmpty());
+  TEST_ASSERT_FALSE(queue.pop(event));
+  fakeAdvanceMicros(100);
+  TEST_ASSERT_TRUE(queue.push(1, HIGH));
+  fakeAdvanceMicros(50);
+  TEST_ASSERT_TRUE(queue.push(2, LOW));
+  TEST_ASSERT_TRUE(queue.pop(event));
+  TEST_ASSERT_EQUAL(1, event.channel);
+  TEST_ASSERT_EQUAL(HIGH, event.level);
+  TEST_ASSERT_EQUAL(100, event.timestamp);
+  TEST_ASSERT_TRUE(queue.pop(event));
+  TEST_ASSERT_EQUAL(2, event.channel);
+  TEST_ASSERT_EQUAL(150, event.timestamp);
+  TEST_ASSERT_TRUE(queue.isEmpty());
+}
+
+void test_full_queue_counts_overruns(void) {
+  EdgeQueue<4> queue;
+  EDGE_EVENT event;
+
+  for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_TRUE(queue.push(i, LOW));
+  TEST_ASSERT_FALSE(queue.push(9, LOW));
+  TEST_ASSERT_FALSE(queue.push(9, LOW));
+  TEST_ASSERT_EQUAL(2, queue.getOverruns());
+  TEST_ASSERT_TRUE(queue.pop(event));
+  TEST_ASSERT_EQUAL(0, event.channel);
+  TEST_ASSERT_TRUE(queue.push(4, LOW));
+  for (uint8_t i = 1; i <= 4; i++) {
+    TEST_ASSERT_TRUE(queue.pop(event));
+    TEST_ASSERT_EQUAL(i, event.channel);
+  }
+}
+
+/**********************************************************************
+ * The indices run freely through 255 and back to 0.
+ */
+void test_indices_wrap(void) {
+  EdgeQueue<128> queue;
+  EDGE_EVENT event;
+
+  for (unsigned int i = 0; i < 1000; i++) {
+    TEST_ASSERT_TRUE(queue.push((uint8_t) i, (i & 1)));
+    if ((i % 3) == 2) {
+      for (int j = 0; j < 3; j++) TEST_ASSERT_TRUE(queue.pop(event));
+      TEST_ASSERT_EQUAL((uint8_t) i, event.channel);
+    }
+  }
+  TEST_ASSERT_EQUAL(0, queue.getOverruns());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_edges_are_popped_in_order);
+  RUN_TEST(test_full_queue_counts_overruns);
+  RUN_TEST(test_indices_wrap);
+  return(UNITY_END());
+}
@@ -0,0 +1,198 @@
+/**********************************************************************
+ * test_input_driver.cpp - debouncing, settling and deferred changes
+ * of InputDriver, driven through its interrupt handlers.
+ */
+
+#include <unity.h>
+#include <InputDriver.h>
+
+#define DOOR 4
+#define WINDOW 16                         // Polled, not interrupt driven
+#define PIR 5
+#define QUIET (INPUT_DRIVER_DEBOUNCE_INTERVAL + 1000UL)
+
+static const uint8_t pins[] = { DOOR, WINDOW };
+static const char * const names[] = { "door", "window" };
+
+/**********************************************************************
+ * Returns the switch bits and motion state of the driver's sample.
+ */
+static uint8_t switches(InputDriver &driver) {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  driver.encode(sample);
+  return(sample.switches);
+}
+
+static bool motion(InputDriver &driver) {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  driver.encode(sample);
+  return((sample.flags & SAMPLE_MOTION) != 0);
+}
+
+void setUp(void) {
+  fakeReset();
+  fakePinLevels[DOOR] = fakePinLevels[WINDOW] = HIGH;
+  fakeAdvance(1000);
+}
+
+void tearDown(void) { }
+
+void test_begin_reads_the_inputs(void) {
+  InputDriver driver(pins, 2, names, PIR);
+  SAMPLE sample;
+  SAMPLE_NAMES sampleNames;
+
+  fakePinLevels[WINDOW] = LOW;
+  TEST_ASSERT_TRUE(driver.begin());
+  TEST_ASSERT_EQUAL(INPUT_PULLUP, fakePinModes[DOOR]);
+  TEST_ASSERT_EQUAL(INPUT, fakePinModes[PIR]);
+  TEST_ASSERT_TRUE(fakeHandlers[DOOR] != NULL);
+  TEST_ASSERT_TRUE(fakeHandlers[WINDOW] == NULL);
+  memset(&sample, 0, sizeof(sample));
+  driver.encode(sample);
+  TEST_ASSERT_EQUAL(2, sample.switchCount);
+  TEST_ASSERT_EQUAL(0x01, sample.switches);
+  TEST_ASSERT_EQUAL(SAMPLE_HAS_MOTION, (sample.flags & (SAMPLE_HAS_MOTION | SAMPLE_MOTION)));
+  driver.describe(sampleNames);
+  TEST_ASSERT_EQUAL_STRING("window", sampleNames.switches[1]);
+  TEST_ASSERT_EQUAL(0, driver.poll());
+}
+
+void test_edges_update_the_state(void) {
+  InputDriver driver(pins, 2, names, PIR);
+
+  driver.begin();
+  fakeSetPin(DOOR, LOW);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_EQUAL(0x02, switches(driver));
+  driver.published();
+  fakeAdvanceMicros(QUIET);
+  fakePinLevels[WINDOW] = LOW;
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_EQUAL(0x00, switches(driver));
+  fakeSetPin(PIR, HIGH);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_TRUE(motion(driver));
+  TEST_ASSERT_EQUAL(0, driver.poll());
+}
+
+/**********************************************************************
+ * Contact bounce after a change is dropped, and must not overwrite the
+ * change while it is waiting to be published.
+ */
+void test_bounce_does_not_overwrite_an_unpublished_change(void) {
+  InputDriver driver(pins, 2, names);
+
+  driver.begin();
+  fakeSetPin(DOOR, LOW);
+  fakeAdvanceMicros(500);
+  fakeSetPin(DOOR, HIGH);
+  fakeAdvanceMicros(500);
+  fakeSetPin(DOOR, LOW);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_EQUAL(0x00, (switches(driver) & 0x01));
+  fakeAdvanceMicros(QUIET);
+  TEST_ASSERT_EQUAL(0, driver.poll());
+  TEST_ASSERT_EQUAL(0x00, (switches(driver) & 0x01));
+}
+
+/**********************************************************************
+ * A switch which really does change again inside the debounce
+ * interval is reported once it has been quiet for the whole interval.
+ */
+void test_toggle_inside_the_interval_is_reported_after_settling(void) {
+  InputDriver driver(pins, 2, names);
+
+  driver.begin();
+  fakeSetPin(DOOR, LOW);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  driver.published();
+  fakeAdvanceMicros(5000);
+  fakeSetPin(DOOR, HIGH);
+  TEST_ASSERT_EQUAL(0, driver.poll());
+  TEST_ASSERT_EQUAL(0x02, switches(driver));
+  fakeAdvanceMicros(INPUT_DRIVER_DEBOUNCE_INTERVAL - 1000);
+  TEST_ASSERT_EQUAL(0, driver.poll());
+  fakeAdvanceMicros(1000);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_EQUAL(0x03, switches(driver));
+}
+
+/**********************************************************************
+ * A change arriving before the previous one is published is deferred
+ * until published() is called.
+ */
+void test_second_change_waits_for_publication(void) {
+  InputDriver driver(pins, 2, names, PIR);
+
+  driver.begin();
+  fakeSetPin(PIR, HIGH);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  fakeAdvanceMicros(100);
+  fakeSetPin(PIR, LOW);
+  TEST_ASSERT_EQUAL(0, driver.poll());
+  TEST_ASSERT_TRUE(motion(driver));
+  TEST_ASSERT_EQUAL(0, driver.poll());
+  driver.published();
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_FALSE(motion(driver));
+}
+
+/**********************************************************************
+ * Any number of edges while a change awaits publication cost nothing
+ * until it is published, and then only the latest level is reported.
+ */
+void test_chatter_is_coalesced(void) {
+  InputDriver driver(pins, 2, names, PIR);
+
+  driver.begin();
+  fakeSetPin(PIR, HIGH);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  for (int i = 0; i < (2 * INPUT_DRIVER_QUEUE_SIZE); i++) {
+    fakeAdvanceMicros(100);
+    fakeSetPin(PIR, (i & 1)?HIGH:LOW);
+    TEST_ASSERT_EQUAL(0, driver.poll());
+  }
+  TEST_ASSERT_TRUE(motion(driver));
+  driver.published();
+  TEST_ASSERT_EQUAL(0, driver.poll());
+  fakeSetPin(PIR, LOW);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  driver.published();
+  fakeSetPin(PIR, HIGH);
+  fakeSetPin(PIR, LOW);
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_TRUE(motion(driver));
+  driver.published();
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_FALSE(motion(driver));
+}
+
+void test_queue_overrun_reads_the_inputs_again(void) {
+  InputDriver driver(pins, 2, names, PIR);
+
+  driver.begin();
+  for (int i = 0; i < ((2 * INPUT_DRIVER_QUEUE_SIZE) + 1); i++) {
+    fakeSetPin(PIR, (i & 1)?LOW:HIGH);
+    fakeAdvanceMicros(10);
+  }
+  driver.published();
+  TEST_ASSERT_EQUAL(SENSOR_UPDATED, driver.poll());
+  TEST_ASSERT_TRUE(motion(driver));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_reads_the_inputs);
+  RUN_TEST(test_edges_update_the_state);
+  RUN_TEST(test_bounce_does_not_overwrite_an_unpublished_change);
+  RUN_TEST(test_toggle_inside_the_interval_is_reported_after_settling);
+  RUN_TEST(test_second_change_waits_for_publication);
+  RUN_TEST(test_chatter_is_coalesced);
+  RUN_TEST(test_queue_overrun_reads_the_inputs_again);
+  return(UNITY_END());
+}
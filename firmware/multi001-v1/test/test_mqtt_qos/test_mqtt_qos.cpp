@@ -0,0 +1,171 @@
+/**********************************************************************
+ * test_mqtt_qos.cpp - InflightWindow bookkeeping and the QoS 1 framing
+ * of QosClient.
+ */
+
+#include <unity.h>
+#include <InflightWindow.h>
+#include <QosClient.h>
+
+static SAMPLE samples[INFLIGHT_WINDOW_SAMPLES + 2];
+
+void setUp(void) {
+  memset(samples, 0, sizeof(samples));
+  for (uint8_t i = 0; i < (INFLIGHT_WINDOW_SAMPLES + 2); i++) samples[i].timestamp = (1000 * i);
+}
+
+void tearDown(void) { }
+
+void test_window_assigns_packet_ids_in_order(void) {
+  InflightWindow window;
+  int8_t slot;
+
+  TEST_ASSERT_TRUE(window.isEmpty());
+  for (uint8_t i = 0; i < INFLIGHT_WINDOW_SIZE; i++) {
+    TEST_ASSERT_NOT_EQUAL(-1, (slot = window.add(i, samples, 1)));
+    TEST_ASSERT_EQUAL(i + 1, window.getEntry(slot).packetId);
+    TEST_ASSERT_EQUAL(i, window.getEntry(slot).kind);
+  }
+  TEST_ASSERT_TRUE(window.isFull());
+  TEST_ASSERT_EQUAL(-1, window.add(0, samples, 1));
+  TEST_ASSERT_EQUAL(INFLIGHT_WINDOW_SIZE, window.getCount());
+}
+
+void test_window_copies_at_most_its_sample_limit(void) {
+  InflightWindow window;
+  int8_t slot = window.add(0, samples, INFLIGHT_WINDOW_SAMPLES + 2);
+
+  TEST_ASSERT_EQUAL(INFLIGHT_WINDOW_SAMPLES, window.getEntry(slot).count);
+  TEST_ASSERT_EQUAL(1000, window.getEntry(slot).samples[1].timestamp);
+  TEST_ASSERT_EQUAL(-1, window.add(0, samples, 0));
+}
+
+/**********************************************************************
+ * An acknowledgement out of order releases its entry, but the window
+ * only slides (and so has room) once the oldest is released too.
+ */
+void test_window_slides_past_released_entries_only(void) {
+  InflightWindow window;
+
+  for (uint8_t i = 0; i < INFLIGHT_WINDOW_SIZE; i++) window.add(0, samples, 1);
+  TEST_ASSERT_NOT_EQUAL(-1, window.acknowledge(2));
+  TEST_ASSERT_EQUAL(-1, window.acknowledge(2));
+  TEST_ASSERT_EQUAL(INFLIGHT_WINDOW_SIZE - 1, window.getCount());
+  TEST_ASSERT_TRUE(window.isFull());
+  TEST_ASSERT_NOT_EQUAL(-1, window.acknowledge(1));
+  TEST_ASSERT_FALSE(window.isFull());
+  TEST_ASSERT_EQUAL(3, window.getEntry(window.getOldest()).packetId);
+  TEST_ASSERT_NOT_EQUAL(-1, window.add(0, samples, 1));
+  TEST_ASSERT_NOT_EQUAL(-1, window.add(0, samples, 1));
+  TEST_ASSERT_TRUE(window.isFull());
+}
+
+void test_window_expiry(void) {
+  InflightWindow window;
+  int8_t first = window.add(0, samples, 1), second = window.add(0, samples, 1);
+
+  TEST_ASSERT_EQUAL(first, window.getExpired(0, 5000));
+  window.sent(first, 100);
+  TEST_ASSERT_EQUAL(second, window.getExpired(100, 5000));
+  window.sent(second, 200);
+  TEST_ASSERT_EQUAL(-1, window.getExpired(5099, 5000));
+  TEST_ASSERT_EQUAL(first, window.getExpired(5100, 5000));
+  window.sent(first, 5100);
+  TEST_ASSERT_EQUAL(2, window.getEntry(first).transmissions);
+  TEST_ASSERT_EQUAL(second, window.getExpired(5200, 5000));
+}
+
+void test_window_packet_ids_skip_zero(void) {
+  InflightWindow window;
+  int8_t slot = -1;
+
+  for (unsigned long i = 0; i < 65535UL; i++) {
+    slot = window.add(0, samples, 1);
+    window.release(slot);
+  }
+  TEST_ASSERT_EQUAL(65535, window.getEntry(slot).packetId);
+  slot = window.add(0, samples, 1);
+  TEST_ASSERT_EQUAL(1, window.getEntry(slot).packetId);
+  TEST_ASSERT_EQUAL(1, window.getCount());
+}
+
+void test_qos_publish_header(void) {
+  FakeClient network;
+  QosClient client(network);
+  const uint8_t expected[] = { 0x3b, 0x0a, 0x00, 0x03, 'a', '/', 'b', 0x12, 0x34, 'x', 'y', 'z' };
+
+  TEST_ASSERT_TRUE(client.beginPublish("a/b", 3, true, 0x1234, true));
+  TEST_ASSERT_EQUAL(3, client.write((const uint8_t*) "xyz", 3));
+  TEST_ASSERT_EQUAL(sizeof(expected), network.sent.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, network.sent.data(), sizeof(expected));
+}
+
+void test_qos_publish_long_remaining_length(void) {
+  FakeClient network;
+  QosClient client(network);
+
+  TEST_ASSERT_TRUE(client.beginPublish("t", 200, false, 1, false));
+  TEST_ASSERT_EQUAL(0x32, (uint8_t) network.sent[0]);
+  TEST_ASSERT_EQUAL(0xcd, (uint8_t) network.sent[1]);
+  TEST_ASSERT_EQUAL(0x01, (uint8_t) network.sent[2]);
+}
+
+void test_qos_publish_refused(void) {
+  FakeClient network;
+  QosClient client(network);
+
+  TEST_ASSERT_FALSE(client.beginPublish("t", 1, false, 0, false));
+  network.isConnected = false;
+  TEST_ASSERT_FALSE(client.beginPublish("t", 1, false, 1, false));
+  TEST_ASSERT_EQUAL(0, network.sent.size());
+}
+
+/**********************************************************************
+ * PUBACKs are picked out of the inbound stream whichever way it is
+ * read, while other packets pass through untouched.
+ */
+void test_qos_collects_acknowledgements(void) {
+  FakeClient network;
+  QosClient client(network);
+  uint8_t buffer[16];
+  uint16_t packetId;
+
+  network.received = std::string("\x40\x02\x00\x07" "\x30\x05\x00\x01" "tab" "\x40\x02\x01\x00", 15);
+  for (int i = 0; i < 4; i++) client.read();
+  TEST_ASSERT_EQUAL(7, client.read(buffer, 7));
+  TEST_ASSERT_EQUAL(0x30, buffer[0]);
+  TEST_ASSERT_EQUAL(4, client.read(buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(2, client.getAcks());
+  TEST_ASSERT_TRUE(client.getAck(packetId));
+  TEST_ASSERT_EQUAL(7, packetId);
+  TEST_ASSERT_TRUE(client.getAck(packetId));
+  TEST_ASSERT_EQUAL(0x0100, packetId);
+  TEST_ASSERT_FALSE(client.getAck(packetId));
+}
+
+void test_qos_drops_acknowledgements_on_reconnect(void) {
+  FakeClient network;
+  QosClient client(network);
+  uint16_t packetId;
+
+  network.received = std::string("\x40\x02\x00\x07", 4);
+  while (client.read() >= 0) ;
+  client.stop();
+  client.connect("broker", 1883);
+  TEST_ASSERT_FALSE(client.getAck(packetId));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_window_assigns_packet_ids_in_order);
+  RUN_TEST(test_window_copies_at_most_its_sample_limit);
+  RUN_TEST(test_window_slides_past_released_entries_only);
+  RUN_TEST(test_window_expiry);
+  RUN_TEST(test_window_packet_ids_skip_zero);
+  RUN_TEST(test_qos_publish_header);
+  RUN_TEST(test_qos_publish_long_remaining_length);
+  RUN_TEST(test_qos_publish_refused);
+  RUN_TEST(test_qos_collects_acknowledgements);
+  RUN_TEST(test_qos_drops_acknowledgements_on_reconnect);
+  return(UNITY_END());
+}
@@ -0,0 +1,466 @@
+/**********************************************************************
+ * test_pipeline.cpp - scripted traces through the sampling and
+ * publication pipeline of the firmware, counting what it publishes.
+ *
+ * The Pipeline is the one run by src/multi001-v1.cpp, with its MQTT
+ * sink replaced by one which records each publication and holds the
+ * reference sample itself.
+ */
+
+#include <unity.h>
+#include <InputDriver.h>
+#include <Pipeline.h>
+#include <SampleFilter.h>
+#include <Scheduler.h>
+
+#define PIR 5
+#define PASS 10UL                         // Milliseconds per loop() pass
+#define SECONDS(s) ((s) * 1000UL)
+#define CYCLE_TIMEOUT SECONDS(15)
+#define MAX_PUBLICATIONS 64
+
+/**********************************************************************
+ * A climate sensor whose readings follow a script: temperature() is
+ * called with the time of each reading.
+ */
+class ScriptedDriver : public SensorDriver {
+  public:
+    ScriptedDriver(int16_t (*temperature)(unsigned long)) : temperature(temperature), pending(false), ready(false), value(0) { }
+    const char *getName() { return("SCRIPT"); }
+    bool begin() { return(true); }
+    void startSample() { this->pending = true; }
+    uint8_t poll() {
+      if (!this->pending) return(0);
+      this->pending = false;
+      this->ready = true;
+      this->value = this->temperature(millis());
+      return(SENSOR_UPDATED);
+    }
+    bool isReady() { return(this->ready); }
+    void encode(SAMPLE &sample) {
+      sample.flags |= (SAMPLE_HAS_TEMPERATURE | SAMPLE_HAS_HUMIDITY);
+      sample.temperature = this->value;
+      sample.humidity = 500;
+    }
+
+  private:
+    int16_t (*temperature)(unsigned long);
+    bool pending;
+    bool ready;
+    int16_t value;
+};
+
+/**********************************************************************
+ * A sink which counts what it is asked to publish and records the
+ * time of every publication reported to published(). Unless it is
+ * connected every publication fails.
+ */
+class RecordingSink : public PipelineSink {
+  public:
+    RecordingSink() : connected(true), json(0), binary(0), channels(0), changedChannels(0), reliable(0), kind(0), publications(0), lastCount(0), hasReference(false) { }
+    bool isConnected() { return(this->connected); }
+    bool publishJson(uint8_t kind, const SAMPLE *samples, size_t count) {
+      this->json++;
+      this->kind = kind;
+      return(this->connected);
+    }
+    bool publishBinary(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) {
+      this->binary++;
+      this->kind = kind;
+      encoded = count;
+      return(this->connected);
+    }
+    bool publishChannels(const SAMPLE &sample, bool all) {
+      this->channels++;
+      if (!all) this->changedChannels++;
+      return(this->connected);
+    }
+    bool publishReliable(uint8_t kind, const SAMPLE *samples, size_t count, size_t &encoded) {
+      this->reliable++;
+      this->kind = kind;
+      encoded = count;
+      return(true);
+    }
+    void published(const SAMPLE *samples, size_t count) {
+      if (this->publications < MAX_PUBLICATIONS) this->publishedAt[this->publications] = millis();
+      this->publications++;
+      this->lastCount = count;
+    }
+    bool getReference(SAMPLE &reference) {
+      reference = this->reference;
+      return(this->hasReference);
+    }
+    void setReference(const SAMPLE &reference) {
+      this->reference = reference;
+      this->hasReference = true;
+    }
+
+    bool connected;
+    unsigned long json;
+    unsigned long binary;
+    unsigned long channels;
+    unsigned long changedChannels;        // Of which only changes
+    unsigned long reliable;
+    uint8_t kind;                         // Of the latest message
+    unsigned long publications;
+    unsigned long publishedAt[MAX_PUBLICATIONS];
+    size_t lastCount;                     // Samples in the latest publication
+    SAMPLE reference;
+    bool hasReference;
+};
+
+/**********************************************************************
+ * A node with a scripted climate sensor and a PIR, configured by
+ * <config>.
+ */
+struct NODE {
+  NODE(int16_t (*temperature)(unsigned long), const PIPELINE_CONFIG &config);
+
+  ScriptedDriver climate;
+  InputDriver input;
+  SensorDriver *drivers[2];
+  SampleFilter filter;
+  SensorSet sensors;
+  PublishPolicy policy;
+  SampleBatch batch;
+  SampleRollup rollup;
+  SampleStore store;
+  SAMPLE_NAMES names;
+  RecordingSink sink;
+  Pipeline pipeline;
+  Scheduler scheduler;
+};
+
+static NODE *node;
+
+static void sampleTask(void *arg) {
+  node->pipeline.sample();
+}
+
+static void pollSensorTask(void *arg) {
+  node->pipeline.poll((uint8_t) (uintptr_t) arg);
+}
+
+static void publishTask(void *arg) {
+  node->pipeline.publish(millis(), node->sink.connected);
+}
+
+static const uint8_t noSwitches[] = { };
+
+NODE::NODE(int16_t (*temperature)(unsigned long), const PIPELINE_CONFIG &config) :
+  climate(temperature), input(noSwitches, 0, NULL, PIR), drivers { &climate, &input }, sensors(drivers, 2, filter), policy(config.softInterval, config.hardInterval),
+  pipeline(sensors, policy, batch, rollup, store, names, sink) {
+  this->filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  this->sensors.begin();
+  this->sensors.describe(this->names);
+  this->store.begin(false);
+  this->pipeline.configure(config, millis());
+  this->scheduler.add("sample", sampleTask, NULL, this->pipeline.getSampleInterval());
+  for (uint8_t i = 0; i < this->sensors.getCount(); i++) this->scheduler.add("poll", pollSensorTask, (void*) (uintptr_t) i, 0);
+  this->scheduler.add("publish", publishTask, NULL, 0);
+}
+
+/**********************************************************************
+ * The configuration of a node which does not sleep and publishes
+ * plain JSON status messages, motion and switches immediately.
+ */
+static PIPELINE_CONFIG configure(unsigned long soft, unsigned long hard, unsigned long sampleInterval) {
+  PIPELINE_CONFIG config;
+
+  memset(&config, 0, sizeof(config));
+  config.softInterval = soft;
+  config.hardInterval = hard;
+  config.sampleInterval = sampleInterval;
+  config.immediateChannels = (SAMPLE_CHANNEL_MOTION | SAMPLE_CHANNEL_SWITCHES);
+  config.cycleTimeout = CYCLE_TIMEOUT;
+  config.payloadFormat = PIPELINE_PAYLOAD_JSON;
+  return(config);
+}
+
+/**********************************************************************
+ * Run the pipeline until <end> milliseconds, one pass every PASS
+ * milliseconds.
+ */
+static void runUntil(unsigned long end) {
+  while (millis() < end) {
+    node->scheduler.loop();
+    fakeAdvance(PASS);
+  }
+}
+
+static int16_t steady(unsigned long now) { return(2000); }
+static int16_t ramp(unsigned long now) { return(2000 + (now / 100)); }
+
+void setUp(void) {
+  fakeReset();
+}
+
+void tearDown(void) {
+  delete node;
+  node = NULL;
+}
+
+/**********************************************************************
+ * A node whose readings never change publishes its first reading and
+ * then only a heartbeat once every hard interval.
+ */
+void test_steady_readings_publish_heartbeats_only(void) {
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(60), SECONDS(1)));
+  runUntil(SECONDS(600) - 1);
+  TEST_ASSERT_EQUAL(10, node->sink.publications);
+  TEST_ASSERT_EQUAL(0, node->sink.publishedAt[0]);
+  TEST_ASSERT_EQUAL(SECONDS(60), node->sink.publishedAt[1]);
+}
+
+/**********************************************************************
+ * Regression: with the soft and hard intervals swapped a quiet node
+ * published every soft interval, ten times as often as configured.
+ */
+void test_soft_and_hard_intervals_are_not_swapped(void) {
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(30), SECONDS(1)));
+  runUntil(SECONDS(300) - 1);
+  TEST_ASSERT_EQUAL(10, node->sink.publications);
+  TEST_ASSERT_EQUAL(SECONDS(30), node->sink.publishedAt[1]);
+}
+
+/**********************************************************************
+ * A temperature rising by a tenth of a degree every second crosses
+ * the half degree deadband every five seconds, and each crossing is
+ * published once.
+ */
+void test_deadband_crossings_are_published(void) {
+  node = new NODE(ramp, configure(SECONDS(3), SECONDS(60), SECONDS(1)));
+  runUntil(SECONDS(60) - 1);
+  TEST_ASSERT_EQUAL(12, node->sink.publications);
+  TEST_ASSERT_EQUAL(SECONDS(5), node->sink.publishedAt[1]);
+  TEST_ASSERT_EQUAL(SECONDS(10), node->sink.publishedAt[2]);
+}
+
+/**********************************************************************
+ * A long PIR occupancy is published on its edges (at once, since
+ * motion is an immediate channel) and by the usual heartbeats, not on
+ * every pass for which the input is high.
+ */
+void test_long_occupancy_publishes_edges_and_heartbeats(void) {
+  const unsigned long expected[] = { 0, SECONDS(10), SECONDS(70), SECONDS(130), SECONDS(150), SECONDS(210), SECONDS(270) };
+
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(60), SECONDS(1)));
+  runUntil(SECONDS(10));
+  fakeSetPin(PIR, HIGH);
+  runUntil(SECONDS(150));
+  fakeSetPin(PIR, LOW);
+  runUntil(SECONDS(300) - 1);
+  TEST_ASSERT_EQUAL(7, node->sink.publications);
+  for (uint8_t i = 0; i < 7; i++) TEST_ASSERT_EQUAL(expected[i], node->sink.publishedAt[i]);
+}
+
+/**********************************************************************
+ * A PIR pulse shorter than a pass is still published as two edges:
+ * the first is published at once and the second, deferred until
+ * then, on the following pass.
+ */
+void test_short_pulse_is_not_lost(void) {
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(60), SECONDS(1)));
+  runUntil(SECONDS(10));
+  fakeSetPin(PIR, HIGH);
+  fakeAdvanceMicros(100);
+  fakeSetPin(PIR, LOW);
+  runUntil(SECONDS(20));
+  TEST_ASSERT_EQUAL(3, node->sink.publications);
+  TEST_ASSERT_EQUAL(SECONDS(10), node->sink.publishedAt[1]);
+  TEST_ASSERT_EQUAL(SECONDS(10) + PASS, node->sink.publishedAt[2]);
+  TEST_ASSERT_EQUAL(0, (node->sink.reference.flags & SAMPLE_MOTION));
+}
+
+/**********************************************************************
+ * A PIR which chatters, with motion not an immediate channel, is
+ * published no more than once per soft interval and its final state
+ * is not lost.
+ */
+void test_chatter_is_published_at_the_soft_interval(void) {
+  const unsigned long expected[] = { 0, SECONDS(10), SECONDS(13), SECONDS(16), SECONDS(19), SECONDS(22), SECONDS(25) };
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), SECONDS(1));
+
+  config.immediateChannels = 0;
+  node = new NODE(steady, config);
+  runUntil(SECONDS(10));
+  while (millis() < SECONDS(20)) {
+    fakeSetPin(PIR, ((millis() / 50) & 1)?LOW:HIGH);
+    node->scheduler.loop();
+    fakeAdvance(PASS);
+  }
+  fakeSetPin(PIR, LOW);
+  runUntil(SECONDS(30));
+  TEST_ASSERT_EQUAL(7, node->sink.publications);
+  for (uint8_t i = 0; i < 7; i++) TEST_ASSERT_EQUAL(expected[i], node->sink.publishedAt[i]);
+  TEST_ASSERT_EQUAL(0, (node->sink.reference.flags & SAMPLE_MOTION));
+}
+
+/**********************************************************************
+ * In batch mode each status goes into the batch, which is published
+ * once it is full as a single message of all its samples.
+ */
+void test_batch_mode_publishes_a_full_batch(void) {
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(10), SECONDS(1)));
+  node->batch.configure(3, 0);
+  runUntil(SECONDS(20));
+  TEST_ASSERT_EQUAL(0, node->sink.publications);
+  runUntil(SECONDS(20) + PASS);
+  TEST_ASSERT_EQUAL(1, node->sink.publications);
+  TEST_ASSERT_EQUAL(1, node->sink.json);
+  TEST_ASSERT_EQUAL(PIPELINE_BATCH, node->sink.kind);
+  TEST_ASSERT_EQUAL(3, node->sink.lastCount);
+  TEST_ASSERT_EQUAL(0, node->batch.getCount());
+}
+
+/**********************************************************************
+ * A batch which falls due whilst we are not connected is queued.
+ */
+void test_batch_is_queued_whilst_disconnected(void) {
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(10), SECONDS(1)));
+  node->batch.configure(3, 0);
+  node->sink.connected = false;
+  runUntil(SECONDS(20) + PASS);
+  TEST_ASSERT_EQUAL(0, node->sink.json);
+  TEST_ASSERT_EQUAL(3, node->store.getCount());
+  TEST_ASSERT_EQUAL(0, node->batch.getCount());
+}
+
+/**********************************************************************
+ * Without a connection the status is queued at once, unless the node
+ * sleeps.
+ */
+void test_status_is_queued_whilst_disconnected(void) {
+  node = new NODE(steady, configure(SECONDS(3), SECONDS(60), SECONDS(1)));
+  node->sink.connected = false;
+  runUntil(PASS);
+  TEST_ASSERT_EQUAL(1, node->store.getCount());
+  TEST_ASSERT_TRUE(node->sink.hasReference);
+}
+
+/**********************************************************************
+ * In sleep mode the status waits for the connection rather than
+ * being queued.
+ */
+void test_sleep_mode_waits_for_a_connection(void) {
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), SECONDS(1));
+
+  config.sleepInterval = SECONDS(60);
+  node = new NODE(steady, config);
+  node->sink.connected = false;
+  runUntil(SECONDS(5));
+  TEST_ASSERT_EQUAL(0, node->sink.json);
+  TEST_ASSERT_EQUAL(0, node->store.getCount());
+  node->sink.connected = true;
+  runUntil(SECONDS(6));
+  TEST_ASSERT_EQUAL(1, node->sink.publications);
+  TEST_ASSERT_EQUAL(SECONDS(5), node->sink.publishedAt[0]);
+}
+
+/**********************************************************************
+ * In sleep mode a status which has waited for the cycle timeout is
+ * queued, so that the node can go back to sleep.
+ */
+void test_sleep_mode_gives_up_at_the_cycle_timeout(void) {
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), SECONDS(1));
+
+  config.sleepInterval = SECONDS(60);
+  node = new NODE(steady, config);
+  node->sink.connected = false;
+  runUntil(CYCLE_TIMEOUT);
+  TEST_ASSERT_EQUAL(0, node->store.getCount());
+  runUntil(CYCLE_TIMEOUT + PASS);
+  TEST_ASSERT_EQUAL(1, node->store.getCount());
+}
+
+/**********************************************************************
+ * The rollup, whose state would not survive deep sleep, is disabled
+ * in sleep mode, and a sample interval of zero is the soft interval.
+ */
+void test_configuration_is_mapped(void) {
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), 0);
+
+  config.rollupWindow = SECONDS(60);
+  node = new NODE(steady, config);
+  TEST_ASSERT_EQUAL(SECONDS(3), node->pipeline.getSampleInterval());
+  TEST_ASSERT_TRUE(node->rollup.isEnabled());
+  config.sleepInterval = SECONDS(60);
+  node->pipeline.configure(config, millis());
+  TEST_ASSERT_FALSE(node->rollup.isEnabled());
+}
+
+/**********************************************************************
+ * In reliable delivery mode the status is published at QoS 1, and
+ * is only reported as published once it is acknowledged.
+ */
+void test_reliable_delivery_publishes_at_qos_1(void) {
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), SECONDS(1));
+
+  config.reliable = true;
+  node = new NODE(steady, config);
+  runUntil(PASS);
+  TEST_ASSERT_EQUAL(1, node->sink.reliable);
+  TEST_ASSERT_EQUAL(PIPELINE_STATUS, node->sink.kind);
+  TEST_ASSERT_EQUAL(0, node->sink.json);
+  TEST_ASSERT_EQUAL(0, node->sink.publications);
+  TEST_ASSERT_EQUAL(0, node->store.getCount());
+}
+
+/**********************************************************************
+ * In channel topic mode a change publishes only the channels which
+ * have changed and a heartbeat refreshes every channel. Channel
+ * topics are never published reliably.
+ */
+void test_channel_topic_heartbeats_refresh_every_channel(void) {
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), SECONDS(1));
+
+  config.channelTopics = true;
+  config.reliable = true;
+  node = new NODE(steady, config);
+  runUntil(SECONDS(60) + PASS);
+  TEST_ASSERT_EQUAL(2, node->sink.channels);
+  TEST_ASSERT_EQUAL(1, node->sink.changedChannels);
+  TEST_ASSERT_EQUAL(0, node->sink.reliable);
+  TEST_ASSERT_EQUAL(0, node->sink.json);
+  TEST_ASSERT_EQUAL(2, node->sink.publications);
+}
+
+/**********************************************************************
+ * The payload format says whether the status goes out as JSON, as a
+ * binary frame or as both.
+ */
+void test_payload_format_is_followed(void) {
+  PIPELINE_CONFIG config = configure(SECONDS(3), SECONDS(60), SECONDS(1));
+
+  config.payloadFormat = PIPELINE_PAYLOAD_JSON_AND_BINARY;
+  node = new NODE(steady, config);
+  runUntil(PASS);
+  TEST_ASSERT_EQUAL(1, node->sink.json);
+  TEST_ASSERT_EQUAL(1, node->sink.binary);
+  config.payloadFormat = PIPELINE_PAYLOAD_BINARY;
+  node->pipeline.configure(config, millis());
+  runUntil(SECONDS(60) + PASS);
+  TEST_ASSERT_EQUAL(1, node->sink.json);
+  TEST_ASSERT_EQUAL(2, node->sink.binary);
+  TEST_ASSERT_EQUAL(2, node->sink.publications);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_readings_publish_heartbeats_only);
+  RUN_TEST(test_soft_and_hard_intervals_are_not_swapped);
+  RUN_TEST(test_deadband_crossings_are_published);
+  RUN_TEST(test_long_occupancy_publishes_edges_and_heartbeats);
+  RUN_TEST(test_short_pulse_is_not_lost);
+  RUN_TEST(test_chatter_is_published_at_the_soft_interval);
+  RUN_TEST(test_batch_mode_publishes_a_full_batch);
+  RUN_TEST(test_batch_is_queued_whilst_disconnected);
+  RUN_TEST(test_status_is_queued_whilst_disconnected);
+  RUN_TEST(test_sleep_mode_waits_for_a_connection);
+  RUN_TEST(test_sleep_mode_gives_up_at_the_cycle_timeout);
+  RUN_TEST(test_configuration_is_mapped);
+  RUN_TEST(test_reliable_delivery_publishes_at_qos_1);
+  RUN_TEST(test_channel_topic_heartbeats_refresh_every_channel);
+  RUN_TEST(test_payload_format_is_followed);
+  return(UNITY_END());
+}
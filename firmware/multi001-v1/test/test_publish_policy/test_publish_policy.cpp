@@ -0,0 +1,150 @@
+/**********************************************************************
+ * test_publish_policy.cpp - soft/hard interval semantics of
+ * PublishPolicy.
+ */
+
+#include <unity.h>
+#include <PublishPolicy.h>
+#include <Sample.h>
+
+#define SOFT 3000UL
+#define HARD 30000UL
+
+/**********************************************************************
+ * Step a policy through <duration> milliseconds in <step> millisecond
+ * passes, publishing whenever it says so, and return the number of
+ * publications. <changeAt> (if not zero) is the time of a single
+ * change in the channel classes <classes>.
+ */
+static unsigned long run(PublishPolicy &policy, unsigned long start, unsigned long duration, unsigned long step, unsigned long changeAt, uint8_t classes, unsigned long *publishedAt) {
+  unsigned long publications = 0;
+
+  for (unsigned long now = start; now < (start + duration); now += step) {
+    if ((changeAt) && (now == changeAt)) policy.notifyChange(classes);
+    if (policy.isDue(now)) {
+      if (publishedAt) publishedAt[publications] = now;
+      policy.published(now);
+      publications++;
+    }
+  }
+  return(publications);
+}
+
+void setUp(void) { }
+void tearDown(void) { }
+
+void test_first_pass_publishes(void) {
+  PublishPolicy policy(SOFT, HARD);
+
+  TEST_ASSERT_TRUE(policy.isDue(0));
+  policy.published(0);
+  TEST_ASSERT_FALSE(policy.isDue(1));
+}
+
+/**********************************************************************
+ * The baseline firmware sampled on the hard interval and published on
+ * the soft one. A quiet node must publish its heartbeat once every
+ * hard interval, not once every soft interval.
+ */
+void test_heartbeat_follows_hard_interval(void) {
+  PublishPolicy policy(SOFT, HARD);
+  unsigned long at[16];
+
+  policy.published(0);
+  TEST_ASSERT_EQUAL(4, run(policy, 1, (4 * HARD), 1, 0, 0, at));
+  TEST_ASSERT_EQUAL(HARD, at[0]);
+  TEST_ASSERT_EQUAL(2 * HARD, at[1]);
+  TEST_ASSERT_EQUAL(4 * HARD, at[3]);
+}
+
+/**********************************************************************
+ * ...and a change must be published once the soft interval has
+ * passed, not held back until the hard interval.
+ */
+void test_change_follows_soft_interval(void) {
+  PublishPolicy policy(SOFT, HARD);
+  unsigned long at[16];
+
+  policy.published(0);
+  TEST_ASSERT_EQUAL(1, run(policy, 1, HARD - 1, 1, 1000, SAMPLE_CHANNEL_TEMPERATURE, at));
+  TEST_ASSERT_EQUAL(SOFT, at[0]);
+}
+
+void test_change_after_soft_interval_is_published_at_once(void) {
+  PublishPolicy policy(SOFT, HARD);
+  unsigned long at[16];
+
+  policy.published(0);
+  TEST_ASSERT_EQUAL(1, run(policy, 1, HARD - 1, 1, 5000, SAMPLE_CHANNEL_TEMPERATURE, at));
+  TEST_ASSERT_EQUAL(5000, at[0]);
+}
+
+void test_changes_inside_the_hold_off_are_coalesced(void) {
+  PublishPolicy policy(SOFT, HARD);
+
+  policy.published(0);
+  for (unsigned long now = 100; now < SOFT; now += 100) {
+    policy.notifyChange(SAMPLE_CHANNEL_SWITCHES);
+    TEST_ASSERT_FALSE(policy.isDue(now));
+  }
+  TEST_ASSERT_TRUE(policy.isPending());
+  TEST_ASSERT_TRUE(policy.isDue(SOFT));
+  policy.published(SOFT);
+  TEST_ASSERT_FALSE(policy.isPending());
+  TEST_ASSERT_FALSE(policy.isDue(SOFT + 1));
+}
+
+void test_immediate_classes_skip_the_hold_off(void) {
+  PublishPolicy policy(SOFT, HARD);
+
+  policy.setImmediate(SAMPLE_CHANNEL_MOTION);
+  policy.published(0);
+  policy.notifyChange(SAMPLE_CHANNEL_TEMPERATURE);
+  TEST_ASSERT_FALSE(policy.isDue(10));
+  policy.notifyChange(SAMPLE_CHANNEL_MOTION | SAMPLE_CHANNEL_TEMPERATURE);
+  TEST_ASSERT_TRUE(policy.isDue(10));
+  policy.published(10);
+  TEST_ASSERT_FALSE(policy.isDue(20));
+}
+
+void test_unclassified_change_is_never_urgent(void) {
+  PublishPolicy policy(SOFT, HARD);
+
+  policy.setImmediate(SAMPLE_CHANNEL_ALL);
+  policy.published(0);
+  policy.notifyChange();
+  TEST_ASSERT_FALSE(policy.isDue(10));
+  TEST_ASSERT_TRUE(policy.isDue(SOFT));
+}
+
+void test_hard_interval_is_raised_to_soft_interval(void) {
+  PublishPolicy policy(HARD, SOFT);
+
+  policy.published(0);
+  TEST_ASSERT_FALSE(policy.isDue(SOFT));
+  TEST_ASSERT_TRUE(policy.isDue(HARD));
+  TEST_ASSERT_EQUAL(HARD, policy.getSoftInterval());
+}
+
+void test_set_intervals_applies_from_last_publication(void) {
+  PublishPolicy policy(SOFT, HARD);
+
+  policy.published(0);
+  policy.setIntervals(1000, 10000);
+  TEST_ASSERT_FALSE(policy.isDue(9999));
+  TEST_ASSERT_TRUE(policy.isDue(10000));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_pass_publishes);
+  RUN_TEST(test_heartbeat_follows_hard_interval);
+  RUN_TEST(test_change_follows_soft_interval);
+  RUN_TEST(test_change_after_soft_interval_is_published_at_once);
+  RUN_TEST(test_changes_inside_the_hold_off_are_coalesced);
+  RUN_TEST(test_immediate_classes_skip_the_hold_off);
+  RUN_TEST(test_unclassified_change_is_never_urgent);
+  RUN_TEST(test_hard_interval_is_raised_to_soft_interval);
+  RUN_TEST(test_set_intervals_applies_from_last_publication);
+  return(UNITY_END());
+}
@@ -0,0 +1,69 @@
+/**********************************************************************
+ * test_sample_batch.cpp - size and latency limits of SampleBatch.
+ */
+
+#include <unity.h>
+#include <SampleBatch.h>
+
+static SAMPLE make(uint32_t timestamp) {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.timestamp = timestamp;
+  return(sample);
+}
+
+void setUp(void) { }
+void tearDown(void) { }
+
+void test_configuration_limits(void) {
+  SampleBatch batch;
+
+  TEST_ASSERT_FALSE(batch.isEnabled());
+  batch.configure(1, 1000);
+  TEST_ASSERT_FALSE(batch.isEnabled());
+  batch.configure(2, 1000);
+  TEST_ASSERT_TRUE(batch.isEnabled());
+  batch.configure(SAMPLE_BATCH_MAX + 10, 0);
+  for (unsigned int i = 0; i < (SAMPLE_BATCH_MAX - 1); i++) batch.add(make(i));
+  TEST_ASSERT_FALSE(batch.isDue(1000000));
+  batch.add(make(SAMPLE_BATCH_MAX));
+  TEST_ASSERT_TRUE(batch.isDue(0));
+}
+
+void test_batch_is_due_when_full_or_old(void) {
+  SampleBatch batch;
+
+  batch.configure(4, 5000);
+  TEST_ASSERT_FALSE(batch.isDue(100000));
+  batch.add(make(1000));
+  batch.add(make(2000));
+  TEST_ASSERT_FALSE(batch.isDue(5999));
+  TEST_ASSERT_TRUE(batch.isDue(6000));
+  batch.add(make(3000));
+  batch.add(make(4000));
+  TEST_ASSERT_TRUE(batch.isDue(4000));
+  TEST_ASSERT_EQUAL(4, batch.getCount());
+  TEST_ASSERT_EQUAL(1000, batch.getSamples()[0].timestamp);
+  batch.clear();
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+  TEST_ASSERT_FALSE(batch.isDue(100000));
+}
+
+void test_overfull_batch_keeps_the_newest(void) {
+  SampleBatch batch;
+
+  batch.configure(SAMPLE_BATCH_MAX, 0);
+  for (unsigned int i = 0; i < (SAMPLE_BATCH_MAX + 2); i++) batch.add(make(i));
+  TEST_ASSERT_EQUAL(SAMPLE_BATCH_MAX, batch.getCount());
+  TEST_ASSERT_EQUAL(2, batch.getSamples()[0].timestamp);
+  TEST_ASSERT_EQUAL(SAMPLE_BATCH_MAX + 1, batch.getSamples()[SAMPLE_BATCH_MAX - 1].timestamp);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_configuration_limits);
+  RUN_TEST(test_batch_is_due_when_full_or_old);
+  RUN_TEST(test_overfull_batch_keeps_the_newest);
+  return(UNITY_END());
+}
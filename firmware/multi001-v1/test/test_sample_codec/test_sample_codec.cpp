@@ -0,0 +1,157 @@
+/**********************************************************************
+ * test_sample_codec.cpp - JSON and binary rendering of SAMPLEs.
+ */
+
+#include <unity.h>
+#include <SampleCodec.h>
+
+static const SAMPLE_NAMES names = { { "door", "window" }, { "probe1", "probe2" } };
+
+static SAMPLE make() {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.timestamp = 1000;
+  sample.flags = (SAMPLE_HAS_TEMPERATURE | SAMPLE_HAS_HUMIDITY);
+  sample.temperature = 2150;
+  sample.humidity = 455;
+  sample.lux = SAMPLE_INVALID_VALUE;
+  return(sample);
+}
+
+void setUp(void) { }
+void tearDown(void) { }
+
+void test_json_object(void) {
+  SAMPLE sample = make();
+  FakePrint out;
+  size_t length;
+
+  sample.flags |= (SAMPLE_HAS_LUX | SAMPLE_HAS_MOTION | SAMPLE_MOTION);
+  sample.lux = 312;
+  sample.switchCount = 2;
+  sample.switches = 0x02;
+  sample.probeCount = 1;
+  sample.probes[0] = -525;
+  length = SampleCodec::toJson(&out, sample, names, -1);
+  TEST_ASSERT_EQUAL(out.text.size(), length);
+  TEST_ASSERT_EQUAL_STRING("{ \"temperature\": 21.50, \"humidity\": 45.5, \"lux\": 312, \"motion\": 1, \"door\": 0, \"window\": 1, \"probe1\": -5.25 }", out.text.c_str());
+}
+
+void test_json_age_and_invalid_values(void) {
+  SAMPLE sample = make();
+  FakePrint out;
+
+  sample.temperature = SAMPLE_INVALID_VALUE;
+  sample.humidity = 5;
+  SampleCodec::toJson(&out, sample, names, 250);
+  TEST_ASSERT_EQUAL_STRING("{ \"age\": 250, \"temperature\": 999, \"humidity\": 0.5 }", out.text.c_str());
+}
+
+void test_json_small_negative_values(void) {
+  SAMPLE sample = make();
+  FakePrint out;
+
+  sample.temperature = -5;
+  sample.humidity = 0;
+  SampleCodec::toJson(&out, sample, names, -1);
+  TEST_ASSERT_EQUAL_STRING("{ \"temperature\": -0.05, \"humidity\": 0.0 }", out.text.c_str());
+}
+
+void test_json_array_ages(void) {
+  SAMPLE samples[3] = { make(), make(), make() };
+  FakePrint out;
+
+  samples[1].timestamp = 4000;
+  samples[2].flags |= SAMPLE_STALE;
+  SampleCodec::toJsonArray(&out, samples, 3, names, 5000);
+  TEST_ASSERT_EQUAL_STRING("[ { \"age\": 4000, \"temperature\": 21.50, \"humidity\": 45.5 }, { \"age\": 1000, \"temperature\": 21.50, \"humidity\": 45.5 }, { \"temperature\": 21.50, \"humidity\": 45.5 } ]", out.text.c_str());
+}
+
+/**********************************************************************
+ * A message is measured before it is streamed, so the two must agree.
+ */
+void test_measure_matches_output(void) {
+  SAMPLE samples[4] = { make(), make(), make(), make() };
+  FakePrint out;
+  size_t length;
+
+  samples[3].probeCount = 2;
+  length = SampleCodec::toJsonArray((Print*) NULL, samples, 4, names, 9000);
+  TEST_ASSERT_EQUAL(length, SampleCodec::toJsonArray(&out, samples, 4, names, 9000));
+  TEST_ASSERT_EQUAL(length, out.text.size());
+}
+
+void test_failed_write_returns_zero(void) {
+  SAMPLE sample = make();
+  FakePrint out(10);
+
+  TEST_ASSERT_EQUAL(0, SampleCodec::toJson(&out, sample, names, -1));
+}
+
+void test_channels(void) {
+  SAMPLE sample = make();
+  SAMPLE_CHANNEL_VALUE channel;
+  char text[SAMPLE_CODEC_TEXT_SIZE];
+
+  sample.flags |= SAMPLE_HAS_MOTION;
+  sample.switchCount = 1;
+  sample.switches = 1;
+  TEST_ASSERT_TRUE(SampleCodec::getChannel(sample, names, SAMPLE_CODEC_MOTION_CHANNEL, channel));
+  TEST_ASSERT_EQUAL_STRING("motion", channel.name);
+  TEST_ASSERT_EQUAL(0, channel.value);
+  TEST_ASSERT_TRUE(SampleCodec::getChannel(sample, names, SAMPLE_CODEC_SWITCH_CHANNEL, channel));
+  TEST_ASSERT_EQUAL_STRING("door", channel.name);
+  TEST_ASSERT_EQUAL(1, channel.value);
+  TEST_ASSERT_FALSE(SampleCodec::getChannel(sample, names, SAMPLE_CODEC_SWITCH_CHANNEL + 1, channel));
+  TEST_ASSERT_FALSE(SampleCodec::getChannel(sample, names, SAMPLE_CODEC_PROBE_CHANNEL, channel));
+  TEST_ASSERT_FALSE(SampleCodec::getChannel(sample, names, SAMPLE_CODEC_CHANNELS, channel));
+  TEST_ASSERT_TRUE(SampleCodec::getChannel(sample, names, 0, channel));
+  TEST_ASSERT_EQUAL(5, SampleCodec::toText(text, sizeof(text), channel));
+  TEST_ASSERT_EQUAL_STRING("21.50", text);
+  TEST_ASSERT_EQUAL(0, SampleCodec::toText(text, 4, channel));
+}
+
+void test_binary_frame(void) {
+  SAMPLE samples[2] = { make(), make() };
+  uint8_t frame[64];
+  size_t encoded;
+  const uint8_t expected[] = {
+    SAMPLE_BINARY_VERSION, 2,
+    0x03, 0x00, 0x00, 0x00, 0xe8, 0x03, 0x00, 0x00, 0x66, 0x08, 0xc7, 0x01,
+    0x83, 0x02, 0x01, 0x05, 0xff, 0xff, 0xff, 0xff, 0x66, 0x08, 0xc7, 0x01, 0x0c, 0xfe
+  };
+
+  samples[1].flags |= SAMPLE_STALE;
+  samples[1].switchCount = 2;
+  samples[1].switches = 0x05;
+  samples[1].probeCount = 1;
+  samples[1].probes[0] = -500;
+  TEST_ASSERT_EQUAL(sizeof(expected), SampleCodec::toBinary(frame, sizeof(frame), samples, 2, 2000, encoded));
+  TEST_ASSERT_EQUAL(2, encoded);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, frame, sizeof(expected));
+}
+
+void test_binary_frame_stops_at_whole_records(void) {
+  SAMPLE samples[3] = { make(), make(), make() };
+  uint8_t frame[SAMPLE_BINARY_HEADER_SIZE + 27];
+  size_t encoded;
+
+  TEST_ASSERT_EQUAL(SAMPLE_BINARY_HEADER_SIZE + 24, SampleCodec::toBinary(frame, sizeof(frame), samples, 3, 2000, encoded));
+  TEST_ASSERT_EQUAL(2, encoded);
+  TEST_ASSERT_EQUAL(2, frame[1]);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_json_object);
+  RUN_TEST(test_json_age_and_invalid_values);
+  RUN_TEST(test_json_small_negative_values);
+  RUN_TEST(test_json_array_ages);
+  RUN_TEST(test_measure_matches_output);
+  RUN_TEST(test_failed_write_returns_zero);
+  RUN_TEST(test_channels);
+  RUN_TEST(test_binary_frame);
+  RUN_TEST(test_binary_frame_stops_at_whole_records);
+  return(UNITY_END());
+}
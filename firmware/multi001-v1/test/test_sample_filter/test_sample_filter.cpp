@@ -0,0 +1,207 @@
+/**********************************************************************
+ * test_sample_filter.cpp - deadbands, smoothing and change classes of
+ * SampleFilter.
+ */
+
+#include <unity.h>
+#include <SampleFilter.h>
+
+static SAMPLE make(int16_t temperature, int16_t humidity) {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.flags = (SAMPLE_HAS_TEMPERATURE | SAMPLE_HAS_HUMIDITY);
+  sample.temperature = temperature;
+  sample.humidity = humidity;
+  sample.lux = SAMPLE_INVALID_VALUE;
+  return(sample);
+}
+
+/**********************************************************************
+ * Feed <reading> to <filter> and return the filtered temperature.
+ */
+static int16_t filtered(SampleFilter &filter, int16_t reading) {
+  SAMPLE sample = make(reading, 500);
+
+  filter.update(sample);
+  filter.apply(sample);
+  return(sample.temperature);
+}
+
+void setUp(void) { }
+void tearDown(void) { }
+
+void test_deadband_is_measured_from_the_reference(void) {
+  SampleFilter filter;
+  SAMPLE reference = make(2000, 500);
+
+  filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  TEST_ASSERT_EQUAL(0, filter.getChanges(make(2049, 500), reference));
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_TEMPERATURE, filter.getChanges(make(2050, 500), reference));
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_TEMPERATURE, filter.getChanges(make(1950, 500), reference));
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_HUMIDITY, filter.getChanges(make(2000, 490), reference));
+}
+
+/**********************************************************************
+ * A value creeping by less than the deadband on each reading is still
+ * published once it has moved a whole deadband from the reference.
+ */
+void test_slow_drift_is_not_lost(void) {
+  SampleFilter filter;
+  SAMPLE reference = make(2000, 500);
+  unsigned long publications = 0;
+
+  filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  for (int16_t t = 2000; t <= 2200; t += 10) {
+    SAMPLE sample = make(t, 500);
+    if (filter.isChanged(sample, reference)) {
+      reference = sample;
+      publications++;
+    }
+  }
+  TEST_ASSERT_EQUAL(4, publications);
+  TEST_ASSERT_EQUAL(2200, reference.temperature);
+}
+
+void test_hovering_value_is_published_once(void) {
+  SampleFilter filter;
+  SAMPLE reference = make(2000, 500);
+  unsigned long publications = 0;
+
+  filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  for (int i = 0; i < 100; i++) {
+    SAMPLE sample = make((i & 1)?2030:2055, 500);
+    if (filter.isChanged(sample, reference)) {
+      reference = sample;
+      publications++;
+    }
+  }
+  TEST_ASSERT_EQUAL(1, publications);
+}
+
+void test_zero_deadband_never_changes_on_its_own(void) {
+  SampleFilter filter;
+
+  filter.configure(SAMPLE_FILTER_NONE, 0, 0, 0);
+  TEST_ASSERT_EQUAL(0, filter.getChanges(make(3000, 900), make(2000, 100)));
+}
+
+void test_validity_changes_always_count(void) {
+  SampleFilter filter;
+
+  filter.configure(SAMPLE_FILTER_NONE, 0, 0, 0);
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_TEMPERATURE, filter.getChanges(make(SAMPLE_INVALID_VALUE, 500), make(2000, 500)));
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_TEMPERATURE, filter.getChanges(make(2000, 500), make(SAMPLE_INVALID_VALUE, 500)));
+  TEST_ASSERT_EQUAL(0, filter.getChanges(make(SAMPLE_INVALID_VALUE, 500), make(SAMPLE_INVALID_VALUE, 500)));
+}
+
+void test_binary_and_presence_classes(void) {
+  SampleFilter filter;
+  SAMPLE reference = make(2000, 500), sample;
+
+  sample = reference;
+  sample.flags |= SAMPLE_HAS_MOTION;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_MOTION, filter.getChanges(sample, reference));
+  reference = sample;
+  sample.flags |= SAMPLE_MOTION;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_MOTION, filter.getChanges(sample, reference));
+  sample = reference;
+  sample.switchCount = 2;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_SWITCHES, filter.getChanges(sample, reference));
+  reference = sample;
+  sample.switches = 0x02;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_SWITCHES, filter.getChanges(sample, reference));
+  sample = reference;
+  sample.flags &= ~SAMPLE_HAS_HUMIDITY;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_HUMIDITY, filter.getChanges(sample, reference));
+  sample = reference;
+  sample.flags |= SAMPLE_STALE;
+  TEST_ASSERT_EQUAL(0, filter.getChanges(sample, reference));
+}
+
+void test_probes_use_the_temperature_deadband(void) {
+  SampleFilter filter;
+  SAMPLE reference = make(2000, 500), sample;
+
+  filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  reference.probeCount = 2;
+  reference.probes[0] = reference.probes[1] = 1500;
+  sample = reference;
+  sample.probes[1] = 1549;
+  TEST_ASSERT_EQUAL(0, filter.getChanges(sample, reference));
+  sample.probes[1] = 1550;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_PROBES, filter.getChanges(sample, reference));
+  sample = reference;
+  sample.probeCount = 1;
+  TEST_ASSERT_EQUAL(SAMPLE_CHANNEL_PROBES, filter.getChanges(sample, reference));
+}
+
+void test_no_filter_passes_readings_through(void) {
+  SampleFilter filter;
+
+  filter.configure(SAMPLE_FILTER_NONE, 50, 10, 0);
+  TEST_ASSERT_EQUAL(2000, filtered(filter, 2000));
+  TEST_ASSERT_EQUAL(2400, filtered(filter, 2400));
+}
+
+void test_ema_converges_on_a_step(void) {
+  SampleFilter filter;
+  int16_t value = 0;
+
+  filter.configure(SAMPLE_FILTER_EMA, 50, 10, 0);
+  TEST_ASSERT_EQUAL(2000, filtered(filter, 2000));
+  TEST_ASSERT_EQUAL(2100, filtered(filter, 2400));
+  for (int i = 0; i < 40; i++) value = filtered(filter, 2400);
+  TEST_ASSERT_INT_WITHIN(1, 2400, value);
+}
+
+void test_median_rejects_a_single_spike(void) {
+  SampleFilter filter;
+
+  filter.configure(SAMPLE_FILTER_MEDIAN, 50, 10, 0);
+  TEST_ASSERT_EQUAL(2000, filtered(filter, 2000));
+  TEST_ASSERT_EQUAL(2000, filtered(filter, 2010));
+  TEST_ASSERT_EQUAL(2010, filtered(filter, 8500));
+  TEST_ASSERT_EQUAL(2020, filtered(filter, 2020));
+}
+
+void test_invalid_reading_restarts_the_filter(void) {
+  SampleFilter filter;
+
+  filter.configure(SAMPLE_FILTER_EMA, 50, 10, 0);
+  filtered(filter, 2000);
+  filtered(filter, 2000);
+  TEST_ASSERT_EQUAL(SAMPLE_INVALID_VALUE, filtered(filter, SAMPLE_INVALID_VALUE));
+  TEST_ASSERT_EQUAL(3000, filtered(filter, 3000));
+}
+
+/**********************************************************************
+ * After reset() a channel (such as a probe index which now belongs to
+ * a different device) is not averaged against its earlier readings.
+ */
+void test_reset_discards_history(void) {
+  SampleFilter filter;
+
+  filter.configure(SAMPLE_FILTER_EMA, 50, 10, 0);
+  filtered(filter, 2000);
+  filtered(filter, 2000);
+  filter.reset();
+  TEST_ASSERT_EQUAL(3000, filtered(filter, 3000));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_deadband_is_measured_from_the_reference);
+  RUN_TEST(test_slow_drift_is_not_lost);
+  RUN_TEST(test_hovering_value_is_published_once);
+  RUN_TEST(test_zero_deadband_never_changes_on_its_own);
+  RUN_TEST(test_validity_changes_always_count);
+  RUN_TEST(test_binary_and_presence_classes);
+  RUN_TEST(test_probes_use_the_temperature_deadband);
+  RUN_TEST(test_no_filter_passes_readings_through);
+  RUN_TEST(test_ema_converges_on_a_step);
+  RUN_TEST(test_median_rejects_a_single_spike);
+  RUN_TEST(test_invalid_reading_restarts_the_filter);
+  RUN_TEST(test_reset_discards_history);
+  return(UNITY_END());
+}
@@ -0,0 +1,94 @@
+/**********************************************************************
+ * test_sample_rollup.cpp - window statistics of SampleRollup.
+ */
+
+#include <unity.h>
+#include <SampleRollup.h>
+
+static const SAMPLE_NAMES names = { { "door" }, { } };
+
+static SAMPLE make(uint32_t timestamp, int16_t temperature) {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.timestamp = timestamp;
+  sample.flags = SAMPLE_HAS_TEMPERATURE;
+  sample.temperature = temperature;
+  sample.lux = SAMPLE_INVALID_VALUE;
+  return(sample);
+}
+
+static SAMPLE motion(uint32_t timestamp, bool on) {
+  SAMPLE sample = make(timestamp, 2000);
+
+  sample.flags |= (SAMPLE_HAS_MOTION | ((on)?SAMPLE_MOTION:0));
+  return(sample);
+}
+
+void setUp(void) { }
+void tearDown(void) { }
+
+void test_disabled_rollup_ignores_samples(void) {
+  SampleRollup rollup;
+
+  TEST_ASSERT_FALSE(rollup.isEnabled());
+  rollup.add(make(0, 2000), names);
+  TEST_ASSERT_FALSE(rollup.isDue(1000000));
+}
+
+void test_measured_channel_statistics(void) {
+  SampleRollup rollup;
+  FakePrint out;
+  size_t length;
+
+  rollup.configure(60000, 0);
+  rollup.add(make(0, 2000), names);
+  rollup.add(make(10000, 2100), names);
+  rollup.add(make(20000, SAMPLE_INVALID_VALUE), names);
+  rollup.add(make(30000, 2250), names);
+  TEST_ASSERT_FALSE(rollup.isDue(59999));
+  TEST_ASSERT_TRUE(rollup.isDue(60000));
+  length = rollup.toJson(&out, 60000);
+  TEST_ASSERT_EQUAL(out.text.size(), length);
+  TEST_ASSERT_EQUAL_STRING("{ \"window\": 60000, \"samples\": 4, \"temperature\": { \"min\": 20.00, \"max\": 22.50, \"mean\": 21.17, \"count\": 3 } }", out.text.c_str());
+}
+
+/**********************************************************************
+ * Binary channels are followed between samples and keep their state
+ * across a reset.
+ */
+void test_binary_channel_duty_and_changes(void) {
+  SampleRollup rollup;
+  FakePrint first, second;
+
+  rollup.configure(40000, 0);
+  rollup.track(motion(0, false), names);
+  rollup.track(motion(10000, true), names);
+  rollup.track(motion(25000, false), names);
+  rollup.track(motion(30000, true), names);
+  rollup.toJson(&first, 40000);
+  TEST_ASSERT_EQUAL_STRING("{ \"window\": 40000, \"samples\": 0, \"motion\": { \"duty\": 62.5, \"changes\": 3 } }", first.text.c_str());
+  rollup.reset(40000);
+  rollup.toJson(&second, 50000);
+  TEST_ASSERT_EQUAL_STRING("{ \"window\": 10000, \"samples\": 0, \"motion\": { \"duty\": 100.0, \"changes\": 0 } }", second.text.c_str());
+}
+
+void test_measure_and_failure(void) {
+  SampleRollup rollup;
+  FakePrint out(20);
+
+  rollup.configure(60000, 0);
+  rollup.add(make(0, -150), names);
+  rollup.track(motion(0, true), names);
+  TEST_ASSERT_GREATER_THAN(20, rollup.toJson((Print*) NULL, 1000));
+  TEST_ASSERT_EQUAL(0, rollup.toJson(&out, 1000));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_disabled_rollup_ignores_samples);
+  RUN_TEST(test_measured_channel_statistics);
+  RUN_TEST(test_binary_channel_duty_and_changes);
+  RUN_TEST(test_measure_and_failure);
+  return(UNITY_END());
+}
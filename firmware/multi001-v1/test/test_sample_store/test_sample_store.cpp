@@ -0,0 +1,193 @@
+/**********************************************************************
+ * test_sample_store.cpp - ordering, overflow and flash spooling of
+ * SampleStore.
+ */
+
+#include <unity.h>
+#include <SampleStore.h>
+
+static SAMPLE out[SAMPLE_STORE_SIZE * 2];
+
+static SAMPLE make(uint32_t timestamp) {
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.timestamp = timestamp;
+  sample.lux = SAMPLE_INVALID_VALUE;
+  return(sample);
+}
+
+static void fill(SampleStore &store, uint32_t first, unsigned long count) {
+  for (unsigned long i = 0; i < count; i++) store.push(make(first + i));
+}
+
+void setUp(void) {
+  LittleFS.fakeReset();
+  memset(out, 0, sizeof(out));
+}
+
+void tearDown(void) { }
+
+void test_samples_are_delivered_oldest_first(void) {
+  SampleStore store;
+  size_t n;
+
+  store.begin(false);
+  TEST_ASSERT_TRUE(store.isEmpty());
+  fill(store, 100, 5);
+  TEST_ASSERT_EQUAL(3, (n = store.peek(out, 3)));
+  TEST_ASSERT_EQUAL(100, out[0].timestamp);
+  TEST_ASSERT_EQUAL(102, out[2].timestamp);
+  store.discard(n);
+  TEST_ASSERT_EQUAL(2, store.getCount());
+  TEST_ASSERT_EQUAL(2, store.drain(out, SAMPLE_STORE_SIZE));
+  TEST_ASSERT_EQUAL(103, out[0].timestamp);
+  TEST_ASSERT_TRUE(store.isEmpty());
+}
+
+void test_full_ring_drops_oldest_without_flash(void) {
+  SampleStore store;
+
+  store.begin(false);
+  fill(store, 0, SAMPLE_STORE_SIZE + 6);
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SIZE, store.getCount());
+  TEST_ASSERT_EQUAL(6, store.getDropped());
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SIZE, store.peek(out, SAMPLE_STORE_SIZE * 2));
+  TEST_ASSERT_EQUAL(6, out[0].timestamp);
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SIZE + 5, out[SAMPLE_STORE_SIZE - 1].timestamp);
+  TEST_ASSERT_FALSE(store.flush());
+}
+
+void test_unmountable_flash_behaves_as_no_flash(void) {
+  SampleStore store;
+
+  LittleFS.fakeMountable = false;
+  store.begin(true);
+  fill(store, 0, SAMPLE_STORE_SIZE + 1);
+  TEST_ASSERT_EQUAL(1, store.getDropped());
+  TEST_ASSERT_EQUAL(0, LittleFS.fakeWrites);
+}
+
+/**********************************************************************
+ * A full ring spills its oldest block to flash, and the spool is
+ * drained (and deleted) before the ring.
+ */
+void test_full_ring_spills_to_flash(void) {
+  SampleStore store;
+  size_t n;
+
+  store.begin(true);
+  fill(store, 0, SAMPLE_STORE_SIZE + 1);
+  TEST_ASSERT_EQUAL(0, store.getDropped());
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SIZE + 1, store.getCount());
+  TEST_ASSERT_EQUAL(2, LittleFS.fakeWrites);
+  TEST_ASSERT_EQUAL(sizeof(uint32_t) + (SAMPLE_STORE_SPILL * sizeof(SAMPLE)), LittleFS.fakeUsed());
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SPILL, (n = store.peek(out, SAMPLE_STORE_SIZE * 2)));
+  TEST_ASSERT_EQUAL(0, out[0].timestamp);
+  TEST_ASSERT_EQUAL(0, (out[0].flags & SAMPLE_STALE));
+  store.discard(n);
+  TEST_ASSERT_FALSE(LittleFS.exists(SAMPLE_STORE_FLASH_FILE));
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SIZE - SAMPLE_STORE_SPILL + 1, store.peek(out, SAMPLE_STORE_SIZE * 2));
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SPILL, out[0].timestamp);
+}
+
+/**********************************************************************
+ * A block which wraps around the end of the ring is spilled oldest
+ * first.
+ */
+void test_spill_across_the_end_of_the_ring(void) {
+  SampleStore store;
+  size_t n;
+
+  store.begin(true);
+  fill(store, 0, 40);
+  TEST_ASSERT_EQUAL(40, store.drain(out, SAMPLE_STORE_SIZE));
+  fill(store, 40, SAMPLE_STORE_SIZE + 1);
+  TEST_ASSERT_EQUAL(0, store.getDropped());
+  TEST_ASSERT_EQUAL(sizeof(uint32_t) + (SAMPLE_STORE_SPILL * sizeof(SAMPLE)), LittleFS.fakeUsed());
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SPILL, (n = store.peek(out, SAMPLE_STORE_SIZE * 2)));
+  for (size_t i = 0; i < n; i++) TEST_ASSERT_EQUAL(40 + i, out[i].timestamp);
+}
+
+void test_spool_from_an_earlier_boot_is_stale(void) {
+  SampleStore *before = new SampleStore(), *after = new SampleStore();
+
+  before->begin(true);
+  fill(*before, 0, SAMPLE_STORE_SIZE + 1);
+  delete before;
+  after->begin(true);
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SPILL, after->getCount());
+  fill(*after, 1000, 1);
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SPILL, after->peek(out, SAMPLE_STORE_SIZE * 2));
+  TEST_ASSERT_EQUAL(SAMPLE_STALE, (out[0].flags & SAMPLE_STALE));
+  TEST_ASSERT_EQUAL(SAMPLE_STALE, (out[SAMPLE_STORE_SPILL - 1].flags & SAMPLE_STALE));
+  after->discard(SAMPLE_STORE_SPILL);
+  TEST_ASSERT_EQUAL(1, after->peek(out, SAMPLE_STORE_SIZE * 2));
+  TEST_ASSERT_EQUAL(1000, out[0].timestamp);
+  TEST_ASSERT_EQUAL(0, (out[0].flags & SAMPLE_STALE));
+  delete after;
+}
+
+void test_foreign_spool_is_discarded(void) {
+  SampleStore store;
+  File file = LittleFS.open(SAMPLE_STORE_FLASH_FILE, "w");
+
+  file.write((const uint8_t*) "junk data", 9);
+  file.close();
+  store.begin(true);
+  TEST_ASSERT_TRUE(store.isEmpty());
+  TEST_ASSERT_FALSE(LittleFS.exists(SAMPLE_STORE_FLASH_FILE));
+}
+
+void test_flush_moves_ram_to_flash(void) {
+  SampleStore store;
+
+  store.begin(true);
+  fill(store, 0, 10);
+  TEST_ASSERT_TRUE(store.flush());
+  TEST_ASSERT_EQUAL(10, store.getCount());
+  TEST_ASSERT_EQUAL(sizeof(uint32_t) + (10 * sizeof(SAMPLE)), LittleFS.fakeUsed());
+  TEST_ASSERT_EQUAL(0, store.drain(out, SAMPLE_STORE_SIZE));
+}
+
+/**********************************************************************
+ * A spill which only partly fits is truncated away, so that the spool
+ * still holds whole records, and the store falls back to dropping.
+ */
+void test_full_filesystem_leaves_whole_records(void) {
+  SampleStore store;
+  size_t spooled = (sizeof(uint32_t) + (SAMPLE_STORE_SPILL * sizeof(SAMPLE)));
+
+  LittleFS.fakeCapacity = (spooled + (sizeof(SAMPLE) / 2));
+  store.begin(true);
+  fill(store, 0, SAMPLE_STORE_SIZE + SAMPLE_STORE_SPILL + 1);
+  TEST_ASSERT_EQUAL(spooled, LittleFS.fakeUsed());
+  TEST_ASSERT_EQUAL(1, store.getDropped());
+  TEST_ASSERT_EQUAL(SAMPLE_STORE_SIZE + SAMPLE_STORE_SPILL, store.getCount());
+}
+
+void test_spool_is_capped(void) {
+  SampleStore store;
+  unsigned long pushed = ((SAMPLE_STORE_FLASH_LIMIT / sizeof(SAMPLE)) + (2 * SAMPLE_STORE_SIZE));
+
+  store.begin(true);
+  fill(store, 0, pushed);
+  TEST_ASSERT_TRUE(LittleFS.fakeUsed() <= SAMPLE_STORE_FLASH_LIMIT);
+  TEST_ASSERT_GREATER_THAN(0, store.getDropped());
+  TEST_ASSERT_EQUAL(pushed, store.getCount() + store.getDropped());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_samples_are_delivered_oldest_first);
+  RUN_TEST(test_full_ring_drops_oldest_without_flash);
+  RUN_TEST(test_unmountable_flash_behaves_as_no_flash);
+  RUN_TEST(test_full_ring_spills_to_flash);
+  RUN_TEST(test_spill_across_the_end_of_the_ring);
+  RUN_TEST(test_spool_from_an_earlier_boot_is_stale);
+  RUN_TEST(test_foreign_spool_is_discarded);
+  RUN_TEST(test_flush_moves_ram_to_flash);
+  RUN_TEST(test_full_filesystem_leaves_whole_records);
+  RUN_TEST(test_spool_is_capped);
+  return(UNITY_END());
+}
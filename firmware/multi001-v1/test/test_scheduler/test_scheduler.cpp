@@ -0,0 +1,150 @@
+/**********************************************************************
+ * test_scheduler.cpp - due times, overruns and statistics of the
+ * cooperative Scheduler.
+ */
+
+#include <unity.h>
+#include <Scheduler.h>
+
+static unsigned long calls[SCHEDULER_MAX_TASKS];
+static unsigned long callTimes[64];
+static unsigned long costMicros;          // Run time of each task call
+
+static void task(void *arg) {
+  uintptr_t id = (uintptr_t) arg;
+
+  if ((id == 0) && (calls[0] < (sizeof(callTimes) / sizeof(callTimes[0])))) callTimes[calls[0]] = millis();
+  calls[id]++;
+  fakeAdvanceMicros(costMicros);
+}
+
+/**********************************************************************
+ * Run <scheduler> for <duration> milliseconds, one pass per
+ * millisecond.
+ */
+static void run(Scheduler &scheduler, unsigned long duration) {
+  unsigned long end = (millis() + duration);
+
+  while (millis() < end) {
+    scheduler.loop();
+    fakeAdvance(1);
+  }
+}
+
+void setUp(void) {
+  fakeReset();
+  memset(calls, 0, sizeof(calls));
+  costMicros = 0;
+}
+
+void tearDown(void) { }
+
+void test_interval_and_every_pass_tasks(void) {
+  Scheduler scheduler;
+
+  TEST_ASSERT_EQUAL(0, scheduler.add("periodic", task, (void*) 0, 100));
+  TEST_ASSERT_EQUAL(1, scheduler.add("always", task, (void*) 1, 0));
+  run(scheduler, 1000);
+  TEST_ASSERT_EQUAL(10, calls[0]);
+  TEST_ASSERT_EQUAL(1000, calls[1]);
+  TEST_ASSERT_EQUAL(0, callTimes[0]);
+  TEST_ASSERT_EQUAL(900, callTimes[9]);
+}
+
+/**********************************************************************
+ * A task which runs late keeps its phase, so it does not drift.
+ */
+void test_no_drift(void) {
+  Scheduler scheduler;
+
+  scheduler.add("periodic", task, (void*) 0, 100);
+  scheduler.loop();
+  fakeAdvance(130);
+  scheduler.loop();
+  fakeAdvance(70);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(3, calls[0]);
+  TEST_ASSERT_EQUAL(130, callTimes[1]);
+  TEST_ASSERT_EQUAL(200, callTimes[2]);
+  TEST_ASSERT_EQUAL(0, scheduler.getOverruns(0));
+}
+
+void test_missed_interval_counts_an_overrun(void) {
+  Scheduler scheduler;
+
+  scheduler.add("periodic", task, (void*) 0, 100);
+  scheduler.loop();
+  fakeAdvance(350);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(1, scheduler.getOverruns(0));
+  fakeAdvance(99);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(2, calls[0]);
+  fakeAdvance(1);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(3, calls[0]);
+}
+
+void test_trigger_and_set_interval(void) {
+  Scheduler scheduler;
+
+  scheduler.add("periodic", task, (void*) 0, 1000);
+  run(scheduler, 10);
+  TEST_ASSERT_EQUAL(1, calls[0]);
+  scheduler.trigger(0);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(2, calls[0]);
+  // The new interval applies from the next run.
+  scheduler.setInterval(0, 10);
+  run(scheduler, 20);
+  TEST_ASSERT_EQUAL(2, calls[0]);
+  scheduler.trigger(0);
+  run(scheduler, 20);
+  TEST_ASSERT_EQUAL(4, calls[0]);
+  // Unknown tasks are ignored.
+  scheduler.trigger(5);
+  scheduler.setInterval(-1, 5);
+}
+
+void test_table_full(void) {
+  Scheduler scheduler;
+
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) TEST_ASSERT_EQUAL(i, scheduler.add("task", task, (void*) 0, 0));
+  TEST_ASSERT_EQUAL(SCHEDULER_NO_TASK, scheduler.add("extra", task, (void*) 0, 0));
+  TEST_ASSERT_EQUAL(SCHEDULER_MAX_TASKS, scheduler.getCount());
+}
+
+void test_statistics_and_reset(void) {
+  Scheduler scheduler;
+  char json[128];
+
+  scheduler.add("mqtt", task, (void*) 0, 0);
+  costMicros = 40;
+  scheduler.loop();
+  costMicros = 250;
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(2, scheduler.getRuns(0));
+  TEST_ASSERT_EQUAL(290, scheduler.getTotalTime(0));
+  TEST_ASSERT_EQUAL(250, scheduler.getMaxTime(0));
+  TEST_ASSERT_GREATER_THAN(0, scheduler.toJson(json, sizeof(json)));
+  TEST_ASSERT_EQUAL_STRING("{ \"mqtt\": { \"runs\": 2, \"overruns\": 0, \"total\": 290, \"max\": 250 } }", json);
+  TEST_ASSERT_EQUAL(0, scheduler.toJson(json, 20));
+  scheduler.reset();
+  TEST_ASSERT_EQUAL(0, scheduler.getRuns(0));
+  TEST_ASSERT_EQUAL(0, scheduler.getTotalTime(0));
+  TEST_ASSERT_EQUAL(0, scheduler.getMaxTime(0));
+  costMicros = 10;
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(10, scheduler.getTotalTime(0));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_interval_and_every_pass_tasks);
+  RUN_TEST(test_no_drift);
+  RUN_TEST(test_missed_interval_counts_an_overrun);
+  RUN_TEST(test_trigger_and_set_interval);
+  RUN_TEST(test_table_full);
+  RUN_TEST(test_statistics_and_reset);
+  return(UNITY_END());
+}